@@ -0,0 +1,142 @@
+/*
+ * Unit tests of src/json-writer.c and src/json-reader.c, run by `make test`.
+ * The response goes to a buffer instead of a socket, see the httpd_* fakes below.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_http_server.h"
+#include "json-reader.h"
+#include "json-writer.h"
+
+static char s_body[4096];
+static size_t s_body_len;
+static int s_failed;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            s_failed++; \
+        } \
+    } while (0)
+
+static void body_append(const char *buf, ssize_t len) {
+    if (len == HTTPD_RESP_USE_STRLEN) {
+        len = buf ? strlen(buf) : 0;
+    }
+    if (len > 0 && s_body_len + len <= sizeof(s_body)) {
+        memcpy(s_body + s_body_len, buf, len);
+        s_body_len += len;
+    }
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    body_append(buf, buf_len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    body_append(buf, buf_len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+    return ESP_ERR_NOT_FOUND;
+}
+
+static void writer_begin(json_writer_t *json, json_format_t format) {
+    static httpd_req_t req;
+    s_body_len = 0;
+    json_writer_init_format(json, &req, format);
+}
+
+static void writer_end(json_writer_t *json) {
+    CHECK(json_writer_finish(json) == ESP_OK);
+    s_body[s_body_len] = '\0';
+}
+
+static void test_writer_non_finite(void) {
+    json_writer_t json;
+
+    writer_begin(&json, JSON_FORMAT_TEXT);
+    json_obj_begin(&json);
+    json_key(&json, "a");
+    json_float(&json, NAN, 2);
+    json_key(&json, "b");
+    json_arr_begin(&json);
+    json_float(&json, 1, 2);
+    json_float(&json, INFINITY, 2);
+    json_float(&json, -INFINITY, 2);
+    json_arr_end(&json);
+    json_key(&json, "c");
+    json_float(&json, 2.5, 1);
+    json_obj_end(&json);
+    writer_end(&json);
+    CHECK(strcmp(s_body, "{\"a\":null,\"b\":[1.00,null,null],\"c\":2.5}") == 0);
+
+    writer_begin(&json, JSON_FORMAT_CBOR);
+    json_arr_begin(&json);
+    json_float(&json, NAN, 2);
+    json_arr_end(&json);
+    writer_end(&json);
+    CHECK(s_body_len == 3 && memcmp(s_body, "\x9F\xF6\xFF", 3) == 0);
+}
+
+typedef struct {
+    const char *text;
+    size_t pos;
+} text_source_t;
+
+static int text_read(void *ctx, char *buf, size_t len) {
+    text_source_t *src = (text_source_t *)ctx;
+    size_t n = strlen(src->text + src->pos);
+    n = n < len ? n : len;
+    memcpy(buf, src->text + src->pos, n);
+    src->pos += n;
+    return n;
+}
+
+/* Parses a document holding a single number, false if it is rejected */
+static bool read_single_number(const char *text, double *number) {
+    text_source_t src = { text, 0 };
+    json_reader_t reader;
+    json_reader_init(&reader, text_read, &src);
+    if (json_reader_next(&reader) != JSON_NUMBER) {
+        return false;
+    }
+    *number = reader.number;
+    return json_reader_next(&reader) == JSON_END;
+}
+
+static void test_reader_long_numbers(void) {
+    char text[256];
+    double number;
+
+    // 100 digits
+    memset(text, '0', 100);
+    text[0] = '1';
+    text[100] = '\0';
+    CHECK(read_single_number(text, &number) && number == 1e99);
+
+    snprintf(text, sizeof(text), "-0.%0*d1e+3", 80, 0);
+    CHECK(read_single_number(text, &number) && number == -1e-78);
+
+    snprintf(text, sizeof(text), "3.14159265358979323846264338327950288419716939937510582097494459");
+    CHECK(read_single_number(text, &number) && number == 3.14159265358979323846);
+
+    snprintf(text, sizeof(text), "1%0*de-90", 70, 0);
+    CHECK(read_single_number(text, &number) && number == 1e-20);
+
+    CHECK(read_single_number("12.5e1", &number) && number == 125);
+    CHECK(!read_single_number("1.", &number));
+    CHECK(!read_single_number("01", &number));
+    CHECK(!read_single_number("-", &number));
+    CHECK(!read_single_number("1e", &number));
+}
+
+int main(void) {
+    test_writer_non_finite();
+    test_reader_long_numbers();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+#include <unistd.h>
+
+/* The firmware's entry point, src/main.c */
+void app_main(void);
+
+int main(void) {
+    // like the IDF main task, app_main returns and the tasks it started keep running
+    app_main();
+    for (;;) {
+        pause();
+    }
+}
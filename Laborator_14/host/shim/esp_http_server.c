@@ -0,0 +1,798 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define HOST_HTTPD_DEFAULT_PORT 8080    // used instead of port 80, which needs root
+#define HOST_HTTPD_HEAD_MAX     (CONFIG_HTTPD_MAX_URI_LEN + CONFIG_HTTPD_MAX_REQ_HDR_LEN + 64)
+#define HOST_HTTPD_RESP_HDR_MAX 512
+
+static const char *TAG = "httpd_host";
+
+typedef struct {
+    int fd;
+    uint64_t last_used;                 // request counter value, for the LRU purge
+    size_t len;                         // bytes in buf, a request head and what followed it
+    void *ctx;                          // httpd_sess_set_ctx(), or req->sess_ctx of the last request
+    httpd_free_ctx_fn_t free_ctx;
+    char buf[HOST_HTTPD_HEAD_MAX];
+} host_sess_t;
+
+typedef struct {
+    httpd_work_fn_t fn;
+    void *arg;
+} host_work_t;
+
+typedef struct {
+    httpd_config_t config;
+    pthread_mutex_t handlers_lock;      // handlers may be registered while the server runs
+    httpd_uri_t *handlers;
+    size_t handler_count;
+    host_sess_t *sessions;
+    int listen_fd;
+    int work_pipe[2];                   // the ctrl socket of the real server
+    uint64_t requests;
+} host_httpd_t;
+
+/* Per request state, req->aux */
+typedef struct {
+    host_httpd_t *server;
+    host_sess_t *sess;
+    const char *query;                  // after the '?' of the URI, NULL without one
+    char *headers;                      // "Field: value\r\n" lines of the request head
+    size_t headers_len;
+    size_t body_buffered;               // body bytes already in sess->buf after the head
+    size_t remaining;                   // body bytes not yet given to the handler
+    bool close;
+    const char *status;
+    const char *type;
+    const char *hdr_fields[16];
+    const char *hdr_values[16];
+    size_t hdr_count;
+    bool headers_sent;
+    bool chunked;
+} host_req_aux_t;
+
+typedef enum { SESS_KEEP, SESS_CLOSE } sess_state_t;
+
+static const char *s_err_status[HTTPD_ERR_CODE_MAX] = {
+    [HTTPD_500_INTERNAL_SERVER_ERROR]       = "500 Internal Server Error",
+    [HTTPD_501_METHOD_NOT_IMPLEMENTED]      = "501 Method Not Implemented",
+    [HTTPD_505_VERSION_NOT_SUPPORTED]       = "505 Version Not Supported",
+    [HTTPD_400_BAD_REQUEST]                 = "400 Bad Request",
+    [HTTPD_401_UNAUTHORIZED]                = "401 Unauthorized",
+    [HTTPD_403_FORBIDDEN]                   = "403 Forbidden",
+    [HTTPD_404_NOT_FOUND]                   = "404 Not Found",
+    [HTTPD_405_METHOD_NOT_ALLOWED]          = "405 Method Not Allowed",
+    [HTTPD_408_REQ_TIMEOUT]                 = "408 Request Timeout",
+    [HTTPD_411_LENGTH_REQUIRED]             = "411 Length Required",
+    [HTTPD_414_URI_TOO_LONG]                = "414 URI Too Long",
+    [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE]    = "431 Request Header Fields Too Large",
+};
+
+static const char *s_err_message[HTTPD_ERR_CODE_MAX] = {
+    [HTTPD_500_INTERNAL_SERVER_ERROR]       = "Server has encountered an unexpected error",
+    [HTTPD_501_METHOD_NOT_IMPLEMENTED]      = "Request method is not supported by server",
+    [HTTPD_505_VERSION_NOT_SUPPORTED]       = "HTTP version not supported by server",
+    [HTTPD_400_BAD_REQUEST]                 = "Bad request syntax",
+    [HTTPD_401_UNAUTHORIZED]                = "No permission -- see authorization schemes",
+    [HTTPD_403_FORBIDDEN]                   = "Request forbidden -- authorization will not help",
+    [HTTPD_404_NOT_FOUND]                   = "Nothing matches the given URI",
+    [HTTPD_405_METHOD_NOT_ALLOWED]          = "Specified method is invalid for this resource",
+    [HTTPD_408_REQ_TIMEOUT]                 = "Server closed this connection",
+    [HTTPD_411_LENGTH_REQUIRED]             = "Client must specify Content-Length",
+    [HTTPD_414_URI_TOO_LONG]                = "URI is too long",
+    [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE]    = "Header fields are too long",
+};
+
+static const char *s_methods[] = {
+    [HTTP_DELETE] = "DELETE", [HTTP_GET] = "GET", [HTTP_HEAD] = "HEAD", [HTTP_POST] = "POST",
+    [HTTP_PUT] = "PUT", [HTTP_CONNECT] = "CONNECT", [HTTP_OPTIONS] = "OPTIONS",
+};
+
+static int send_all(int fd, const char *buf, size_t len) {
+    while (len) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return HTTPD_SOCK_ERR_FAIL;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void sess_free_ctx(host_sess_t *sess) {
+    if (sess->ctx) {
+        if (sess->free_ctx) {
+            sess->free_ctx(sess->ctx);
+        } else {
+            free(sess->ctx);
+        }
+    }
+    sess->ctx = NULL;
+    sess->free_ctx = NULL;
+}
+
+static void sess_close(host_sess_t *sess) {
+    if (sess->fd >= 0) {
+        close(sess->fd);
+        sess->fd = -1;
+        sess->len = 0;
+        sess_free_ctx(sess);
+    }
+}
+
+static host_sess_t *sess_find(host_httpd_t *server, int fd) {
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd == fd && fd >= 0) {
+            return &server->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+/* ---- URI matching ---- */
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto) {
+    size_t tpl_len = strlen(uri_template);
+    char last = tpl_len > 0 ? uri_template[tpl_len - 1] : 0;
+    char prevlast = tpl_len > 1 ? uri_template[tpl_len - 2] : 0;
+    bool asterisk = last == '*' || (prevlast == '*' && last == '?');
+    bool quest = last == '?' || (prevlast == '?' && last == '*');
+    size_t exact = tpl_len - asterisk - quest;
+
+    if (tpl_len < (size_t)(asterisk + quest * 2)) {
+        return false;
+    }
+    if (match_upto >= exact && strncmp(uri_template, uri_to_match, exact) == 0) {
+        return asterisk || match_upto == exact;
+    }
+    // "/path/?" also matches "/path", without the character before the '?'
+    return quest && match_upto == exact - 1 && strncmp(uri_template, uri_to_match, exact - 1) == 0;
+}
+
+static bool uri_matches(const host_httpd_t *server, const char *tpl, const char *uri, size_t len) {
+    if (server->config.uri_match_fn) {
+        return server->config.uri_match_fn(tpl, uri, len);
+    }
+    return strlen(tpl) == len && strncmp(tpl, uri, len) == 0;
+}
+
+/* ---- request ---- */
+
+static host_req_aux_t *req_aux(httpd_req_t *r) {
+    return (host_req_aux_t *)r->aux;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+    return r && r->aux ? req_aux(r)->sess->fd : -1;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    host_req_aux_t *aux = req_aux(r);
+    if (buf_len > aux->remaining) {
+        buf_len = aux->remaining;
+    }
+    if (buf_len == 0) {
+        return 0;
+    }
+    if (aux->body_buffered) {
+        size_t n = buf_len < aux->body_buffered ? buf_len : aux->body_buffered;
+        host_sess_t *sess = aux->sess;
+        memcpy(buf, sess->buf, n);
+        memmove(sess->buf, sess->buf + n, sess->len - n);
+        sess->len -= n;
+        aux->body_buffered -= n;
+        aux->remaining -= n;
+        return n;
+    }
+    ssize_t n = recv(aux->sess->fd, buf, buf_len, 0);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    aux->remaining -= n;
+    return n;
+}
+
+static const char *find_header(httpd_req_t *r, const char *field, size_t *len) {
+    host_req_aux_t *aux = req_aux(r);
+    size_t field_len = strlen(field);
+    const char *line = aux->headers;
+    const char *end = aux->headers + aux->headers_len;
+    while (line < end) {
+        const char *eol = memchr(line, '\r', end - line);
+        if (!eol) {
+            eol = end;
+        }
+        if ((size_t)(eol - line) > field_len && line[field_len] == ':' && strncasecmp(line, field, field_len) == 0) {
+            const char *value = line + field_len + 1;
+            while (value < eol && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            *len = eol - value;
+            return value;
+        }
+        line = eol + 2;
+    }
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+    size_t len;
+    return find_header(r, field, &len) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+    size_t len;
+    const char *value = find_header(r, field, &len);
+    if (!value) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t n = len < val_size - 1 ? len : val_size - 1;
+    memcpy(val, value, n);
+    val[n] = '\0';
+    return n < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+    const char *query = req_aux(r)->query;
+    return query ? strlen(query) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+    const char *query = req_aux(r)->query;
+    if (!query) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (buf_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t len = strlen(query);
+    size_t n = len < buf_len - 1 ? len : buf_len - 1;
+    memcpy(buf, query, n);
+    buf[n] = '\0';
+    return n < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+    if (!qry || !key || !val || val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t key_len = strlen(key);
+    const char *p = qry;
+    while (*p) {
+        const char *end = strchr(p, '&');
+        if (!end) {
+            end = p + strlen(p);
+        }
+        const char *eq = memchr(p, '=', end - p);
+        if (eq && (size_t)(eq - p) == key_len && strncmp(p, key, key_len) == 0) {
+            size_t len = end - eq - 1;
+            size_t n = len < val_size - 1 ? len : val_size - 1;
+            memcpy(val, eq + 1, n);
+            val[n] = '\0';
+            return n < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/* ---- response ---- */
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    req_aux(r)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    req_aux(r)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+    host_req_aux_t *aux = req_aux(r);
+    if (aux->hdr_count >= aux->server->config.max_resp_headers ||
+        aux->hdr_count >= sizeof(aux->hdr_fields) / sizeof(aux->hdr_fields[0])) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    // like the real server, only the pointers are kept until the response is sent
+    aux->hdr_fields[aux->hdr_count] = field;
+    aux->hdr_values[aux->hdr_count] = value;
+    aux->hdr_count++;
+    return ESP_OK;
+}
+
+static esp_err_t send_head(httpd_req_t *r, const char *length_header) {
+    host_req_aux_t *aux = req_aux(r);
+    char head[HOST_HTTPD_RESP_HDR_MAX];
+    int len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s",
+                       aux->status, aux->type, length_header);
+    for (size_t i = 0; i < aux->hdr_count && len < (int)sizeof(head); i++) {
+        len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n", aux->hdr_fields[i], aux->hdr_values[i]);
+    }
+    if (aux->close && len < (int)sizeof(head)) {
+        len += snprintf(head + len, sizeof(head) - len, "Connection: close\r\n");
+    }
+    if (len + 2 >= (int)sizeof(head)) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    memcpy(head + len, "\r\n", 2);
+    aux->headers_sent = true;
+    return send_all(aux->sess->fd, head, len + 2) == 0 ? ESP_OK : ESP_ERR_HTTPD_RESP_SEND;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    host_req_aux_t *aux = req_aux(r);
+    if (aux->headers_sent) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? strlen(buf) : 0;
+    }
+    char length[48];
+    snprintf(length, sizeof(length), "Content-Length: %d\r\n", (int)buf_len);
+    esp_err_t err = send_head(r, length);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (buf_len && r->method != HTTP_HEAD && send_all(aux->sess->fd, buf, buf_len) != 0) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+int httpd_send(httpd_req_t *r, const char *buf, size_t buf_len) {
+    host_req_aux_t *aux = req_aux(r);
+    // the caller writes the raw response, the server must not add a head of its own
+    aux->headers_sent = true;
+    return send_all(aux->sess->fd, buf, buf_len) == 0 ? (int)buf_len : HTTPD_SOCK_ERR_FAIL;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    host_req_aux_t *aux = req_aux(r);
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? strlen(buf) : 0;
+    }
+    if (!aux->headers_sent) {
+        esp_err_t err = send_head(r, "Transfer-Encoding: chunked\r\n");
+        if (err != ESP_OK) {
+            return err;
+        }
+        aux->chunked = true;
+    } else if (!aux->chunked) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+
+    char size[16];
+    int len = snprintf(size, sizeof(size), "%x\r\n", (unsigned)buf_len);
+    if (send_all(aux->sess->fd, size, len) != 0 ||
+        (buf_len && send_all(aux->sess->fd, buf, buf_len) != 0) ||
+        send_all(aux->sess->fd, "\r\n", 2) != 0) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    if (buf_len == 0) {
+        aux->chunked = false;   // the last chunk, the response is complete
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    if ((int)error < 0 || error >= HTTPD_ERR_CODE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_resp_set_status(req, s_err_status[error]);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_sendstr(req, msg ? msg : s_err_message[error]);
+}
+
+/* ---- WebSocket, not implemented on the host ---- */
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd) {
+    host_httpd_t *server = hd;
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd == fd && fd >= 0) {
+            return HTTPD_WS_CLIENT_HTTP;
+        }
+    }
+    return HTTPD_WS_CLIENT_INVALID;
+}
+
+/* ---- sessions ---- */
+
+void *httpd_sess_get_ctx(httpd_handle_t handle, int sockfd) {
+    host_sess_t *sess = sess_find(handle, sockfd);
+    return sess ? sess->ctx : NULL;
+}
+
+void httpd_sess_set_ctx(httpd_handle_t handle, int sockfd, void *ctx, httpd_free_ctx_fn_t free_fn) {
+    host_sess_t *sess = sess_find(handle, sockfd);
+    if (!sess) {
+        return;
+    }
+    if (sess->ctx != ctx) {
+        sess_free_ctx(sess);
+    }
+    sess->ctx = ctx;
+    sess->free_ctx = free_fn;
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+    if (httpd_ws_get_fd_info(hd, sockfd) == HTTPD_WS_CLIENT_INVALID) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    return send_all(sockfd, buf, buf_len) == 0 ? (int)buf_len : HTTPD_SOCK_ERR_FAIL;
+}
+
+static void trigger_close(void *arg) {
+    host_sess_t *sess = arg;
+    sess_close(sess);
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    host_httpd_t *server = handle;
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd == sockfd && sockfd >= 0) {
+            return httpd_queue_work(server, trigger_close, &server->sessions[i]);
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/* ---- server task ---- */
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    host_httpd_t *server = handle;
+    if (!server || !uri_handler || !uri_handler->uri || !uri_handler->handler) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&server->handlers_lock);
+    for (size_t i = 0; i < server->handler_count && err == ESP_OK; i++) {
+        if (server->handlers[i].method == uri_handler->method && strcmp(server->handlers[i].uri, uri_handler->uri) == 0) {
+            err = ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (err == ESP_OK && server->handler_count == server->config.max_uri_handlers) {
+        err = ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    if (err == ESP_OK) {
+        server->handlers[server->handler_count++] = *uri_handler;
+    }
+    pthread_mutex_unlock(&server->handlers_lock);
+    return err;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+    host_httpd_t *server = handle;
+    host_work_t item = { .fn = work, .arg = arg };
+    if (!server || !work) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // a pipe write this small is atomic, like a datagram to the ctrl socket
+    return write(server->work_pipe[1], &item, sizeof(item)) == sizeof(item) ? ESP_OK : ESP_FAIL;
+}
+
+static int parse_method(const char *name, size_t len) {
+    for (size_t i = 0; i < sizeof(s_methods) / sizeof(s_methods[0]); i++) {
+        if (strlen(s_methods[i]) == len && strncmp(s_methods[i], name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void send_server_err(host_httpd_t *server, host_sess_t *sess, httpd_err_code_t error) {
+    char response[256];
+    const char *msg = s_err_message[error];
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 %s\r\nContent-Type: text/html\r\nContent-Length: %d\r\nConnection: close\r\n\r\n%s",
+                       s_err_status[error], (int)strlen(msg), msg);
+    send_all(sess->fd, response, len);
+}
+
+static void dispatch(host_httpd_t *server, httpd_req_t *req, host_req_aux_t *aux, size_t path_len) {
+    httpd_uri_t handler;
+    bool uri_found = false;
+    bool found = false;
+    pthread_mutex_lock(&server->handlers_lock);
+    for (size_t i = 0; i < server->handler_count && !found; i++) {
+        if (uri_matches(server, server->handlers[i].uri, req->uri, path_len)) {
+            uri_found = true;
+            found = (int)server->handlers[i].method == req->method;
+            handler = server->handlers[i];
+        }
+    }
+    pthread_mutex_unlock(&server->handlers_lock);
+
+    if (!found) {
+        httpd_resp_send_err(req, uri_found ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, NULL);
+    } else if (handler.is_websocket) {
+        aux->close = true;
+        httpd_resp_send_err(req, HTTPD_501_METHOD_NOT_IMPLEMENTED, "WebSocket is not supported by the host build");
+    } else {
+        req->user_ctx = handler.user_ctx;
+        if (handler.handler(req) != ESP_OK) {
+            aux->close = true;  // a failed handler closes the connection, as on the board
+        }
+    }
+}
+
+/* Handles the request whose head ends at head_len in sess->buf */
+static sess_state_t handle_request(host_httpd_t *server, host_sess_t *sess, size_t head_len) {
+    char *head = sess->buf;
+    char *line_end = strstr(head, "\r\n");
+    char *sp1 = memchr(head, ' ', line_end - head);
+    char *sp2 = sp1 ? memchr(sp1 + 1, ' ', line_end - sp1 - 1) : NULL;
+    if (!sp1 || !sp2 || strncmp(sp2 + 1, "HTTP/1.", 7) != 0) {
+        send_server_err(server, sess, HTTPD_400_BAD_REQUEST);
+        return SESS_CLOSE;
+    }
+    int method = parse_method(head, sp1 - head);
+    if (method < 0) {
+        send_server_err(server, sess, HTTPD_501_METHOD_NOT_IMPLEMENTED);
+        return SESS_CLOSE;
+    }
+    size_t uri_len = sp2 - sp1 - 1;
+    if (uri_len > CONFIG_HTTPD_MAX_URI_LEN) {
+        send_server_err(server, sess, HTTPD_414_URI_TOO_LONG);
+        return SESS_CLOSE;
+    }
+    if ((size_t)(head + head_len - (line_end + 2)) > CONFIG_HTTPD_MAX_REQ_HDR_LEN) {
+        send_server_err(server, sess, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE);
+        return SESS_CLOSE;
+    }
+
+    httpd_req_t req = { .handle = server, .method = method, .sess_ctx = sess->ctx, .free_ctx = sess->free_ctx };
+    host_req_aux_t aux = {
+        .server = server,
+        .sess = sess,
+        .headers = line_end + 2,
+        .headers_len = head + head_len - 2 - (line_end + 2),
+        .status = "200 OK",
+        .type = HTTPD_TYPE_TEXT,
+        .close = strncmp(sp2 + 1, "HTTP/1.0", 8) == 0,
+    };
+    req.aux = &aux;
+    memcpy((char *)req.uri, sp1 + 1, uri_len);
+    char *question = memchr(req.uri, '?', uri_len);
+    aux.query = question ? question + 1 : NULL;
+
+    char value[32];
+    if (httpd_req_get_hdr_value_str(&req, "Connection", value, sizeof(value)) == ESP_OK) {
+        aux.close = strcasecmp(value, "close") == 0 || (aux.close && strcasecmp(value, "keep-alive") != 0);
+    }
+    if (httpd_req_get_hdr_value_str(&req, "Content-Length", value, sizeof(value)) == ESP_OK) {
+        req.content_len = strtoul(value, NULL, 10);
+    } else if (httpd_req_get_hdr_value_len(&req, "Transfer-Encoding")) {
+        send_server_err(server, sess, HTTPD_411_LENGTH_REQUIRED);
+        return SESS_CLOSE;
+    }
+
+    // the head stays in the buffer for the headers, the body after it is moved to the front afterwards
+    size_t after_head = sess->len - head_len;
+    aux.body_buffered = after_head < req.content_len ? after_head : req.content_len;
+    aux.remaining = req.content_len;
+
+    char body_start[HOST_HTTPD_HEAD_MAX];
+    memcpy(body_start, sess->buf + head_len, after_head);
+    char head_copy[HOST_HTTPD_HEAD_MAX];
+    memcpy(head_copy, sess->buf, head_len);
+    aux.headers = head_copy + (aux.headers - sess->buf);
+    memcpy(sess->buf, body_start, after_head);
+    sess->len = after_head;
+
+    dispatch(server, &req, &aux, question ? (size_t)(question - req.uri) : uri_len);
+
+    // as in the real server, a context the handler set in the request replaces the session's
+    if (!req.ignore_sess_ctx_changes && req.sess_ctx != sess->ctx) {
+        sess_free_ctx(sess);
+    }
+    sess->ctx = req.sess_ctx;
+    sess->free_ctx = req.free_ctx;
+
+    // the part of the body the handler did not read is discarded
+    char purge[32];
+    while (aux.remaining) {
+        int n = httpd_req_recv(&req, purge, sizeof(purge));
+        if (n <= 0) {
+            return SESS_CLOSE;
+        }
+    }
+    if (aux.chunked) {
+        return SESS_CLOSE;   // the handler never sent the last chunk
+    }
+    return aux.close ? SESS_CLOSE : SESS_KEEP;
+}
+
+/* Handles every complete request in the session's buffer, false when the session has to close */
+static bool sess_drain(host_httpd_t *server, host_sess_t *sess) {
+    for (;;) {
+        sess->buf[sess->len] = '\0';
+        char *end = strstr(sess->buf, "\r\n\r\n");
+        if (!end) {
+            if (sess->len == sizeof(sess->buf) - 1) {
+                send_server_err(server, sess, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE);
+                return false;
+            }
+            return true;
+        }
+        sess_state_t state = handle_request(server, sess, end + 4 - sess->buf);
+        if (state != SESS_KEEP) {
+            return false;
+        }
+    }
+}
+
+/* Reads from the session and handles what came in, false when the session has to close */
+static bool sess_process(host_httpd_t *server, host_sess_t *sess) {
+    ssize_t n = recv(sess->fd, sess->buf + sess->len, sizeof(sess->buf) - 1 - sess->len, 0);
+    if (n <= 0) {
+        return n < 0 && (errno == EAGAIN || errno == EINTR);
+    }
+    sess->len += n;
+    sess->last_used = ++server->requests;
+    return sess_drain(server, sess);
+}
+
+static void sess_accept(host_httpd_t *server) {
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    host_sess_t *free_sess = NULL;
+    host_sess_t *lru = NULL;
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        host_sess_t *sess = &server->sessions[i];
+        if (sess->fd < 0) {
+            free_sess = sess;
+            break;
+        }
+        if (!lru || sess->last_used < lru->last_used) {
+            lru = sess;
+        }
+    }
+    if (!free_sess && lru && server->config.lru_purge_enable) {
+        ESP_LOGW(TAG, "closing least recently used socket %d", lru->fd);
+        sess_close(lru);
+        free_sess = lru;
+    }
+    if (!free_sess) {
+        ESP_LOGW(TAG, "no free sockets, closing new connection");
+        close(fd);
+        return;
+    }
+
+    struct timeval recv_timeout = { .tv_sec = server->config.recv_wait_timeout };
+    struct timeval send_timeout = { .tv_sec = server->config.send_wait_timeout };
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    free_sess->fd = fd;
+    free_sess->len = 0;
+    free_sess->last_used = ++server->requests;
+}
+
+static void server_task(void *arg) {
+    host_httpd_t *server = arg;
+    int max_socks = server->config.max_open_sockets;
+    struct pollfd *fds = calloc(max_socks + 2, sizeof(struct pollfd));
+    host_sess_t **polled = calloc(max_socks, sizeof(host_sess_t *));
+
+    for (;;) {
+        int count = 0;
+        fds[count++] = (struct pollfd){ .fd = server->work_pipe[0], .events = POLLIN };
+        fds[count++] = (struct pollfd){ .fd = server->listen_fd, .events = POLLIN };
+        for (int i = 0; i < max_socks; i++) {
+            if (server->sessions[i].fd >= 0) {
+                polled[count - 2] = &server->sessions[i];
+                fds[count++] = (struct pollfd){ .fd = server->sessions[i].fd, .events = POLLIN };
+            }
+        }
+        if (poll(fds, count, -1) < 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            host_work_t item;
+            if (read(server->work_pipe[0], &item, sizeof(item)) == sizeof(item)) {
+                item.fn(item.arg);
+            }
+        }
+        for (int i = 2; i < count; i++) {
+            if (fds[i].revents && !sess_process(server, polled[i - 2])) {
+                sess_close(polled[i - 2]);
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            sess_accept(server);
+        }
+    }
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    if (!handle || !config || config->max_open_sockets == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_httpd_t *server = calloc(1, sizeof(host_httpd_t));
+    if (!server) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    server->config = *config;
+    pthread_mutex_init(&server->handlers_lock, NULL);
+    server->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    server->sessions = calloc(config->max_open_sockets, sizeof(host_sess_t));
+    if (!server->handlers || !server->sessions || pipe(server->work_pipe) != 0) {
+        free(server->handlers);
+        free(server->sessions);
+        free(server);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    for (int i = 0; i < config->max_open_sockets; i++) {
+        server->sessions[i].fd = -1;
+    }
+
+    uint16_t port = config->server_port == 80 ? HOST_HTTPD_DEFAULT_PORT : config->server_port;
+    const char *env_port = getenv("HTTPD_PORT");
+    if (env_port) {
+        port = atoi(env_port);
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int one = 1;
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->listen_fd < 0 ||
+        setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server->listen_fd, config->backlog_conn) != 0) {
+        ESP_LOGE(TAG, "cannot listen on port %u: %s", port, strerror(errno));
+        return ESP_ERR_HTTPD_TASK;
+    }
+    if (xTaskCreatePinnedToCore(server_task, "httpd", config->stack_size, server,
+                                config->task_priority, NULL, config->core_id) != pdPASS) {
+        return ESP_ERR_HTTPD_TASK;
+    }
+    ESP_LOGI(TAG, "listening on port %u", port);
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;   // the host build serves until the process exits
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+#include <unistd.h>
+#include "esp_err.h"
+
+typedef enum { ESP_MAC_WIFI_STA, ESP_MAC_WIFI_SOFTAP, ESP_MAC_BT, ESP_MAC_ETH } esp_mac_type_t;
+
+/* A locally administered address from the pid, distinct for every host instance */
+static inline esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+    uint32_t pid = (uint32_t)getpid();
+    mac[0] = 0x02;
+    mac[1] = 0x00;
+    mac[2] = (uint8_t)type;
+    mac[3] = pid >> 16;
+    mac[4] = pid >> 8;
+    mac[5] = pid;
+    return ESP_OK;
+}
@@ -0,0 +1,125 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_timer.h"
+
+/* Each timer is a thread, the callbacks of different timers may run concurrently */
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool started;
+    bool periodic;
+    uint64_t period_us;
+    int64_t due_us;
+};
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t s_boot_us;
+
+/* Time since boot on the board, since the process started here */
+__attribute__((constructor)) static void record_boot_time(void) {
+    s_boot_us = monotonic_us();
+}
+
+int64_t esp_timer_get_time(void) {
+    return monotonic_us() - s_boot_us;
+}
+
+static void *timer_thread(void *arg) {
+    struct esp_timer *timer = arg;
+    pthread_mutex_lock(&timer->lock);
+    for (;;) {
+        while (!timer->started) {
+            pthread_cond_wait(&timer->cond, &timer->lock);
+        }
+        int64_t now = esp_timer_get_time();
+        if (now < timer->due_us) {
+            int64_t wait_us = timer->due_us - now;
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            uint64_t ns = deadline.tv_nsec + (uint64_t)wait_us * 1000;
+            deadline.tv_sec += ns / 1000000000ULL;
+            deadline.tv_nsec = ns % 1000000000ULL;
+            pthread_cond_timedwait(&timer->cond, &timer->lock, &deadline);
+            continue;
+        }
+        if (timer->periodic) {
+            timer->due_us += timer->period_us;
+            if (timer->due_us <= now) {
+                timer->due_us = now + timer->period_us;   // skip the missed periods
+            }
+        } else {
+            timer->started = false;
+        }
+        pthread_mutex_unlock(&timer->lock);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&timer->lock);
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle) {
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+    if (!timer) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    pthread_mutex_init(&timer->lock, NULL);
+    pthread_cond_init(&timer->cond, NULL);
+    if (pthread_create(&timer->thread, NULL, timer_thread, timer) != 0) {
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(timer->thread);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t us, bool periodic) {
+    pthread_mutex_lock(&timer->lock);
+    if (timer->started) {
+        pthread_mutex_unlock(&timer->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->periodic = periodic;
+    timer->period_us = us;
+    timer->due_us = esp_timer_get_time() + us;
+    timer->started = true;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return timer_start(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return timer_start(timer, period_us, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timer->lock);
+    esp_err_t err = timer->started ? ESP_OK : ESP_ERR_INVALID_STATE;
+    timer->started = false;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    // the thread stays parked on the condition, timers are not deleted in the Lab sources
+    esp_timer_stop(timer);
+    return ESP_OK;
+}
@@ -0,0 +1,5 @@
+#pragma once
+/* No Wi-Fi on the host, the server listens on the host's interfaces */
+#include "esp_err.h"
+
+static inline esp_err_t esp_netif_init(void) { return ESP_OK; }
@@ -0,0 +1,232 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notified;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t items[];
+};
+
+struct host_semaphore {
+    pthread_mutex_t mutex;
+};
+
+static __thread struct host_task *s_current = NULL;
+
+static struct timespec deadline_after(TickType_t ticks) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ns = (uint64_t)ticks * portTICK_PERIOD_MS * 1000000ULL + ts.tv_nsec;
+    ts.tv_sec += ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    return ts;
+}
+
+static void *task_main(void *arg) {
+    struct host_task *task = arg;
+    s_current = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_size, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+    (void)name; (void)stack_size; (void)priority; (void)core;
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (!task) {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    if (pthread_create(&task->thread, NULL, task_main, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_size, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    return xTaskCreatePinnedToCore(fn, name, stack_size, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == s_current) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec ts = {
+        .tv_sec = (ticks * portTICK_PERIOD_MS) / 1000,
+        .tv_nsec = ((ticks * portTICK_PERIOD_MS) % 1000) * 1000000L,
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return s_current;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    struct host_task *task = s_current;
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&task->lock);
+    while (task->notified == 0 && ticks != 0) {
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&task->cond, &task->lock);
+        } else if (pthread_cond_timedwait(&task->cond, &task->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t value = task->notified;
+    if (value) {
+        task->notified = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notified++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    struct host_semaphore *sem = calloc(1, sizeof(*sem));
+    if (sem) {
+        pthread_mutex_init(&sem->mutex, NULL);
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        return pthread_mutex_lock(&sem->mutex) == 0 ? pdTRUE : pdFALSE;
+    }
+    struct timespec deadline = deadline_after(ticks);
+    return pthread_mutex_timedlock(&sem->mutex, &deadline) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return pthread_mutex_unlock(&sem->mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    pthread_mutex_destroy(&sem->mutex);
+    free(sem);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct host_queue *queue = calloc(1, sizeof(*queue) + (size_t)length * item_size);
+    if (queue) {
+        pthread_mutex_init(&queue->lock, NULL);
+        pthread_cond_init(&queue->not_empty, NULL);
+        pthread_cond_init(&queue->not_full, NULL);
+        queue->length = length;
+        queue->item_size = item_size;
+    }
+    return queue;
+}
+
+/* Waits on cond while the queue is full (or empty), or until the ticks run out, call with the queue lock held */
+static bool queue_wait(struct host_queue *queue, pthread_cond_t *cond, bool full, TickType_t ticks) {
+    struct timespec deadline = deadline_after(ticks);
+    while (full ? queue->count == queue->length : queue->count == 0) {
+        if (ticks == 0) {
+            return false;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(cond, &queue->lock);
+        } else if (pthread_cond_timedwait(cond, &queue->lock, &deadline) == ETIMEDOUT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    pthread_mutex_lock(&queue->lock);
+    bool ok = queue_wait(queue, &queue->not_full, true, ticks);
+    if (ok) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + (size_t)tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_signal(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok ? pdTRUE : errQUEUE_FULL;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    pthread_mutex_lock(&queue->lock);
+    bool ok = queue_wait(queue, &queue->not_empty, false, ticks);
+    if (ok) {
+        memcpy(item, queue->items + (size_t)queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue);
+}
@@ -0,0 +1,19 @@
+#pragma once
+/* FreeRTOS on pthreads, only what the Lab 14 sources use */
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+#define errQUEUE_FULL       0
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ  100     // CONFIG_FREERTOS_HZ of the board
+#define portTICK_PERIOD_MS  (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define tskNO_AFFINITY      0x7FFFFFFF
+#define portNUM_PROCESSORS  2
@@ -0,0 +1,23 @@
+#pragma once
+/* No mDNS responder on the host, esp32_sim.py advertises simulated boards instead */
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct {
+    const char *key;
+    const char *value;
+} mdns_txt_item_t;
+
+static inline esp_err_t mdns_init(void) { return ESP_ERR_NOT_SUPPORTED; }
+static inline void mdns_free(void) { }
+static inline esp_err_t mdns_hostname_set(const char *hostname) { return ESP_ERR_INVALID_STATE; }
+static inline esp_err_t mdns_instance_name_set(const char *instance_name) { return ESP_ERR_INVALID_STATE; }
+static inline esp_err_t mdns_service_add(const char *instance_name, const char *service_type, const char *proto,
+                                         uint16_t port, mdns_txt_item_t txt[], size_t num_items) {
+    return ESP_ERR_INVALID_STATE;
+}
+static inline esp_err_t mdns_service_txt_set(const char *service_type, const char *proto,
+                                             mdns_txt_item_t txt[], uint8_t num_items) {
+    return ESP_ERR_INVALID_STATE;
+}
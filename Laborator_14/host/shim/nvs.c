@@ -0,0 +1,170 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs.h"
+
+#define NVS_HOST_MAX_HANDLES    8
+#define NVS_HOST_KEY_MAX        16  // 15 characters like the real partition
+
+typedef enum { ENTRY_U8, ENTRY_U32, ENTRY_BLOB } entry_type_t;
+
+/* Entries live for the process lifetime, a restart of the host build starts with empty NVS */
+typedef struct nvs_entry {
+    struct nvs_entry *next;
+    char ns[NVS_HOST_KEY_MAX];
+    char key[NVS_HOST_KEY_MAX];
+    entry_type_t type;
+    size_t len;
+    uint8_t data[];
+} nvs_entry_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static nvs_entry_t *s_entries = NULL;
+static struct {
+    bool used;
+    bool writable;
+    char ns[NVS_HOST_KEY_MAX];
+} s_handles[NVS_HOST_MAX_HANDLES];
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle) {
+    if (!name || strlen(name) >= NVS_HOST_KEY_MAX || !handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < NVS_HOST_MAX_HANDLES; i++) {
+        if (!s_handles[i].used) {
+            s_handles[i].used = true;
+            s_handles[i].writable = mode == NVS_READWRITE;
+            strcpy(s_handles[i].ns, name);
+            *handle = i + 1;
+            err = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&s_lock);
+    if (handle >= 1 && handle <= NVS_HOST_MAX_HANDLES) {
+        s_handles[handle - 1].used = false;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return handle >= 1 && handle <= NVS_HOST_MAX_HANDLES && s_handles[handle - 1].used ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+/* Call with s_lock held */
+static nvs_entry_t **entry_find(nvs_handle_t handle, const char *key) {
+    nvs_entry_t **link = &s_entries;
+    while (*link) {
+        if (strcmp((*link)->ns, s_handles[handle - 1].ns) == 0 && strcmp((*link)->key, key) == 0) {
+            return link;
+        }
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static esp_err_t check_handle(nvs_handle_t handle, const char *key, bool write) {
+    if (handle < 1 || handle > NVS_HOST_MAX_HANDLES || !s_handles[handle - 1].used) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!key || strlen(key) >= NVS_HOST_KEY_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return write && !s_handles[handle - 1].writable ? ESP_ERR_NVS_READ_ONLY : ESP_OK;
+}
+
+static esp_err_t entry_set(nvs_handle_t handle, const char *key, entry_type_t type, const void *value, size_t len) {
+    nvs_entry_t *entry = malloc(sizeof(nvs_entry_t) + len);
+    if (!entry) {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = check_handle(handle, key, true);
+    if (err == ESP_OK) {
+        nvs_entry_t **link = entry_find(handle, key);
+        strcpy(entry->ns, s_handles[handle - 1].ns);
+        strcpy(entry->key, key);
+        entry->type = type;
+        entry->len = len;
+        memcpy(entry->data, value, len);
+        entry->next = *link ? (*link)->next : NULL;
+        free(*link);
+        *link = entry;
+        entry = NULL;
+    }
+    pthread_mutex_unlock(&s_lock);
+    free(entry);
+    return err;
+}
+
+static esp_err_t entry_get(nvs_handle_t handle, const char *key, entry_type_t type, void *value, size_t *len) {
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = check_handle(handle, key, false);
+    if (err == ESP_OK) {
+        nvs_entry_t *entry = *entry_find(handle, key);
+        if (!entry || entry->type != type) {
+            err = ESP_ERR_NVS_NOT_FOUND;
+        } else if (value && *len < entry->len) {
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+            *len = entry->len;
+        } else {
+            if (value) {
+                memcpy(value, entry->data, entry->len);
+            }
+            *len = entry->len;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = check_handle(handle, key, true);
+    if (err == ESP_OK) {
+        nvs_entry_t **link = entry_find(handle, key);
+        nvs_entry_t *entry = *link;
+        if (entry) {
+            *link = entry->next;
+            free(entry);
+        } else {
+            err = ESP_ERR_NVS_NOT_FOUND;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length) {
+    return entry_get(handle, key, ENTRY_BLOB, value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return entry_set(handle, key, ENTRY_BLOB, value, length);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *value) {
+    size_t len = sizeof(*value);
+    return entry_get(handle, key, ENTRY_U8, value, &len);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return entry_set(handle, key, ENTRY_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *value) {
+    size_t len = sizeof(*value);
+    return entry_get(handle, key, ENTRY_U32, value, &len);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return entry_set(handle, key, ENTRY_U32, &value, sizeof(value));
+}
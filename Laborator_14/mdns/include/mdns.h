@@ -10,6 +10,7 @@
 extern "C" {
 #endif
 
+#include "sdkconfig.h"
 #include <esp_netif.h>
 
 #define MDNS_TYPE_A                 0x0001
@@ -129,6 +130,7 @@ void mdns_free(void);
  */
 esp_err_t mdns_hostname_set(const char *hostname);
 
+#ifdef CONFIG_MDNS_ENABLE_DELEGATION
 /**
  * @brief  Adds a hostname and address to be delegated
  *         A/AAAA queries will be replied for the hostname and
@@ -160,6 +162,7 @@ esp_err_t mdns_delegate_hostname_add(const char *hostname, const mdns_ip_addr_t
  *
  */
 esp_err_t mdns_delegate_hostname_remove(const char *hostname);
+#endif /* CONFIG_MDNS_ENABLE_DELEGATION */
 
 /**
  * @brief  Query whether a hostname has been added
@@ -511,6 +514,7 @@ esp_err_t mdns_service_txt_item_remove(const char *service_type, const char *pro
 esp_err_t mdns_service_txt_item_remove_for_host(const char *instance, const char *service_type, const char *proto, const char *hostname,
         const char *key);
 
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
 /**
  * @brief  Add subtype for service.
  *
@@ -528,6 +532,7 @@ esp_err_t mdns_service_txt_item_remove_for_host(const char *instance, const char
  */
 esp_err_t mdns_service_subtype_add_for_host(const char *instance_name, const char *service_type, const char *proto,
         const char *hostname, const char *subtype);
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
 
 /**
  * @brief  Remove and free all services from mDNS server
@@ -538,6 +543,7 @@ esp_err_t mdns_service_subtype_add_for_host(const char *instance_name, const cha
  */
 esp_err_t mdns_service_remove_all(void);
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
 /**
  * @brief Deletes the finished query. Call this only after the search has ended!
  *
@@ -720,6 +726,7 @@ esp_err_t mdns_query_a(const char *host_name, uint32_t timeout, esp_ip4_addr_t *
  */
 esp_err_t mdns_query_aaaa(const char *host_name, uint32_t timeout, esp_ip6_addr_t *addr);
 #endif
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
 
 /**
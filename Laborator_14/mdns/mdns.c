@@ -50,6 +50,7 @@ static const char *TAG = "mdns";
 static volatile TaskHandle_t _mdns_service_task_handle = NULL;
 static SemaphoreHandle_t _mdns_service_semaphore = NULL;
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
 static void _mdns_search_finish_done(void);
 static mdns_search_once_t *_mdns_search_find_from(mdns_search_once_t *search, mdns_name_t *name, uint16_t type, mdns_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
 static void _mdns_search_result_add_ip(mdns_search_once_t *search, const char *hostname, esp_ip_addr_t *ip,
@@ -62,6 +63,7 @@ static void _mdns_search_result_add_txt(mdns_search_once_t *search, mdns_txt_ite
 static mdns_result_t *_mdns_search_result_add_ptr(mdns_search_once_t *search, const char *instance,
         const char *service_type, const char *proto, mdns_if_t tcpip_if,
         mdns_ip_protocol_t ip_protocol, uint32_t ttl);
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 static bool _mdns_append_host_list_in_services(mdns_out_answer_t **destination, mdns_srv_item_t *services[], size_t services_len, bool flush, bool bye);
 static bool _mdns_append_host_list(mdns_out_answer_t **destination, bool flush, bool bye);
 static void _mdns_remap_self_service_hostname(const char *old_hostname, const char *new_hostname);
@@ -136,6 +138,15 @@ static inline esp_netif_t *esp_netif_from_preset_if(mdns_predef_if_t predef_if)
     }
 }
 
+/*
+ * @brief Set internal mdns interface's pointer and update the networking layer's netif map
+ */
+static inline void _mdns_set_netif_ptr(mdns_if_t tcpip_if, esp_netif_t *esp_netif)
+{
+    s_esp_netifs[tcpip_if].netif = esp_netif;
+    _mdns_netif_map_update(tcpip_if, esp_netif);
+}
+
 /**
  * @brief Gets the actual esp_netif pointer from the internal network interface list
  *
@@ -153,7 +164,7 @@ esp_netif_t *_mdns_get_esp_netif(mdns_if_t tcpip_if)
     if (tcpip_if < MDNS_MAX_INTERFACES) {
         if (s_esp_netifs[tcpip_if].netif == NULL && s_esp_netifs[tcpip_if].predefined) {
             // If the local copy is NULL and this netif is predefined -> we can find it in the global netif list
-            s_esp_netifs[tcpip_if].netif = esp_netif_from_preset_if(s_esp_netifs[tcpip_if].predef_if);
+            _mdns_set_netif_ptr(tcpip_if, esp_netif_from_preset_if(s_esp_netifs[tcpip_if].predef_if));
             // failing to find it means that the netif is *not* available -> return NULL
         }
         return s_esp_netifs[tcpip_if].netif;
@@ -168,7 +179,7 @@ esp_netif_t *_mdns_get_esp_netif(mdns_if_t tcpip_if)
 static inline void _mdns_clean_netif_ptr(mdns_if_t tcpip_if)
 {
     if (tcpip_if < MDNS_MAX_INTERFACES) {
-        s_esp_netifs[tcpip_if].netif = NULL;
+        _mdns_set_netif_ptr(tcpip_if, NULL);
     }
 }
 
@@ -266,6 +277,7 @@ static mdns_srv_item_t *_mdns_get_service_item(const char *service, const char *
     return NULL;
 }
 
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
 static mdns_srv_item_t *_mdns_get_service_item_subtype(const char *subtype, const char *service, const char *proto)
 {
     mdns_srv_item_t *s = _mdns_server->services;
@@ -283,6 +295,7 @@ static mdns_srv_item_t *_mdns_get_service_item_subtype(const char *subtype, cons
     }
     return NULL;
 }
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
 
 static mdns_host_item_t *mdns_get_host_item(const char *hostname)
 {
@@ -358,6 +371,7 @@ static const char *_mdns_get_service_instance_name(const mdns_service_t *service
     return _mdns_get_default_instance_name();
 }
 
+#ifdef CONFIG_MDNS_MULTIPLE_INSTANCE
 static bool _mdns_instance_name_match(const char *lhs, const char *rhs)
 {
     if (lhs == NULL) {
@@ -400,6 +414,24 @@ static mdns_srv_item_t *_mdns_get_service_item_instance(const char *instance, co
     }
     return NULL;
 }
+#else
+/**
+ * @brief  finds service by its type, as there is only one instance per service type.
+ *         If instance is supplied, it has to match the service instance name.
+ */
+static mdns_srv_item_t *_mdns_get_service_item_instance(const char *instance, const char *service, const char *proto,
+        const char *hostname)
+{
+    mdns_srv_item_t *s = _mdns_get_service_item(service, proto, hostname);
+    if (s && instance) {
+        const char *srv_instance = _mdns_get_service_instance_name(s->service);
+        if (!srv_instance || strcasecmp(srv_instance, instance)) {
+            return NULL;
+        }
+    }
+    return s;
+}
+#endif /* CONFIG_MDNS_MULTIPLE_INSTANCE */
 
 /**
  * @brief  reads MDNS FQDN into mdns_name_t structure
@@ -820,6 +852,7 @@ static uint16_t _mdns_append_ptr_record(uint8_t *packet, uint16_t *index, const
     return record_length;
 }
 
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
 /**
  * @brief  appends PTR record for a subtype to a packet, incrementing the index
  *
@@ -867,6 +900,7 @@ static uint16_t _mdns_append_subtype_ptr_record(uint8_t *packet, uint16_t *index
     record_length += part_length;
     return record_length;
 }
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
 
 /**
  * @brief  appends DNS-SD PTR record for service to a packet, incrementing the index
@@ -1317,6 +1351,7 @@ static uint8_t _mdns_append_service_ptr_answers(uint8_t *packet, uint16_t *index
     }
     appended_answers++;
 
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
     mdns_subtype_t *subtype = service->subtype;
     while (subtype) {
         appended_answers +=
@@ -1324,6 +1359,7 @@ static uint8_t _mdns_append_service_ptr_answers(uint8_t *packet, uint16_t *index
                                              service->service, service->proto, flush, bye) > 0);
         subtype = subtype->next;
     }
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
 
     return appended_answers;
 }
@@ -1417,14 +1453,119 @@ static uint8_t _mdns_append_answer(uint8_t *packet, uint16_t *index, mdns_out_an
     return 0;
 }
 
+esp_err_t _mdns_pool_init(mdns_pool_t *pool, void *objs, size_t size, size_t count)
+{
+    if (pool->lock) {
+        return ESP_OK;
+    }
+    pool->lock = xSemaphoreCreateMutex();
+    if (!pool->lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    pool->objs = (uint8_t *)objs;
+    pool->size = size;
+    pool->count = count;
+    pool->free = NULL;
+    for (size_t i = count; i > 0; i--) {
+        void *obj = pool->objs + (i - 1) * size;
+        *(void **)obj = pool->free;
+        pool->free = obj;
+    }
+    return ESP_OK;
+}
+
+void *_mdns_pool_alloc(mdns_pool_t *pool)
+{
+    xSemaphoreTake(pool->lock, portMAX_DELAY);
+    void *obj = pool->free;
+    if (obj) {
+        pool->free = *(void **)obj;
+    }
+    xSemaphoreGive(pool->lock);
+    if (!obj) {
+        obj = malloc(pool->size);
+        if (!obj) {
+            HOOK_MALLOC_FAILED;
+        }
+    }
+    return obj;
+}
+
+void _mdns_pool_free(mdns_pool_t *pool, void *obj)
+{
+    if (!obj) {
+        return;
+    }
+    if ((uint8_t *)obj < pool->objs || (uint8_t *)obj >= pool->objs + pool->count * pool->size) {
+        free(obj);
+        return;
+    }
+    xSemaphoreTake(pool->lock, portMAX_DELAY);
+    *(void **)obj = pool->free;
+    pool->free = obj;
+    xSemaphoreGive(pool->lock);
+}
+
+/*
+ * Outgoing packets are serialized into buffers from a small static pool. Ownership of a
+ * buffer passes to the networking layer on _mdns_udp_pcb_write_buf() and comes back with
+ * _mdns_tx_buf_release(), so the next packet can be serialized while the previous one is
+ * still in flight. The pool outlives mdns_init()/mdns_free() cycles, since the network
+ * stack may still hold a buffer when the service is stopped.
+ */
+static mdns_tx_buf_t s_tx_bufs[MDNS_TX_BUF_POOL_LEN];
+static mdns_pool_t s_tx_buf_pool;
+
 /**
- * @brief  sends a packet
+ * @brief  Take a TX buffer from the pool, falling back to heap if all are in flight
+ */
+static mdns_tx_buf_t *_mdns_tx_buf_alloc(void)
+{
+    mdns_tx_buf_t *buf = (mdns_tx_buf_t *)_mdns_pool_alloc(&s_tx_buf_pool);
+    if (buf) {
+        buf->next = NULL;
+    }
+    return buf;
+}
+
+void _mdns_tx_buf_release(mdns_tx_buf_t *buf)
+{
+    _mdns_pool_free(&s_tx_buf_pool, buf);
+}
+
+/**
+ * @brief  hands a serialized packet over to the networking layer
+ *
+ * @param  buf     the buffer with destination and length filled in
+ */
+static void _mdns_tx_buf_send(mdns_tx_buf_t *buf)
+{
+#ifdef MDNS_ENABLE_DEBUG
+    _mdns_dbg_printf("\nTX[%u][%u]: ", buf->tcpip_if, buf->ip_protocol);
+    if (buf->dst.type == ESP_IPADDR_TYPE_V4) {
+        _mdns_dbg_printf("To: " IPSTR ":%u, ", IP2STR(&buf->dst.u_addr.ip4), buf->port);
+    } else {
+        _mdns_dbg_printf("To: " IPV6STR ":%u, ", IPV62STR(buf->dst.u_addr.ip6), buf->port);
+    }
+    mdns_debug_packet(MDNS_TX_BUF_PAYLOAD(buf), buf->len);
+#endif
+    _mdns_udp_pcb_write_buf(buf);
+}
+
+/**
+ * @brief  serializes a packet into a TX buffer
  *
  * @param  p       the packet
+ *
+ * @return the buffer with destination and length filled in, NULL if out of memory
  */
-static void _mdns_dispatch_tx_packet(mdns_tx_packet_t *p)
+static mdns_tx_buf_t *_mdns_serialize_tx_packet(mdns_tx_packet_t *p)
 {
-    static uint8_t packet[MDNS_MAX_PACKET_SIZE];
+    mdns_tx_buf_t *buf = _mdns_tx_buf_alloc();
+    if (!buf) {
+        return NULL;
+    }
+    uint8_t *packet = MDNS_TX_BUF_PAYLOAD(buf);
     uint16_t index = MDNS_HEAD_LEN;
     memset(packet, 0, MDNS_HEAD_LEN);
     mdns_out_question_t *q;
@@ -1468,17 +1609,25 @@ static void _mdns_dispatch_tx_packet(mdns_tx_packet_t *p)
     }
     _mdns_set_u16(packet, MDNS_HEAD_ADDITIONAL_OFFSET, count);
 
-#ifdef MDNS_ENABLE_DEBUG
-    _mdns_dbg_printf("\nTX[%u][%u]: ", p->tcpip_if, p->ip_protocol);
-    if (p->dst.type == ESP_IPADDR_TYPE_V4) {
-        _mdns_dbg_printf("To: " IPSTR ":%u, ", IP2STR(&p->dst.u_addr.ip4), p->port);
-    } else {
-        _mdns_dbg_printf("To: " IPV6STR ":%u, ", IPV62STR(p->dst.u_addr.ip6), p->port);
-    }
-    mdns_debug_packet(packet, index);
-#endif
+    buf->tcpip_if = p->tcpip_if;
+    buf->ip_protocol = p->ip_protocol;
+    buf->port = p->port;
+    buf->len = index;
+    memcpy(&buf->dst, &p->dst, sizeof(esp_ip_addr_t));
+    return buf;
+}
 
-    _mdns_udp_pcb_write(p->tcpip_if, p->ip_protocol, &p->dst, p->port, packet, index);
+/**
+ * @brief  sends a packet
+ *
+ * @param  p       the packet
+ */
+static void _mdns_dispatch_tx_packet(mdns_tx_packet_t *p)
+{
+    mdns_tx_buf_t *buf = _mdns_serialize_tx_packet(p);
+    if (buf) {
+        _mdns_tx_buf_send(buf);
+    }
 }
 
 /**
@@ -1685,6 +1834,23 @@ static bool _mdns_alloc_answer(mdns_out_answer_t **destination, uint16_t type, m
     return true;
 }
 
+/**
+ * @brief  Set the mDNS multicast group of given protocol as destination
+ */
+static void _mdns_set_default_dst(esp_ip_addr_t *dst, mdns_ip_protocol_t ip_protocol)
+{
+    if (ip_protocol == MDNS_IP_PROTOCOL_V4) {
+        esp_ip_addr_t addr = ESP_IP4ADDR_INIT(224, 0, 0, 251);
+        memcpy(dst, &addr, sizeof(esp_ip_addr_t));
+    }
+#if CONFIG_LWIP_IPV6
+    else {
+        esp_ip_addr_t addr = ESP_IP6ADDR_INIT(0x000002ff, 0, 0, 0xfb000000);
+        memcpy(dst, &addr, sizeof(esp_ip_addr_t));
+    }
+#endif
+}
+
 /**
  * @brief  Allocate new packet for sending
  */
@@ -1699,16 +1865,7 @@ static mdns_tx_packet_t *_mdns_alloc_packet_default(mdns_if_t tcpip_if, mdns_ip_
     packet->tcpip_if = tcpip_if;
     packet->ip_protocol = ip_protocol;
     packet->port = MDNS_SERVICE_PORT;
-    if (ip_protocol == MDNS_IP_PROTOCOL_V4) {
-        esp_ip_addr_t addr = ESP_IP4ADDR_INIT(224, 0, 0, 251);
-        memcpy(&packet->dst, &addr, sizeof(esp_ip_addr_t));
-    }
-#if CONFIG_LWIP_IPV6
-    else {
-        esp_ip_addr_t addr = ESP_IP6ADDR_INIT(0x000002ff, 0, 0, 0xfb000000);
-        memcpy(&packet->dst, &addr, sizeof(esp_ip_addr_t));
-    }
-#endif
+    _mdns_set_default_dst(&packet->dst, ip_protocol);
     return packet;
 }
 
@@ -1763,6 +1920,7 @@ static bool _mdns_service_match_ptr_question(const mdns_service_t *service, cons
     // The question parser stores anything before _type._proto in question->host
     // So the question->host can be subtype or instance name based on its content
     if (question->sub) {
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
         mdns_subtype_t *subtype = service->subtype;
         while (subtype) {
             if (!strcasecmp(subtype->subtype, question->host)) {
@@ -1770,6 +1928,7 @@ static bool _mdns_service_match_ptr_question(const mdns_service_t *service, cons
             }
             subtype = subtype->next;
         }
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
         return false;
     }
     if (question->host) {
@@ -1780,6 +1939,17 @@ static bool _mdns_service_match_ptr_question(const mdns_service_t *service, cons
     return true;
 }
 
+/**
+ * @brief  Delay of the next response with shared answers, spread in 25ms steps
+ */
+static uint32_t _mdns_get_shared_answer_delay(void)
+{
+    static uint8_t share_step = 0;
+    uint32_t delay = 25 + (share_step * 25);
+    share_step = (share_step + 1) & 0x03;
+    return delay;
+}
+
 /**
  * @brief  Create answer packet to questions from parsed packet
  */
@@ -1791,6 +1961,7 @@ static void _mdns_create_answer_from_parsed_packet(mdns_parsed_packet_t *parsed_
     bool send_flush = parsed_packet->src_port == MDNS_SERVICE_PORT;
     bool unicast = false;
     bool shared = false;
+    bool shared_records = false;
     mdns_tx_packet_t *packet = _mdns_alloc_packet_default(parsed_packet->tcpip_if, parsed_packet->ip_protocol);
     if (!packet) {
         return;
@@ -1802,6 +1973,9 @@ static void _mdns_create_answer_from_parsed_packet(mdns_parsed_packet_t *parsed_
     mdns_parsed_question_t *q = parsed_packet->questions;
     while (q) {
         shared = q->type == MDNS_TYPE_PTR || q->type == MDNS_TYPE_SDPTR || !parsed_packet->probe;
+        if (q->type == MDNS_TYPE_PTR || q->type == MDNS_TYPE_SDPTR) {
+            shared_records = true;
+        }
         if (q->type == MDNS_TYPE_SRV || q->type == MDNS_TYPE_TXT) {
             mdns_srv_item_t *service = _mdns_get_service_item_instance(q->host, q->service, q->proto, NULL);
             if (service == NULL || !_mdns_create_answer_from_service(packet, service->service, q, shared, send_flush)) {
@@ -1875,12 +2049,22 @@ static void _mdns_create_answer_from_parsed_packet(mdns_parsed_packet_t *parsed_
     if (unicast || !send_flush) {
         memcpy(&packet->dst, &parsed_packet->src, sizeof(esp_ip_addr_t));
         packet->port = parsed_packet->src_port;
+        // The response goes to a single querier, so known answers of other queriers must not
+        // suppress it. Only responses to QU questions with shared records keep the response delay
+        // (RFC 6762, section 6), legacy unicast queries and unique records are answered right away.
+        if (send_flush && shared_records) {
+            // waits as a packet and is serialized when due, TX buffers are only taken to send
+            packet->distributed = false;
+            _mdns_schedule_tx_packet(packet, _mdns_get_shared_answer_delay());
+        } else {
+            _mdns_dispatch_tx_packet(packet);
+            _mdns_free_tx_packet(packet);
+        }
+        return;
     }
 
-    static uint8_t share_step = 0;
     if (shared) {
-        _mdns_schedule_tx_packet(packet, 25 + (share_step * 25));
-        share_step = (share_step + 1) & 0x03;
+        _mdns_schedule_tx_packet(packet, _mdns_get_shared_answer_delay());
     } else {
         _mdns_dispatch_tx_packet(packet);
         _mdns_free_tx_packet(packet);
@@ -2706,12 +2890,14 @@ static void _mdns_free_service(mdns_service_t *service)
         free((char *)s->value);
         free(s);
     }
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
     while (service->subtype) {
         mdns_subtype_t *next = service->subtype->next;
         free((char *)service->subtype->subtype);
         free(service->subtype);
         service->subtype = next;
     }
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
     free(service);
 }
 
@@ -2931,6 +3117,7 @@ static bool _hostname_is_ours(const char *hostname)
     return false;
 }
 
+#if defined(CONFIG_MDNS_ENABLE_DELEGATION) || defined(CONFIG_MDNS_RESPOND_REVERSE_QUERIES)
 /**
  * @brief Adds a delegated hostname to the linked list
  * @param hostname Host name pointer
@@ -2955,6 +3142,7 @@ static bool _mdns_delegate_hostname_add(const char *hostname, mdns_ip_addr_t *ad
     _mdns_host_list = host;
     return true;
 }
+#endif /* CONFIG_MDNS_ENABLE_DELEGATION || CONFIG_MDNS_RESPOND_REVERSE_QUERIES */
 
 static void free_address_list(mdns_ip_addr_t *address_list)
 {
@@ -2965,6 +3153,7 @@ static void free_address_list(mdns_ip_addr_t *address_list)
     }
 }
 
+#ifdef CONFIG_MDNS_ENABLE_DELEGATION
 static mdns_ip_addr_t *copy_address_list(const mdns_ip_addr_t *address_list)
 {
     mdns_ip_addr_t *head = NULL;
@@ -2988,6 +3177,7 @@ static mdns_ip_addr_t *copy_address_list(const mdns_ip_addr_t *address_list)
     }
     return head;
 }
+#endif /* CONFIG_MDNS_ENABLE_DELEGATION */
 
 static void free_delegated_hostnames(void)
 {
@@ -3001,6 +3191,7 @@ static void free_delegated_hostnames(void)
     }
 }
 
+#ifdef CONFIG_MDNS_ENABLE_DELEGATION
 static bool _mdns_delegate_hostname_remove(const char *hostname)
 {
     mdns_srv_item_t *srv = _mdns_server->services;
@@ -3044,6 +3235,7 @@ static bool _mdns_delegate_hostname_remove(const char *hostname)
     }
     return true;
 }
+#endif /* CONFIG_MDNS_ENABLE_DELEGATION */
 
 /**
  * @brief  Check if parsed name is discovery
@@ -3115,7 +3307,11 @@ static bool _mdns_name_is_ours(mdns_name_t *name)
     //find the service
     mdns_srv_item_t *service;
     if (name->sub) {
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
         service = _mdns_get_service_item_subtype(name->host, name->service, name->proto);
+#else
+        return false;
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
     } else if (_str_null_or_empty(name->host)) {
         service = _mdns_get_service_item(name->service, name->proto, NULL);
     } else {
@@ -3274,6 +3470,7 @@ static void _mdns_remove_parsed_question(mdns_parsed_packet_t *parsed_packet, ui
     }
 }
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
 /**
  * @brief  Get number of items in TXT parsed data
  */
@@ -3410,6 +3607,7 @@ handle_error :
     free(txt_value_len);
     free(txt);
 }
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
 /**
  * @brief  Duplicate string or return error
@@ -3427,6 +3625,297 @@ static esp_err_t _mdns_strdup_check(char **out, char *in)
     return ESP_OK;
 }
 
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+/*
+ * Deferred fast path answers keep only the question while they wait for the shared answer
+ * delay, the response is serialized into a TX buffer when it is due. Holding serialized
+ * buffers instead would drain the small TX pool for up to 125 ms per query.
+ */
+static mdns_fast_answer_t s_fast_answers[MDNS_FAST_ANSWER_POOL_LEN];
+static mdns_pool_t s_fast_answer_pool;
+
+/**
+ * @brief  finds the first of our services with the given type
+ */
+static mdns_srv_item_t *_mdns_fast_path_find_service(const char *service, const char *proto)
+{
+    mdns_srv_item_t *s = _mdns_server->services;
+    while (s && !_mdns_service_match(s->service, service, proto, NULL)) {
+        s = s->next;
+    }
+    return s;
+}
+
+/**
+ * @brief  serializes the response to a single A/AAAA question for our hostname or PTR question for our service type
+ *
+ * A/AAAA questions get the address of the asked type as answer and the other one as additional
+ * record (RFC 6762, section 6.2). PTR questions get PTR/SRV/TXT answers for each matching service
+ * and its host's addresses as additional records.
+ *
+ * @param  out          the buffer to serialize into, MDNS_MAX_PACKET_SIZE long
+ * @param  id           ID of the query
+ * @param  type         the question type
+ * @param  unicast      the question is QU
+ * @param  send_flush   the query came from an mDNS querier (not a legacy one-shot query)
+ * @param  host         hostname of an A/AAAA question
+ * @param  service      service type of a PTR question
+ * @param  proto        protocol of a PTR question
+ * @param  tcpip_if     interface to take the addresses of
+ *
+ * @return length of the response, 0 if there is nothing to answer
+ */
+static uint16_t _mdns_fast_path_serialize(uint8_t *out, uint16_t id, uint16_t type, bool unicast, bool send_flush,
+                                          const char *host, const char *service, const char *proto, mdns_if_t tcpip_if)
+{
+    uint16_t index = MDNS_HEAD_LEN;
+    uint8_t count = 0;
+    mdns_out_answer_t answer = { 0 };
+
+    memset(out, 0, MDNS_HEAD_LEN);
+    _mdns_set_u16(out, MDNS_HEAD_FLAGS_OFFSET, MDNS_FLAGS_QR_AUTHORITATIVE);
+    _mdns_set_u16(out, MDNS_HEAD_ID_OFFSET, id);
+
+    if (type != MDNS_TYPE_PTR) {
+        if (!send_flush) {
+            // one-shot query, repeat the question
+            mdns_out_question_t question = { 0 };
+            question.type = type;
+            question.unicast = unicast;
+            question.host = host;
+            question.domain = MDNS_DEFAULT_DOMAIN;
+            if (_mdns_append_question(out, &index, &question)) {
+                _mdns_set_u16(out, MDNS_HEAD_QUESTIONS_OFFSET, 1);
+            }
+        }
+        answer.host = &_mdns_self_host;
+        answer.flush = send_flush;
+        answer.type = type;
+        count = _mdns_append_answer(out, &index, &answer, tcpip_if);
+        if (!count) {
+            // no address of this type on the interface yet
+            return 0;
+        }
+        _mdns_set_u16(out, MDNS_HEAD_ANSWERS_OFFSET, count);
+        answer.type = type == MDNS_TYPE_A ? MDNS_TYPE_AAAA : MDNS_TYPE_A;
+        _mdns_set_u16(out, MDNS_HEAD_ADDITIONAL_OFFSET, _mdns_append_answer(out, &index, &answer, tcpip_if));
+        return index;
+    }
+
+    mdns_srv_item_t *first = _mdns_fast_path_find_service(service, proto);
+    if (!first) {
+        return 0;
+    }
+    mdns_srv_item_t *s;
+    for (s = first; s; s = s->next) {
+        if (!_mdns_service_match(s->service, service, proto, NULL)) {
+            continue;
+        }
+        answer.service = s->service;
+        answer.type = MDNS_TYPE_PTR;
+        answer.flush = false;
+        count += _mdns_append_answer(out, &index, &answer, tcpip_if);
+        answer.flush = send_flush;
+        answer.type = MDNS_TYPE_SRV;
+        count += _mdns_append_answer(out, &index, &answer, tcpip_if);
+        answer.type = MDNS_TYPE_TXT;
+        count += _mdns_append_answer(out, &index, &answer, tcpip_if);
+    }
+    _mdns_set_u16(out, MDNS_HEAD_ANSWERS_OFFSET, count);
+
+    count = 0;
+    for (s = first; s; s = s->next) {
+        if (!_mdns_service_match(s->service, service, proto, NULL)) {
+            continue;
+        }
+        answer.service = s->service;
+        answer.host = mdns_get_host_item(s->service->hostname);
+        answer.type = MDNS_TYPE_A;
+        count += _mdns_append_answer(out, &index, &answer, tcpip_if);
+        answer.type = MDNS_TYPE_AAAA;
+        count += _mdns_append_answer(out, &index, &answer, tcpip_if);
+    }
+    _mdns_set_u16(out, MDNS_HEAD_ADDITIONAL_OFFSET, count);
+    return index;
+}
+
+/**
+ * @brief  queues a PTR answer to be serialized and sent after the shared answer delay
+ *
+ * The same question from another querier while the answer waits is covered by it.
+ */
+static void _mdns_fast_answer_schedule(mdns_rx_packet_t *packet, const mdns_name_t *name, bool unicast)
+{
+    esp_ip_addr_t dst;
+    uint16_t port;
+    if (unicast) {
+        memcpy(&dst, &packet->src, sizeof(esp_ip_addr_t));
+        port = packet->src_port;
+    } else {
+        _mdns_set_default_dst(&dst, packet->ip_protocol);
+        port = MDNS_SERVICE_PORT;
+    }
+
+    mdns_fast_answer_t *a = _mdns_server->fast_answer_queue_head;
+    for (; a; a = a->next) {
+        if (a->tcpip_if == packet->tcpip_if && a->ip_protocol == packet->ip_protocol && a->port == port
+                && !memcmp(&a->dst, &dst, sizeof(esp_ip_addr_t))
+                && !strcasecmp(a->service, name->service) && !strcasecmp(a->proto, name->proto)) {
+            return;
+        }
+    }
+
+    a = (mdns_fast_answer_t *)_mdns_pool_alloc(&s_fast_answer_pool);
+    if (!a) {
+        return;
+    }
+    memcpy(&a->dst, &dst, sizeof(esp_ip_addr_t));
+    a->port = port;
+    a->tcpip_if = packet->tcpip_if;
+    a->ip_protocol = packet->ip_protocol;
+    a->id = _mdns_read_u16(_mdns_get_packet_data(packet), MDNS_HEAD_ID_OFFSET);
+    memcpy(a->service, name->service, sizeof(a->service));
+    memcpy(a->proto, name->proto, sizeof(a->proto));
+    a->send_at = (xTaskGetTickCount() * portTICK_PERIOD_MS) + _mdns_get_shared_answer_delay();
+
+    mdns_fast_answer_t **q = &_mdns_server->fast_answer_queue_head;
+    while (*q && (*q)->send_at <= a->send_at) {
+        q = &(*q)->next;
+    }
+    a->next = *q;
+    *q = a;
+}
+
+/**
+ * @brief  serializes and sends all deferred fast path answers which are due
+ */
+static void _mdns_fast_answer_queue_run(void)
+{
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    while (_mdns_server->fast_answer_queue_head && (int32_t)(_mdns_server->fast_answer_queue_head->send_at - now) < 0) {
+        mdns_fast_answer_t *a = _mdns_server->fast_answer_queue_head;
+        _mdns_server->fast_answer_queue_head = a->next;
+        mdns_tx_buf_t *buf = NULL;
+        if (_mdns_server->interfaces[a->tcpip_if].pcbs[a->ip_protocol].state > PCB_PROBE_3) {
+            buf = _mdns_tx_buf_alloc();
+        }
+        if (buf) {
+            buf->len = _mdns_fast_path_serialize(MDNS_TX_BUF_PAYLOAD(buf), a->id, MDNS_TYPE_PTR, false, true,
+                                                 NULL, a->service, a->proto, a->tcpip_if);
+            if (buf->len) {
+                memcpy(&buf->dst, &a->dst, sizeof(esp_ip_addr_t));
+                buf->port = a->port;
+                buf->tcpip_if = a->tcpip_if;
+                buf->ip_protocol = a->ip_protocol;
+                _mdns_tx_buf_send(buf);
+            } else {
+                _mdns_tx_buf_release(buf);
+            }
+        }
+        _mdns_pool_free(&s_fast_answer_pool, a);
+    }
+}
+
+/**
+ * @brief  drops all deferred fast path answers
+ */
+static void _mdns_clear_fast_answer_queue(void)
+{
+    while (_mdns_server->fast_answer_queue_head) {
+        mdns_fast_answer_t *a = _mdns_server->fast_answer_queue_head;
+        _mdns_server->fast_answer_queue_head = a->next;
+        _mdns_pool_free(&s_fast_answer_pool, a);
+    }
+}
+
+/**
+ * @brief  answers a plain query with a single question directly from the received bytes
+ *
+ * Handles PTR questions for our service types and A/AAAA questions for our hostname,
+ * if the query carries no known answers. The response is serialized straight into
+ * a TX buffer, so no parsed packet, tx packet or answer list gets allocated.
+ * Answers with our addresses are unique records and are sent right away, as are
+ * responses to legacy unicast queries. Service answers are shared and keep the usual
+ * delay (RFC 6762, section 6), they are serialized once the delay is over.
+ *
+ * @param  packet       the received packet
+ *
+ * @return true if the query was handled here, false if it has to go through the generic parser
+ */
+static bool _mdns_fast_path_answer(mdns_rx_packet_t *packet)
+{
+    static mdns_name_t n;
+    mdns_name_t *name = &n;
+    const uint8_t *data = _mdns_get_packet_data(packet);
+    size_t len = _mdns_get_packet_len(packet);
+
+    if (len <= MDNS_HEAD_LEN
+            || _mdns_read_u16(data, MDNS_HEAD_FLAGS_OFFSET) != 0
+            || _mdns_read_u16(data, MDNS_HEAD_QUESTIONS_OFFSET) != 1
+            || _mdns_read_u16(data, MDNS_HEAD_ANSWERS_OFFSET) != 0
+            || _mdns_read_u16(data, MDNS_HEAD_SERVERS_OFFSET) != 0
+            || _mdns_read_u16(data, MDNS_HEAD_ADDITIONAL_OFFSET) != 0) {
+        return false;
+    }
+    if (_str_null_or_empty(_mdns_server->hostname)
+            || _mdns_server->interfaces[packet->tcpip_if].pcbs[packet->ip_protocol].state <= PCB_PROBE_3) {
+        return false;
+    }
+
+    const uint8_t *content = _mdns_parse_fqdn(data, data + MDNS_HEAD_LEN, name, len);
+    if (!content || content + 4 != data + len || name->invalid || name->sub
+            || strcasecmp(name->domain, MDNS_DEFAULT_DOMAIN)) {
+        return false;
+    }
+    uint16_t type = _mdns_read_u16(content, MDNS_TYPE_OFFSET);
+    uint16_t mdns_class = _mdns_read_u16(content, MDNS_CLASS_OFFSET);
+    bool unicast = !!(mdns_class & 0x8000);
+    if ((mdns_class & 0x7FFF) != 0x0001) {
+        return false;
+    }
+
+    bool host_question = (type == MDNS_TYPE_A || type == MDNS_TYPE_AAAA)
+                         && name->host[0] && !name->service[0] && !name->proto[0]
+                         && !strcasecmp(name->host, _mdns_server->hostname);
+    bool ptr_question = type == MDNS_TYPE_PTR && !name->host[0] && name->service[0] && name->proto[0];
+    if (!host_question && !ptr_question) {
+        return false;
+    }
+
+    bool send_flush = packet->src_port == MDNS_SERVICE_PORT;
+    if (ptr_question && send_flush) {
+        if (_mdns_fast_path_find_service(name->service, name->proto)) {
+            _mdns_fast_answer_schedule(packet, name, unicast);
+        }
+        return true;
+    }
+
+    mdns_tx_buf_t *buf = _mdns_tx_buf_alloc();
+    if (!buf) {
+        return true;
+    }
+    buf->len = _mdns_fast_path_serialize(MDNS_TX_BUF_PAYLOAD(buf), _mdns_read_u16(data, MDNS_HEAD_ID_OFFSET),
+                                         type, unicast, send_flush, name->host, name->service, name->proto,
+                                         packet->tcpip_if);
+    if (!buf->len) {
+        // no address on this interface yet, or not our service
+        _mdns_tx_buf_release(buf);
+        return true;
+    }
+    buf->tcpip_if = packet->tcpip_if;
+    buf->ip_protocol = packet->ip_protocol;
+    if (unicast || !send_flush) {
+        memcpy(&buf->dst, &packet->src, sizeof(esp_ip_addr_t));
+        buf->port = packet->src_port;
+    } else {
+        _mdns_set_default_dst(&buf->dst, packet->ip_protocol);
+        buf->port = MDNS_SERVICE_PORT;
+    }
+    _mdns_tx_buf_send(buf);
+    return true;
+}
+#endif /* CONFIG_MDNS_FAST_PATH_RESPONDER */
+
 /**
  * @brief  main packet parser
  *
@@ -3440,7 +3929,9 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
     size_t len = _mdns_get_packet_len(packet);
     const uint8_t *content = data + MDNS_HEAD_LEN;
     bool do_not_reply = false;
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
     mdns_search_once_t *search_result = NULL;
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
 #ifdef MDNS_ENABLE_DEBUG
     _mdns_dbg_printf("\nRX[%u][%u]: ", packet->tcpip_if, (uint32_t)packet->ip_protocol);
@@ -3476,6 +3967,12 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
         return;
     }
 
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+    if (_mdns_fast_path_answer(packet)) {
+        return;
+    }
+#endif /* CONFIG_MDNS_FAST_PATH_RESPONDER */
+
     mdns_parsed_packet_t *parsed_packet = (mdns_parsed_packet_t *)malloc(sizeof(mdns_parsed_packet_t));
     if (!parsed_packet) {
         HOOK_MALLOC_FAILED;
@@ -3595,7 +4092,9 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
     if (header.questions && !parsed_packet->questions && !parsed_packet->discovery && !header.answers) {
         goto clear_rx_packet;
     } else if (header.answers || header.servers || header.additional) {
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
         uint16_t recordIndex = 0;
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
         while (content < (data + len)) {
 
@@ -3622,6 +4121,7 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
             bool discovery = false;
             bool ours = false;
             mdns_srv_item_t *service = NULL;
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
             mdns_parsed_record_type_t record_type = MDNS_ANSWER;
 
             if (recordIndex >= (header.answers + header.servers)) {
@@ -3630,6 +4130,7 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                 record_type = MDNS_NS;
             }
             recordIndex++;
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
             if (type == MDNS_TYPE_NSEC || type == MDNS_TYPE_OPT) {
                 //skip NSEC and OPT
@@ -3644,21 +4145,29 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                     service = _mdns_get_service_item(name->service, name->proto, NULL);
                 }
             } else {
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
                 if ((header.flags & MDNS_FLAGS_QUERY_REPSONSE) == 0 || record_type == MDNS_NS) {
                     //skip this record
                     continue;
                 }
                 search_result = _mdns_search_find_from(_mdns_server->search_once, name, type, packet->tcpip_if, packet->ip_protocol);
+#else
+                //records of other hosts are only of interest to the querier
+                continue;
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
             }
 
             if (type == MDNS_TYPE_PTR) {
                 if (!_mdns_parse_fqdn(data, data_ptr, name, len)) {
                     continue;//error
                 }
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
                 if (search_result) {
                     _mdns_search_result_add_ptr(search_result, name->host, name->service, name->proto,
                                                 packet->tcpip_if, packet->ip_protocol, ttl);
-                } else if ((discovery || ours) && !name->sub && _mdns_name_is_ours(name)) {
+                } else
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
+                if ((discovery || ours) && !name->sub && _mdns_name_is_ours(name)) {
                     if (discovery && (service = _mdns_get_service_item(name->service, name->proto, NULL))) {
                         _mdns_remove_parsed_question(parsed_packet, MDNS_TYPE_SDPTR, service);
                     } else if (service && parsed_packet->questions && !parsed_packet->probe) {
@@ -3671,6 +4180,7 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                     }
                 }
             } else if (type == MDNS_TYPE_SRV) {
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
                 mdns_result_t *result = NULL;
                 if (search_result && search_result->type == MDNS_TYPE_PTR) {
                     result = search_result->result;
@@ -3690,6 +4200,7 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                         }
                     }
                 }
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
                 bool is_selfhosted = _mdns_name_is_selfhosted(name);
                 if (!_mdns_parse_fqdn(data, data_ptr + MDNS_SRV_FQDN_OFFSET, name, len)) {
                     continue;//error
@@ -3701,6 +4212,7 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                 uint16_t weight = _mdns_read_u16(data_ptr, MDNS_SRV_WEIGHT_OFFSET);
                 uint16_t port = _mdns_read_u16(data_ptr, MDNS_SRV_PORT_OFFSET);
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
                 if (search_result) {
                     if (search_result->type == MDNS_TYPE_PTR) {
                         if (!result->hostname) { // assign host/port for this entry only if not previously set
@@ -3710,7 +4222,9 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                     } else {
                         _mdns_search_result_add_srv(search_result, name->host, port, packet->tcpip_if, packet->ip_protocol, ttl);
                     }
-                } else if (ours) {
+                } else
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
+                if (ours) {
                     if (parsed_packet->questions && !parsed_packet->probe) {
                         _mdns_remove_parsed_question(parsed_packet, type, service);
                         continue;
@@ -3769,6 +4283,7 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                     }
                 }
             } else if (type == MDNS_TYPE_TXT) {
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
                 if (search_result) {
                     mdns_txt_item_t *txt = NULL;
                     uint8_t *txt_value_len = NULL;
@@ -3806,7 +4321,9 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                             _mdns_search_result_add_txt(search_result, txt, txt_value_len, txt_count, packet->tcpip_if, packet->ip_protocol, ttl);
                         }
                     }
-                } else if (ours) {
+                } else
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
+                if (ours) {
                     if (parsed_packet->questions && !parsed_packet->probe && service) {
                         _mdns_remove_parsed_question(parsed_packet, type, service);
                         continue;
@@ -3837,13 +4354,16 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                 esp_ip_addr_t ip6;
                 ip6.type = ESP_IPADDR_TYPE_V6;
                 memcpy(ip6.u_addr.ip6.addr, data_ptr, MDNS_ANSWER_AAAA_SIZE);
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
                 if (search_result) {
                     //check for more applicable searches (PTR & A/AAAA at the same time)
                     while (search_result) {
                         _mdns_search_result_add_ip(search_result, name->host, &ip6, packet->tcpip_if, packet->ip_protocol, ttl);
                         search_result = _mdns_search_find_from(search_result->next, name, type, packet->tcpip_if, packet->ip_protocol);
                     }
-                } else if (ours) {
+                } else
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
+                if (ours) {
                     if (parsed_packet->questions && !parsed_packet->probe) {
                         _mdns_remove_parsed_question(parsed_packet, type, NULL);
                         continue;
@@ -3890,13 +4410,16 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
                 esp_ip_addr_t ip;
                 ip.type = ESP_IPADDR_TYPE_V4;
                 memcpy(&(ip.u_addr.ip4.addr), data_ptr, 4);
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
                 if (search_result) {
                     //check for more applicable searches (PTR & A/AAAA at the same time)
                     while (search_result) {
                         _mdns_search_result_add_ip(search_result, name->host, &ip, packet->tcpip_if, packet->ip_protocol, ttl);
                         search_result = _mdns_search_find_from(search_result->next, name, type, packet->tcpip_if, packet->ip_protocol);
                     }
-                } else if (ours) {
+                } else
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
+                if (ours) {
                     if (parsed_packet->questions && !parsed_packet->probe) {
                         _mdns_remove_parsed_question(parsed_packet, type, NULL);
                         continue;
@@ -3940,9 +4463,11 @@ void mdns_parse_packet(mdns_rx_packet_t *packet)
             }
         }
         //end while
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
         if (parsed_packet->authoritative) {
             _mdns_search_finish_done();
         }
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
     }
 
     if (!do_not_reply && _mdns_server->interfaces[packet->tcpip_if].pcbs[packet->ip_protocol].state > PCB_PROBE_3 && (parsed_packet->questions || parsed_packet->discovery)) {
@@ -4178,6 +4703,7 @@ void mdns_preset_if_handle_system_event(void *arg, esp_event_base_t event_base,
 }
 #endif /* CONFIG_MDNS_PREDEF_NETIF_STA || CONFIG_MDNS_PREDEF_NETIF_AP || CONFIG_MDNS_PREDEF_NETIF_ETH */
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
 /*
  * MDNS Search
  * */
@@ -4699,6 +5225,7 @@ static void _mdns_search_send(mdns_search_once_t *search)
         }
     }
 }
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
 static void _mdns_tx_handle_packet(mdns_tx_packet_t *p)
 {
@@ -4800,9 +5327,12 @@ static void _mdns_free_action(mdns_action_t *action)
     case ACTION_SERVICE_TXT_DEL:
         free(action->data.srv_txt_del.key);
         break;
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
     case ACTION_SERVICE_SUBTYPE_ADD:
         free(action->data.srv_subtype_add.subtype);
         break;
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
     case ACTION_SEARCH_ADD:
     //fallthrough
     case ACTION_SEARCH_SEND:
@@ -4810,12 +5340,14 @@ static void _mdns_free_action(mdns_action_t *action)
     case ACTION_SEARCH_END:
         _mdns_search_free(action->data.search_add.search);
         break;
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
     case ACTION_TX_HANDLE:
         _mdns_free_tx_packet(action->data.tx_handle.packet);
         break;
     case ACTION_RX_HANDLE:
         _mdns_packet_free(action->data.rx_handle.packet);
         break;
+#ifdef CONFIG_MDNS_ENABLE_DELEGATION
     case ACTION_DELEGATE_HOSTNAME_ADD:
         free((char *)action->data.delegate_hostname.hostname);
         free_address_list(action->data.delegate_hostname.address_list);
@@ -4823,6 +5355,7 @@ static void _mdns_free_action(mdns_action_t *action)
     case ACTION_DELEGATE_HOSTNAME_REMOVE:
         free((char *)action->data.delegate_hostname.hostname);
         break;
+#endif /* CONFIG_MDNS_ENABLE_DELEGATION */
     default:
         break;
     }
@@ -4838,8 +5371,10 @@ static void _mdns_execute_action(mdns_action_t *action)
     mdns_service_t *service;
     char *key;
     char *value;
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
     char *subtype;
     mdns_subtype_t *subtype_item;
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
     mdns_txt_linked_item_t *txt, * t;
 
     switch (action->type) {
@@ -4953,6 +5488,7 @@ static void _mdns_execute_action(mdns_action_t *action)
         _mdns_announce_all_pcbs(&action->data.srv_txt_set.service, 1, false);
 
         break;
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
     case ACTION_SERVICE_SUBTYPE_ADD:
         service = action->data.srv_subtype_add.service->service;
         subtype = action->data.srv_subtype_add.subtype;
@@ -4966,6 +5502,7 @@ static void _mdns_execute_action(mdns_action_t *action)
         subtype_item->next = service->subtype;
         service->subtype = subtype_item;
         break;
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
     case ACTION_SERVICE_DEL:
         a = _mdns_server->services;
         if (action->data.srv_del.service) {
@@ -5004,6 +5541,7 @@ static void _mdns_execute_action(mdns_action_t *action)
         }
 
         break;
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
     case ACTION_SEARCH_ADD:
         _mdns_search_add(action->data.search_add.search);
         break;
@@ -5013,6 +5551,7 @@ static void _mdns_execute_action(mdns_action_t *action)
     case ACTION_SEARCH_END:
         _mdns_search_finish(action->data.search_add.search);
         break;
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
     case ACTION_TX_HANDLE: {
         mdns_tx_packet_t *p = _mdns_server->tx_queue_head;
         // packet to be handled should be at tx head, but must be consistent with the one pushed to action queue
@@ -5029,6 +5568,7 @@ static void _mdns_execute_action(mdns_action_t *action)
         mdns_parse_packet(action->data.rx_handle.packet);
         _mdns_packet_free(action->data.rx_handle.packet);
         break;
+#ifdef CONFIG_MDNS_ENABLE_DELEGATION
     case ACTION_DELEGATE_HOSTNAME_ADD:
         if (!_mdns_delegate_hostname_add(action->data.delegate_hostname.hostname,
                                          action->data.delegate_hostname.address_list)) {
@@ -5040,12 +5580,14 @@ static void _mdns_execute_action(mdns_action_t *action)
         _mdns_delegate_hostname_remove(action->data.delegate_hostname.hostname);
         free((char *)action->data.delegate_hostname.hostname);
         break;
+#endif /* CONFIG_MDNS_ENABLE_DELEGATION */
     default:
         break;
     }
     free(action);
 }
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
 /**
  * @brief  Queue search action
  */
@@ -5067,6 +5609,7 @@ static esp_err_t _mdns_send_search_action(mdns_action_type_t type, mdns_search_o
     }
     return ESP_OK;
 }
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
 /**
  * @brief  Called from timer task to run mDNS responder
@@ -5078,6 +5621,9 @@ static esp_err_t _mdns_send_search_action(mdns_action_type_t type, mdns_search_o
 static void _mdns_scheduler_run(void)
 {
     MDNS_SERVICE_LOCK();
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+    _mdns_fast_answer_queue_run();
+#endif /* CONFIG_MDNS_FAST_PATH_RESPONDER */
     mdns_tx_packet_t *p = _mdns_server->tx_queue_head;
     mdns_action_t *action = NULL;
 
@@ -5107,6 +5653,7 @@ static void _mdns_scheduler_run(void)
     MDNS_SERVICE_UNLOCK();
 }
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
 /**
  * @brief  Called from timer task to run active searches
  */
@@ -5138,6 +5685,7 @@ static void _mdns_search_run(void)
     }
     MDNS_SERVICE_UNLOCK();
 }
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
 /**
  * @brief  the main MDNS service task. Packets are received and parsed here
@@ -5166,7 +5714,9 @@ static void _mdns_service_task(void *pvParameters)
 static void _mdns_timer_cb(void *arg)
 {
     _mdns_scheduler_run();
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
     _mdns_search_run();
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 }
 
 static esp_err_t _mdns_start_timer(void)
@@ -5336,7 +5886,7 @@ esp_err_t mdns_register_netif(esp_netif_t *esp_netif)
 
     for (mdns_if_t i = 0; i < MDNS_MAX_INTERFACES; ++i) {
         if (!s_esp_netifs[i].predefined && s_esp_netifs[i].netif == NULL) {
-            s_esp_netifs[i].netif = esp_netif;
+            _mdns_set_netif_ptr(i, esp_netif);
             err = ESP_OK;
             break;
         }
@@ -5355,7 +5905,7 @@ esp_err_t mdns_unregister_netif(esp_netif_t *esp_netif)
     MDNS_SERVICE_LOCK();
     for (mdns_if_t i = 0; i < MDNS_MAX_INTERFACES; ++i) {
         if (!s_esp_netifs[i].predefined && s_esp_netifs[i].netif == esp_netif) {
-            s_esp_netifs[i].netif = NULL;
+            _mdns_set_netif_ptr(i, NULL);
             err = ESP_OK;
             break;
         }
@@ -5379,9 +5929,19 @@ esp_err_t mdns_init(void)
         return ESP_ERR_NO_MEM;
     }
     memset((uint8_t *)_mdns_server, 0, sizeof(mdns_server_t));
+    if (_mdns_pool_init(&s_tx_buf_pool, s_tx_bufs, sizeof(s_tx_bufs[0]), MDNS_TX_BUF_POOL_LEN) != ESP_OK) {
+        err = ESP_ERR_NO_MEM;
+        goto free_server;
+    }
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+    if (_mdns_pool_init(&s_fast_answer_pool, s_fast_answers, sizeof(s_fast_answers[0]), MDNS_FAST_ANSWER_POOL_LEN) != ESP_OK) {
+        err = ESP_ERR_NO_MEM;
+        goto free_server;
+    }
+#endif /* CONFIG_MDNS_FAST_PATH_RESPONDER */
     // zero-out local copy of netifs to initiate a fresh search by interface key whenever a netif ptr is needed
     for (mdns_if_t i = 0; i < MDNS_MAX_INTERFACES; ++i) {
-        s_esp_netifs[i].netif = NULL;
+        _mdns_set_netif_ptr(i, NULL);
     }
 
     _mdns_server->action_queue = xQueueCreate(MDNS_ACTION_QUEUE_LEN, sizeof(mdns_action_t *));
@@ -5488,6 +6048,10 @@ void mdns_free(void)
         vQueueDelete(_mdns_server->action_queue);
     }
     _mdns_clear_tx_queue_head();
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+    _mdns_clear_fast_answer_queue();
+#endif /* CONFIG_MDNS_FAST_PATH_RESPONDER */
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
     while (_mdns_server->search_once) {
         mdns_search_once_t *h = _mdns_server->search_once;
         _mdns_server->search_once = h->next;
@@ -5500,6 +6064,7 @@ void mdns_free(void)
         }
         free(h);
     }
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
     vSemaphoreDelete(_mdns_server->action_sema);
     free(_mdns_server);
     _mdns_server = NULL;
@@ -5535,6 +6100,7 @@ esp_err_t mdns_hostname_set(const char *hostname)
     return ESP_OK;
 }
 
+#ifdef CONFIG_MDNS_ENABLE_DELEGATION
 esp_err_t mdns_delegate_hostname_add(const char *hostname, const mdns_ip_addr_t *address_list)
 {
     if (!_mdns_server) {
@@ -5593,6 +6159,7 @@ esp_err_t mdns_delegate_hostname_remove(const char *hostname)
     }
     return ESP_OK;
 }
+#endif /* CONFIG_MDNS_ENABLE_DELEGATION */
 
 bool mdns_hostname_exists(const char *hostname)
 {
@@ -5643,7 +6210,11 @@ esp_err_t mdns_service_add_for_host(const char *instance, const char *service, c
         return ESP_ERR_NO_MEM;
     }
 
+#ifdef CONFIG_MDNS_MULTIPLE_INSTANCE
     mdns_srv_item_t *item = _mdns_get_service_item_instance(instance, service, proto, hostname);
+#else
+    mdns_srv_item_t *item = _mdns_get_service_item(service, proto, hostname);
+#endif /* CONFIG_MDNS_MULTIPLE_INSTANCE */
     if (item) {
         return ESP_ERR_INVALID_ARG;
     }
@@ -5903,6 +6474,7 @@ esp_err_t mdns_service_txt_item_remove(const char *service, const char *proto, c
     return mdns_service_txt_item_remove_for_host(NULL, service, proto, _mdns_server->hostname, key);
 }
 
+#ifdef CONFIG_MDNS_ENABLE_SUBTYPES
 esp_err_t mdns_service_subtype_add_for_host(const char *instance_name, const char *service, const char *proto,
         const char *hostname, const char *subtype)
 {
@@ -5935,6 +6507,7 @@ esp_err_t mdns_service_subtype_add_for_host(const char *instance_name, const cha
     }
     return ESP_OK;
 }
+#endif /* CONFIG_MDNS_ENABLE_SUBTYPES */
 
 esp_err_t mdns_service_instance_name_set_for_host(const char *instance_old, const char *service, const char *proto, const char *hostname,
         const char *instance)
@@ -6033,6 +6606,7 @@ esp_err_t mdns_service_remove_all(void)
     return ESP_OK;
 }
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
 /*
  * MDNS QUERY
  * */
@@ -6258,6 +6832,7 @@ esp_err_t mdns_query_aaaa(const char *name, uint32_t timeout, esp_ip6_addr_t *ad
     return ESP_ERR_NOT_FOUND;
 }
 #endif
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
 #ifdef MDNS_ENABLE_DEBUG
 
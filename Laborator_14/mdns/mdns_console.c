@@ -9,6 +9,7 @@
 #include "argtable3/argtable3.h"
 #include "mdns.h"
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
 static const char *ip_protocol_str[] = {"V4", "V6", "MAX"};
 
 static void mdns_print_results(mdns_result_t *results)
@@ -491,6 +492,7 @@ static void register_mdns_query_svc(void)
 
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd_init) );
 }
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 
 static struct {
     struct arg_str *hostname;
@@ -1042,6 +1044,7 @@ void mdns_console_register(void)
     register_mdns_service_txt_remove();
     register_mdns_service_remove_all();
 
+#ifdef CONFIG_MDNS_ENABLE_QUERIER
     register_mdns_query_a();
 #if CONFIG_LWIP_IPV6
     register_mdns_query_aaaa();
@@ -1052,4 +1055,5 @@ void mdns_console_register(void)
 
     register_mdns_query_ip();
     register_mdns_query_svc();
+#endif /* CONFIG_MDNS_ENABLE_QUERIER */
 }
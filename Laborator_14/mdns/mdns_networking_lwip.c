@@ -8,6 +8,7 @@
  * MDNS Server Networking
  *
  */
+#include <stddef.h>
 #include <string.h>
 #include "esp_log.h"
 #include "lwip/ip_addr.h"
@@ -33,6 +34,20 @@ static struct udp_pcb *_pcb_main = NULL;
 
 static void _udp_recv(void *arg, struct udp_pcb *upcb, struct pbuf *pb, const ip_addr_t *raddr, uint16_t rport);
 
+/*
+ * lwIP netif of each mDNS interface, updated from _mdns_netif_map_update(), so the receive callback
+ * finds the interface of a datagram with a few pointer compares instead of querying esp-netif
+ * for every interface.
+ */
+static struct netif *s_netif_map[MDNS_MAX_INTERFACES];
+
+/*
+ * Packet descriptors are taken from a static pool (the payload stays in the pbuf), so the receive
+ * callback does not allocate per datagram. Descriptors come back to the pool from _mdns_packet_free().
+ */
+static mdns_rx_packet_t s_rx_packets[CONFIG_MDNS_RX_BUFFER_POOL_SIZE];
+static mdns_pool_t s_rx_packet_pool;
+
 /**
  * @brief  Low level UDP PCB Initialize
  */
@@ -41,6 +56,9 @@ static esp_err_t _udp_pcb_main_init(void)
     if (_pcb_main) {
         return ESP_OK;
     }
+    if (_mdns_pool_init(&s_rx_packet_pool, s_rx_packets, sizeof(s_rx_packets[0]), CONFIG_MDNS_RX_BUFFER_POOL_SIZE) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
     _pcb_main = udp_new();
     if (!_pcb_main) {
         return ESP_ERR_NO_MEM;
@@ -126,14 +144,14 @@ static void _udp_recv(void *arg, struct udp_pcb *upcb, struct pbuf *pb, const ip
 {
 
     uint8_t i;
+    struct netif *input_netif = ip_current_input_netif();
     while (pb != NULL) {
         struct pbuf *this_pb = pb;
         pb = pb->next;
         this_pb->next = NULL;
 
-        mdns_rx_packet_t *packet = (mdns_rx_packet_t *)malloc(sizeof(mdns_rx_packet_t));
+        mdns_rx_packet_t *packet = (mdns_rx_packet_t *)_mdns_pool_alloc(&s_rx_packet_pool);
         if (!packet) {
-            HOOK_MALLOC_FAILED;
             //missed packet - no memory
             pbuf_free(this_pb);
             continue;
@@ -171,8 +189,8 @@ static void _udp_recv(void *arg, struct udp_pcb *upcb, struct pbuf *pb, const ip
         struct udp_pcb *pcb = NULL;
         for (i = 0; i < MDNS_MAX_INTERFACES; i++) {
             pcb = _mdns_server->interfaces[i].pcbs[packet->ip_protocol].pcb;
-            netif = esp_netif_get_netif_impl(_mdns_get_esp_netif(i));
-            if (pcb && netif && netif == ip_current_input_netif ()) {
+            netif = s_netif_map[i];
+            if (pcb && netif && netif == input_netif) {
                 if (packet->src.type == IPADDR_TYPE_V4) {
 #if CONFIG_LWIP_IPV6
                     if ((packet->src.u_addr.ip4.addr & netif->netmask.u_addr.ip4.addr) != (netif->ip_addr.u_addr.ip4.addr & netif->netmask.u_addr.ip4.addr)) {
@@ -192,7 +210,7 @@ static void _udp_recv(void *arg, struct udp_pcb *upcb, struct pbuf *pb, const ip
         if (!pcb || !_mdns_server || !_mdns_server->action_queue
                 || _mdns_send_rx_action(packet) != ESP_OK) {
             pbuf_free(this_pb);
-            free(packet);
+            _mdns_pool_free(&s_rx_packet_pool, packet);
         }
     }
 
@@ -260,6 +278,7 @@ static esp_err_t _udp_pcb_init(mdns_if_t tcpip_if, mdns_ip_protocol_t ip_protoco
 
     _mdns_server->interfaces[tcpip_if].pcbs[ip_protocol].pcb = _pcb_main;
     _mdns_server->interfaces[tcpip_if].pcbs[ip_protocol].failed_probes = 0;
+    _mdns_netif_map_update(tcpip_if, _mdns_get_esp_netif(tcpip_if));
     return ESP_OK;
 }
 
@@ -267,9 +286,6 @@ typedef struct {
     struct tcpip_api_call_data call;
     mdns_if_t tcpip_if;
     mdns_ip_protocol_t ip_protocol;
-    struct pbuf *pbt;
-    const ip_addr_t *ip;
-    uint16_t port;
     esp_err_t err;
 } mdns_api_call_t;
 
@@ -319,52 +335,88 @@ esp_err_t _mdns_pcb_deinit(mdns_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
     return msg.err;
 }
 
-static err_t _mdns_udp_pcb_write_api(struct tcpip_api_call_data *api_call_msg)
+#if LWIP_SUPPORT_CUSTOM_PBUF
+/*
+ * TX buffers are sent in place: the custom pbuf lives at the start of the buffer's headroom
+ * and the payload follows within the same buffer. lwIP checks the room for the UDP/IP/link
+ * headers against the end of the pbuf struct, so the headers always fit in front of the
+ * payload and udp_sendto() never chains an extra header pbuf. The buffer is released from
+ * the pbuf's free callback, i.e. once lwIP and the netif driver are done with it.
+ */
+#define MDNS_TX_PBUF_OFFSET LWIP_MEM_ALIGN_SIZE(PBUF_TRANSPORT)
+
+_Static_assert(sizeof(struct pbuf_custom) + MDNS_TX_PBUF_OFFSET <= MDNS_TX_BUF_HEADROOM,
+               "MDNS_TX_BUF_HEADROOM does not fit the pbuf and the protocol headers");
+
+static void _mdns_tx_pbuf_free(struct pbuf *p)
 {
-    void *nif = NULL;
-    mdns_api_call_t *msg = (mdns_api_call_t *)api_call_msg;
-    mdns_pcb_t *_pcb = &_mdns_server->interfaces[msg->tcpip_if].pcbs[msg->ip_protocol];
-    nif = esp_netif_get_netif_impl(_mdns_get_esp_netif(msg->tcpip_if));
-    if (!nif) {
-        pbuf_free(msg->pbt);
-        msg->err = ERR_IF;
-        return ERR_IF;
+    _mdns_tx_buf_release((mdns_tx_buf_t *)((uint8_t *)p - offsetof(mdns_tx_buf_t, data)));
+}
+#endif // LWIP_SUPPORT_CUSTOM_PBUF
+
+/**
+ * @brief  Wrap TX buffer into a pbuf, copying only if custom pbufs are not available
+ *
+ * The buffer is owned by the returned pbuf (or released on failure)
+ */
+static struct pbuf *_mdns_tx_buf_to_pbuf(mdns_tx_buf_t *buf)
+{
+    struct pbuf *pbt = NULL;
+#if LWIP_SUPPORT_CUSTOM_PBUF
+    struct pbuf_custom *cp = (struct pbuf_custom *)buf->data;
+    cp->custom_free_function = _mdns_tx_pbuf_free;
+    pbt = pbuf_alloced_custom(PBUF_TRANSPORT, buf->len, PBUF_RAM, cp,
+                              MDNS_TX_BUF_PAYLOAD(buf) - MDNS_TX_PBUF_OFFSET, MDNS_TX_PBUF_OFFSET + buf->len);
+    if (pbt) {
+        return pbt;
     }
-    esp_err_t err = udp_sendto_if (_pcb->pcb, msg->pbt, msg->ip, msg->port, (struct netif *)nif);
-    pbuf_free(msg->pbt);
-    msg->err = err;
-    return err;
+#endif // LWIP_SUPPORT_CUSTOM_PBUF
+    pbt = pbuf_alloc(PBUF_TRANSPORT, buf->len, PBUF_RAM);
+    if (pbt) {
+        memcpy((uint8_t *)pbt->payload, MDNS_TX_BUF_PAYLOAD(buf), buf->len);
+    }
+    _mdns_tx_buf_release(buf);
+    return pbt;
 }
 
-size_t _mdns_udp_pcb_write(mdns_if_t tcpip_if, mdns_ip_protocol_t ip_protocol, const esp_ip_addr_t *ip, uint16_t port, uint8_t *data, size_t len)
+/**
+ * @brief  Send TX buffer from LwIP thread
+ */
+static void _mdns_udp_pcb_write_cb(void *arg)
 {
-    struct pbuf *pbt = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
-    if (pbt == NULL) {
-        return 0;
+    mdns_tx_buf_t *buf = (mdns_tx_buf_t *)arg;
+    mdns_pcb_t *_pcb = _mdns_server ? &_mdns_server->interfaces[buf->tcpip_if].pcbs[buf->ip_protocol] : NULL;
+    struct netif *nif = esp_netif_get_netif_impl(_mdns_get_esp_netif(buf->tcpip_if));
+    if (!_pcb || !_pcb->pcb || !nif) {
+        _mdns_tx_buf_release(buf);
+        return;
     }
-    memcpy((uint8_t *)pbt->payload, data, len);
 
     ip_addr_t ip_add_copy;
 #if CONFIG_LWIP_IPV6
-    ip_add_copy.type = ip->type;
-    memcpy(&(ip_add_copy.u_addr), &(ip->u_addr), sizeof(ip_add_copy.u_addr));
+    ip_add_copy.type = buf->dst.type;
+    memcpy(&(ip_add_copy.u_addr), &(buf->dst.u_addr), sizeof(ip_add_copy.u_addr));
 #else
-    memcpy(&(ip_add_copy.addr), &(ip->u_addr), sizeof(ip_add_copy.addr));
+    memcpy(&(ip_add_copy.addr), &(buf->dst.u_addr), sizeof(ip_add_copy.addr));
 #endif // CONFIG_LWIP_IPV6
+    uint16_t port = buf->port;
 
-    mdns_api_call_t msg = {
-        .tcpip_if = tcpip_if,
-        .ip_protocol = ip_protocol,
-        .pbt = pbt,
-        .ip = &ip_add_copy,
-        .port = port
-    };
-    tcpip_api_call(_mdns_udp_pcb_write_api, &msg.call);
+    struct pbuf *pbt = _mdns_tx_buf_to_pbuf(buf);
+    if (pbt == NULL) {
+        return;
+    }
+    udp_sendto_if (_pcb->pcb, pbt, &ip_add_copy, port, nif);
+    pbuf_free(pbt);
+}
 
-    if (msg.err) {
-        return 0;
+esp_err_t _mdns_udp_pcb_write_buf(mdns_tx_buf_t *buf)
+{
+    // Posting instead of tcpip_api_call() lets the mDNS task continue with the next packet
+    if (tcpip_callback(_mdns_udp_pcb_write_cb, buf) != ERR_OK) {
+        _mdns_tx_buf_release(buf);
+        return ESP_ERR_NO_MEM;
     }
-    return len;
+    return ESP_OK;
 }
 
 void *_mdns_get_packet_data(mdns_rx_packet_t *packet)
@@ -380,5 +432,12 @@ size_t _mdns_get_packet_len(mdns_rx_packet_t *packet)
 void _mdns_packet_free(mdns_rx_packet_t *packet)
 {
     pbuf_free(packet->pb);
-    free(packet);
+    _mdns_pool_free(&s_rx_packet_pool, packet);
+}
+
+void _mdns_netif_map_update(mdns_if_t tcpip_if, esp_netif_t *esp_netif)
+{
+    if (tcpip_if < MDNS_MAX_INTERFACES) {
+        s_netif_map[tcpip_if] = esp_netif ? esp_netif_get_netif_impl(esp_netif) : NULL;
+    }
 }
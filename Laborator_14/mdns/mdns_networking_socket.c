@@ -81,11 +81,28 @@ size_t _mdns_get_packet_len(mdns_rx_packet_t *packet)
     return packet->pb->len;
 }
 
+/*
+ * Received packets are read straight into slots of a static pool, which hold the packet
+ * descriptor, the pbuf wrapper and the payload, so the receive task does not need a bounce
+ * buffer nor per packet allocations. Slots come back to the pool from _mdns_packet_free().
+ */
+typedef struct {
+    mdns_rx_packet_t packet;                /*!< must stay first, _mdns_packet_free() casts it back to the slot */
+    struct pbuf pb;
+    uint8_t data[MDNS_MAX_PACKET_SIZE];
+} mdns_rx_slot_t;
+
+static mdns_rx_slot_t s_rx_slots[CONFIG_MDNS_RX_BUFFER_POOL_SIZE];
+static mdns_pool_t s_rx_slot_pool;
+
 void _mdns_packet_free(mdns_rx_packet_t *packet)
 {
-    free(packet->pb->payload);
-    free(packet->pb);
-    free(packet);
+    _mdns_pool_free(&s_rx_slot_pool, packet);
+}
+
+void _mdns_netif_map_update(mdns_if_t tcpip_if, esp_netif_t *esp_netif)
+{
+    // sockets are bound to their interface, the receive task knows the interface already
 }
 
 esp_err_t _mdns_pcb_deinit(mdns_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
@@ -189,24 +206,30 @@ static inline size_t espaddr_to_inet(const esp_ip_addr_t *addr, const uint16_t p
     return ss_addr_len;
 }
 
-size_t _mdns_udp_pcb_write(mdns_if_t tcpip_if, mdns_ip_protocol_t ip_protocol, const esp_ip_addr_t *ip, uint16_t port, uint8_t *data, size_t len)
+esp_err_t _mdns_udp_pcb_write_buf(mdns_tx_buf_t *buf)
 {
-    int sock = pcb_to_sock(_mdns_server->interfaces[tcpip_if].pcbs[ip_protocol].pcb);
+    esp_err_t ret = ESP_FAIL;
+    int sock = pcb_to_sock(_mdns_server->interfaces[buf->tcpip_if].pcbs[buf->ip_protocol].pcb);
     if (sock < 0) {
-        return 0;
+        goto release;
     }
     struct sockaddr_storage in_addr;
-    size_t ss_size = espaddr_to_inet(ip, htons(port), ip_protocol, &in_addr);
+    size_t ss_size = espaddr_to_inet(&buf->dst, htons(buf->port), buf->ip_protocol, &in_addr);
     if (!ss_size) {
         ESP_LOGE(TAG, "espaddr_to_inet() failed: Mismatch of IP protocols");
-        return 0;
+        goto release;
     }
-    ESP_LOGD(TAG, "[sock=%d]: Sending to IP %s port %d", sock, get_string_address(&in_addr), port);
-    ssize_t actual_len = sendto(sock, data, len, 0, (struct sockaddr *)&in_addr, ss_size);
+    ESP_LOGD(TAG, "[sock=%d]: Sending to IP %s port %d", sock, get_string_address(&in_addr), buf->port);
+    ssize_t actual_len = sendto(sock, MDNS_TX_BUF_PAYLOAD(buf), buf->len, 0, (struct sockaddr *)&in_addr, ss_size);
     if (actual_len < 0) {
-        ESP_LOGE(TAG, "[sock=%d]: _mdns_udp_pcb_write sendto() has failed\n errno=%d: %s", sock, errno, strerror(errno));
-    }
-    return actual_len;
+        ESP_LOGE(TAG, "[sock=%d]: _mdns_udp_pcb_write_buf sendto() has failed\n errno=%d: %s", sock, errno, strerror(errno));
+        goto release;
+    }
+    ret = ESP_OK;
+release:
+    // sendto() copies the data, so the buffer can go back to the pool right away
+    _mdns_tx_buf_release(buf);
+    return ret;
 }
 
 static inline void inet_to_espaddr(const struct sockaddr_storage *in_addr, esp_ip_addr_t *addr, uint16_t *port)
@@ -279,37 +302,36 @@ void sock_recv_task(void *arg)
                     continue;
                 }
                 if (FD_ISSET(sock, &rfds)) {
-                    static char recvbuf[MDNS_MAX_PACKET_SIZE];
                     uint16_t port = 0;
 
                     struct sockaddr_storage raddr; // Large enough for both IPv4 or IPv6
                     socklen_t socklen = sizeof(struct sockaddr_storage);
                     esp_ip_addr_t addr = {0};
-                    int len = recvfrom(sock, recvbuf, sizeof(recvbuf), 0,
+                    mdns_rx_slot_t *slot = (mdns_rx_slot_t *)_mdns_pool_alloc(&s_rx_slot_pool);
+                    if (slot == NULL) {
+                        char discard;
+                        ESP_LOGE(TAG, "Failed to allocate the mdns packet");
+                        // still consume the datagram so select() does not keep reporting it
+                        recv(sock, &discard, sizeof(discard), 0);
+                        continue;
+                    }
+                    int len = recvfrom(sock, slot->data, sizeof(slot->data), 0,
                                        (struct sockaddr *) &raddr, &socklen);
                     if (len < 0) {
                         ESP_LOGE(TAG, "multicast recvfrom failed. errno=%d: %s", errno, strerror(errno));
+                        _mdns_pool_free(&s_rx_slot_pool, slot);
                         break;
                     }
                     ESP_LOGD(TAG, "[sock=%d]: Received from IP:%s", sock, get_string_address(&raddr));
-                    ESP_LOG_BUFFER_HEXDUMP(TAG, recvbuf, len, ESP_LOG_VERBOSE);
+                    ESP_LOG_BUFFER_HEXDUMP(TAG, slot->data, len, ESP_LOG_VERBOSE);
                     inet_to_espaddr(&raddr, &addr, &port);
 
-                    // Allocate the packet structure and pass it to the mdns main engine
-                    mdns_rx_packet_t *packet = (mdns_rx_packet_t *) calloc(1, sizeof(mdns_rx_packet_t));
-                    struct pbuf *packet_pbuf = calloc(1, sizeof(struct pbuf));
-                    uint8_t *buf = malloc(len);
-                    if (packet == NULL || packet_pbuf == NULL || buf == NULL ) {
-                        free(buf);
-                        free(packet_pbuf);
-                        free(packet);
-                        HOOK_MALLOC_FAILED;
-                        ESP_LOGE(TAG, "Failed to allocate the mdns packet");
-                        continue;
-                    }
-                    memcpy(buf, recvbuf, len);
+                    // Pass the packet, which lives in the slot, to the mdns main engine
+                    mdns_rx_packet_t *packet = &slot->packet;
+                    struct pbuf *packet_pbuf = &slot->pb;
+                    memset(packet, 0, sizeof(mdns_rx_packet_t));
                     packet_pbuf->next = NULL;
-                    packet_pbuf->payload = buf;
+                    packet_pbuf->payload = slot->data;
                     packet_pbuf->tot_len = len;
                     packet_pbuf->len = len;
                     packet->tcpip_if = tcpip_if;
@@ -325,9 +347,7 @@ void sock_recv_task(void *arg)
                         packet->src.type == ESP_IPADDR_TYPE_V4 ? MDNS_IP_PROTOCOL_V4 : MDNS_IP_PROTOCOL_V6;
                     if (!_mdns_server || !_mdns_server->action_queue || _mdns_send_rx_action(packet) != ESP_OK) {
                         ESP_LOGE(TAG, "_mdns_send_rx_action failed!");
-                        free(packet->pb->payload);
-                        free(packet->pb);
-                        free(packet);
+                        _mdns_pool_free(&s_rx_slot_pool, slot);
                     }
                 }
             }
@@ -338,6 +358,10 @@ void sock_recv_task(void *arg)
 
 static void mdns_networking_init(void)
 {
+    if (_mdns_pool_init(&s_rx_slot_pool, s_rx_slots, sizeof(s_rx_slots[0]), CONFIG_MDNS_RX_BUFFER_POOL_SIZE) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the receive buffer pool");
+        return;
+    }
     if (s_run_sock_recv_task == false) {
         s_run_sock_recv_task = true;
         xTaskCreate( sock_recv_task, "mdns recv task", 3 * 1024, NULL, 5, NULL );
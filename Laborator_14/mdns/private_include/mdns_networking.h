@@ -29,16 +29,46 @@ esp_err_t _mdns_pcb_init(mdns_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
  */
 esp_err_t _mdns_pcb_deinit(mdns_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
 
+/**
+ * @brief  Let the networking layer know which esp-netif serves the given interface
+ *
+ * Called whenever the interface's netif changes (registered, unregistered, predefined netif found
+ * or cleaned), with NULL if the interface has no netif anymore.
+ */
+void _mdns_netif_map_update(mdns_if_t tcpip_if, esp_netif_t *esp_netif);
+
+/**
+ * @brief  Create the pool on first use, objs is an array of count objects of the given size
+ */
+esp_err_t _mdns_pool_init(mdns_pool_t *pool, void *objs, size_t size, size_t count);
+
+/**
+ * @brief  Take an object from the pool, from heap if all of them are in use
+ */
+void *_mdns_pool_alloc(mdns_pool_t *pool);
+
+/**
+ * @brief  Return an object taken with _mdns_pool_alloc()
+ */
+void _mdns_pool_free(mdns_pool_t *pool, void *obj);
+
+/**
+ * @brief  Return TX buffer to the pool once its data has left the network stack
+ */
+void _mdns_tx_buf_release(mdns_tx_buf_t *buf);
+
 /**
  * @brief  send packet over UDP
  *
- * @param  server       The server
- * @param  data         byte array containing the packet data
- * @param  len          length of the packet data
+ * The buffer carries its destination (interface, protocol, address, port) and is owned
+ * by the networking layer from this call on. It is handed back with _mdns_tx_buf_release()
+ * after transmission, which may happen after this function returns.
+ *
+ * @param  buf          serialized packet
  *
- * @return length of sent packet or 0 on error
+ * @return ESP_OK if the packet was passed to the network stack
  */
-size_t _mdns_udp_pcb_write(mdns_if_t tcpip_if, mdns_ip_protocol_t ip_protocol, const esp_ip_addr_t *ip, uint16_t port, uint8_t *data, size_t len);
+esp_err_t _mdns_udp_pcb_write_buf(mdns_tx_buf_t *buf);
 
 /**
  * @brief  Gets data pointer to the mDNS packet
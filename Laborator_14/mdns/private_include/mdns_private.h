@@ -96,6 +96,9 @@
 #endif
 #define MDNS_NAME_BUF_LEN           (MDNS_NAME_MAX_LEN+1)   // Maximum char buffer size to hold hostname, instance, service or proto
 #define MDNS_MAX_PACKET_SIZE        1460                    // Maximum size of mDNS  outgoing packet
+#define MDNS_TX_BUF_POOL_LEN        CONFIG_MDNS_TX_BUFFER_POOL_SIZE // Number of preallocated outgoing packet buffers
+#define MDNS_FAST_ANSWER_POOL_LEN   8                       // Number of preallocated deferred fast path answers
+#define MDNS_TX_BUF_HEADROOM        96                      // Space in front of the payload for the lwIP pbuf and the UDP/IP/link headers
 
 #define MDNS_HEAD_LEN               12
 #define MDNS_HEAD_ID_OFFSET         0
@@ -339,6 +342,48 @@ typedef struct mdns_tx_packet_s {
     uint16_t id;
 } mdns_tx_packet_t;
 
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+/*
+ * PTR question answered by the fast path after the shared answer delay. Only the question is
+ * kept while it waits, the response is serialized once it is due.
+ */
+typedef struct mdns_fast_answer_s {
+    struct mdns_fast_answer_s *next;        /*!< next deferred answer in the queue (the free list link while pooled) */
+    uint32_t send_at;                       /*!< time in ms to send the answer at */
+    esp_ip_addr_t dst;                      /*!< destination address */
+    mdns_if_t tcpip_if;                     /*!< interface to send on */
+    mdns_ip_protocol_t ip_protocol;         /*!< pcb type V4/V6 */
+    uint16_t port;                          /*!< destination port */
+    uint16_t id;                            /*!< ID of the query */
+    char service[MDNS_NAME_BUF_LEN];
+    char proto[MDNS_NAME_BUF_LEN];
+} mdns_fast_answer_t;
+#endif /* CONFIG_MDNS_FAST_PATH_RESPONDER */
+
+/*
+ * Fixed size objects taken from a static array, with heap as the fallback once all of them are
+ * in use. A free object keeps the free list link in its first pointer.
+ */
+typedef struct {
+    void *free;                             /*!< first free object */
+    uint8_t *objs;                          /*!< the static array */
+    size_t size;                            /*!< size of one object */
+    size_t count;                           /*!< number of objects in the array */
+    SemaphoreHandle_t lock;
+} mdns_pool_t;
+
+typedef struct mdns_tx_buf_s {
+    struct mdns_tx_buf_s *next;             /*!< the free list link while pooled */
+    esp_ip_addr_t dst;                      /*!< destination address */
+    mdns_if_t tcpip_if;                     /*!< interface to send on */
+    mdns_ip_protocol_t ip_protocol;         /*!< pcb type V4/V6 */
+    uint16_t port;                          /*!< destination port */
+    uint16_t len;                           /*!< length of the serialized packet */
+    uint8_t data[MDNS_TX_BUF_HEADROOM + MDNS_MAX_PACKET_SIZE] __attribute__((aligned(4)));
+} mdns_tx_buf_t;
+
+#define MDNS_TX_BUF_PAYLOAD(buf)    ((buf)->data + MDNS_TX_BUF_HEADROOM)
+
 typedef struct {
     mdns_pcb_state_t state;
     struct udp_pcb *pcb;
@@ -385,6 +430,9 @@ typedef struct mdns_server_s {
     QueueHandle_t action_queue;
     SemaphoreHandle_t action_sema;
     mdns_tx_packet_t *tx_queue_head;
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+    mdns_fast_answer_t *fast_answer_queue_head;
+#endif /* CONFIG_MDNS_FAST_PATH_RESPONDER */
     mdns_search_once_t *search_once;
     esp_timer_handle_t timer_handle;
 } mdns_server_t;
@@ -0,0 +1,168 @@
+/*
+ * SPDX-FileCopyrightText: 2015-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Measures the time mdns_parse_packet() takes to answer a single question query,
+ * including serializing and "sending" the response.
+ * Build it with and without CONFIG_MDNS_FAST_PATH_RESPONDER to compare (see bench.sh)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp32_mock.h"
+#include "mdns.h"
+#include "mdns_private.h"
+
+#define BENCH_ITERATIONS    200000
+
+//
+// Dependency injected test functions
+void mdns_test_execute_action(void *action);
+void mdns_test_fast_answer_queue_run(void);
+void esp_netif_mock_set_ip4_addr(uint32_t addr);
+void mdns_test_init_di(void);
+extern mdns_server_t *_mdns_server;
+
+void mdns_parse_packet(mdns_rx_packet_t *packet);
+
+// stands in for the pcb of interface 0, A answers are only added on interfaces with a pcb
+static uint8_t bench_pcb;
+
+static int bench_hostname_set(const char *mdns_hostname)
+{
+    for (int i = 0; i < MDNS_MAX_INTERFACES; i++) {
+        _mdns_server->interfaces[i].pcbs[MDNS_IP_PROTOCOL_V4].state = PCB_RUNNING;
+        _mdns_server->interfaces[i].pcbs[MDNS_IP_PROTOCOL_V6].state = PCB_RUNNING;
+    }
+    _mdns_server->interfaces[0].pcbs[MDNS_IP_PROTOCOL_V4].pcb = (struct udp_pcb *)&bench_pcb;
+    int ret = mdns_hostname_set(mdns_hostname);
+    mdns_action_t *a = NULL;
+    GetLastItem(&a);
+    mdns_test_execute_action(a);
+    return ret;
+}
+
+static int bench_service_add(const char *instance, const char *service_name, const char *proto, uint32_t port, mdns_txt_item_t txt[], size_t num_items)
+{
+    if (mdns_service_add(instance, service_name, proto, port, txt, num_items)) {
+        // This is expected failure as the service thread is not running
+    }
+    mdns_action_t *a = NULL;
+    GetLastItem(&a);
+    mdns_test_execute_action(a);
+    return ESP_OK;
+}
+
+/**
+ * @brief  Sends out everything the parser left behind: answers scheduled on the tx queue
+ *         (generic path, unicast responses too) and deferred answers (fast path)
+ */
+static void bench_flush_tx(void)
+{
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+    // serialized and sent as if their delay was over
+    for (mdns_fast_answer_t *a = _mdns_server->fast_answer_queue_head; a; a = a->next) {
+        a->send_at = 0;
+    }
+    mdns_test_fast_answer_queue_run();
+#endif
+    while (_mdns_server->tx_queue_head) {
+        mdns_action_t *a = malloc(sizeof(mdns_action_t));
+        if (!a) {
+            abort();
+        }
+        a->type = ACTION_TX_HANDLE;
+        a->data.tx_handle.packet = _mdns_server->tx_queue_head;
+        _mdns_server->tx_queue_head->queued = true;
+        mdns_test_execute_action(a);
+    }
+}
+
+static size_t bench_make_query(uint8_t *buf, const char *labels[], uint16_t type)
+{
+    size_t len = 12;
+    memset(buf, 0, len);
+    buf[5] = 1; // one question
+    for (int i = 0; labels[i]; i++) {
+        size_t l = strlen(labels[i]);
+        buf[len++] = l;
+        memcpy(buf + len, labels[i], l);
+        len += l;
+    }
+    buf[len++] = 0;
+    buf[len++] = type >> 8;
+    buf[len++] = type & 0xFF;
+    buf[len++] = 0x00;
+    buf[len++] = 0x01; // class IN
+    return len;
+}
+
+static void bench_run(const char *name, uint8_t *query, size_t len)
+{
+    struct pbuf pb = { .payload = query, .len = len };
+    mdns_rx_packet_t packet = { 0 };
+    struct timespec start, end;
+
+    packet.pb = &pb;
+    packet.tcpip_if = 0;
+    packet.ip_protocol = MDNS_IP_PROTOCOL_V4;
+    packet.src.type = ESP_IPADDR_TYPE_V4;
+    packet.src.u_addr.ip4.addr = 0x0201A8C0;
+    packet.src_port = MDNS_SERVICE_PORT;
+    packet.multicast = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        mdns_parse_packet(&packet);
+        bench_flush_tx();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%-24s %10.0f ns/query\n", name, ns / BENCH_ITERATIONS);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t buf[256];
+    size_t len;
+    mdns_txt_item_t txt[2] = {
+        {"board", "esp32"},
+        {"path", "/"}
+    };
+
+    mdns_test_init_di();
+    esp_netif_mock_set_ip4_addr(0x6401A8C0); // 192.168.1.100, the A answers carry an address
+    if (mdns_init() || bench_hostname_set("minifritz")) {
+        abort();
+    }
+    bench_service_add("ESP WebServer", "_http", "_tcp", 80, txt, 2);
+    bench_service_add(NULL, "_arduino", "_tcp", 3232, NULL, 0);
+    bench_service_add(NULL, "_workstation", "_tcp", 9, NULL, 0);
+
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+    printf("fast path responder: on\n");
+#else
+    printf("fast path responder: off\n");
+#endif
+    len = bench_make_query(buf, (const char *[]) {"_http", "_tcp", "local", NULL}, MDNS_TYPE_PTR);
+    bench_run("PTR _http._tcp.local", buf, len);
+    len = bench_make_query(buf, (const char *[]) {"minifritz", "local", NULL}, MDNS_TYPE_A);
+    bench_run("A minifritz.local", buf, len);
+    len = bench_make_query(buf, (const char *[]) {"_ftp", "_tcp", "local", NULL}, MDNS_TYPE_PTR);
+    bench_run("PTR _ftp._tcp.local", buf, len);
+
+    mdns_service_remove_all();
+    mdns_action_t *a = NULL;
+    GetLastItem(&a);
+    mdns_test_execute_action(a);
+    _mdns_server->interfaces[0].pcbs[MDNS_IP_PROTOCOL_V4].pcb = NULL;
+    ForceTaskDelete();
+    mdns_free();
+    return 0;
+}
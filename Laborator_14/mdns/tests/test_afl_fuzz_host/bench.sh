@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+#
+# Builds the responder benchmark with and without the fast path responder
+# and runs both, to compare the time spent answering simple queries.
+#
+# Uses the same host mocks as the fuzzer, so IDF_PATH has to be set,
+# the same as for `make INSTR=off`.
+#
+set -e
+
+cd "$(dirname "$0")"
+
+OUT=build/bench
+
+for name in fast generic; do
+    mkdir -p $OUT/$name
+    cp sdkconfig.h $OUT/$name/sdkconfig.h
+    if [ $name = generic ]; then
+        sed -i "/^#define CONFIG_MDNS_FAST_PATH_RESPONDER /d" $OUT/$name/sdkconfig.h
+    fi
+    make -s -B INSTR=off MDNS_BENCH=on SDKCONFIG_DIR=$OUT/$name bench > /dev/null
+    mv bench $OUT/$name/bench
+    ./$OUT/$name/bench
+done
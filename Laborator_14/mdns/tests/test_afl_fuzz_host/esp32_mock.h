@@ -62,6 +62,7 @@
 #define xQueueCreateMutex(s)
 #define _mdns_pcb_init(a,b)         true
 #define _mdns_pcb_deinit(a,b)       true
+#define _mdns_netif_map_update(a,b)
 #define xSemaphoreCreateMutex()     malloc(1)
 #define xSemaphoreCreateBinary()    malloc(1)
 #define vSemaphoreDelete(s)         free(s)
@@ -73,7 +74,7 @@
 
 #define ESP_TASK_PRIO_MAX 25
 #define ESP_TASKD_EVENT_PRIO 5
-#define _mdns_udp_pcb_write(tcpip_if, ip_protocol, ip, port, data, len) len
+#define _mdns_udp_pcb_write_buf(buf)   (_mdns_tx_buf_release(buf), ESP_OK)
 #define TaskHandle_t TaskHandle_t
 
 
@@ -44,9 +44,22 @@ esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key)
     return NULL;
 }
 
+static uint32_t s_ip4_addr;   // network order, 0 if the netif has no address
+
+void esp_netif_mock_set_ip4_addr(uint32_t addr)
+{
+    s_ip4_addr = addr;
+}
+
 esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info)
 {
-    return ESP_ERR_NOT_SUPPORTED;
+    if (!s_ip4_addr) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    // the type is opaque here: the address is its first member, followed by netmask and gateway
+    memset(ip_info, 0, 3 * sizeof(uint32_t));
+    memcpy(ip_info, &s_ip4_addr, sizeof(s_ip4_addr));
+    return ESP_OK;
 }
 
 esp_err_t esp_netif_dhcpc_get_status(esp_netif_t *esp_netif, esp_netif_dhcp_status_t *status)
@@ -18,6 +18,9 @@ mdns_search_once_t *(*mdns_test_static_search_init)(const char *name, const char
         mdns_query_notify_t notifier) = NULL;
 esp_err_t         (*mdns_test_static_send_search_action)(mdns_action_type_t type, mdns_search_once_t *search) = NULL;
 void              (*mdns_test_static_search_free)(mdns_search_once_t *search) = NULL;
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+void              (*mdns_test_static_fast_answer_queue_run)(void) = NULL;
+#endif
 
 static void _mdns_execute_action(mdns_action_t *action);
 static mdns_srv_item_t *_mdns_get_service_item(const char *service, const char *proto, const char *hostname);
@@ -25,6 +28,9 @@ static mdns_search_once_t *_mdns_search_init(const char *name, const char *servi
         uint32_t timeout, uint8_t max_results, mdns_query_notify_t notifier);
 static esp_err_t _mdns_send_search_action(mdns_action_type_t type, mdns_search_once_t *search);
 static void _mdns_search_free(mdns_search_once_t *search);
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+static void _mdns_fast_answer_queue_run(void);
+#endif
 
 void mdns_test_init_di(void)
 {
@@ -33,6 +39,9 @@ void mdns_test_init_di(void)
     mdns_test_static_search_init = _mdns_search_init;
     mdns_test_static_send_search_action = _mdns_send_search_action;
     mdns_test_static_search_free = _mdns_search_free;
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+    mdns_test_static_fast_answer_queue_run = _mdns_fast_answer_queue_run;
+#endif
 }
 
 void mdns_test_execute_action(void *action)
@@ -40,6 +49,13 @@ void mdns_test_execute_action(void *action)
     mdns_test_static_execute_action((mdns_action_t *)action);
 }
 
+#ifdef CONFIG_MDNS_FAST_PATH_RESPONDER
+void mdns_test_fast_answer_queue_run(void)
+{
+    mdns_test_static_fast_answer_queue_run();
+}
+#endif
+
 void mdns_test_search_free(mdns_search_once_t *search)
 {
     return mdns_test_static_search_free(search);
@@ -295,6 +295,12 @@
 #define CONFIG_MDNS_TASK_AFFINITY 0x0
 #define CONFIG_MDNS_SERVICE_ADD_TIMEOUT_MS 1
 #define CONFIG_MDNS_TIMER_PERIOD_MS 100
+#define CONFIG_MDNS_TX_BUFFER_POOL_SIZE 2
+#define CONFIG_MDNS_FAST_PATH_RESPONDER 1
+#define CONFIG_MDNS_MULTIPLE_INSTANCE 1
+#define CONFIG_MDNS_ENABLE_QUERIER 1
+#define CONFIG_MDNS_ENABLE_DELEGATION 1
+#define CONFIG_MDNS_ENABLE_SUBTYPES 1
 #define CONFIG_MQTT_PROTOCOL_311 1
 #define CONFIG_MQTT_TRANSPORT_SSL 1
 #define CONFIG_MQTT_TRANSPORT_WEBSOCKET 1
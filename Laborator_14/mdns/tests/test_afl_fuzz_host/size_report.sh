@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+#
+# Builds mdns.c and mdns_console.c once per feature configuration and prints
+# the sizes of both objects together, to see how much each of the optional
+# features costs.
+#
+# The sources are compiled with the host mocks used by the fuzzer, so IDF_PATH
+# has to be set, the same as for `make INSTR=off`. Pass CC (and SIZE) to get
+# numbers for the target, e.g.
+#     CC=xtensa-esp32-elf-gcc SIZE=xtensa-esp32-elf-size ./size_report.sh
+#
+set -e
+
+cd "$(dirname "$0")"
+
+CC=${CC:-gcc}
+SIZE=${SIZE:-size}
+OUT=build/size
+
+# name:options disabled in sdkconfig.h (comma separated)
+CONFIGS="
+full:
+no_querier:CONFIG_MDNS_ENABLE_QUERIER
+no_delegation:CONFIG_MDNS_ENABLE_DELEGATION
+no_subtypes:CONFIG_MDNS_ENABLE_SUBTYPES
+single_instance:CONFIG_MDNS_MULTIPLE_INSTANCE
+responder_only:CONFIG_MDNS_ENABLE_QUERIER,CONFIG_MDNS_ENABLE_DELEGATION,CONFIG_MDNS_ENABLE_SUBTYPES,CONFIG_MDNS_MULTIPLE_INSTANCE
+"
+
+printf "%-16s %8s %8s %8s %8s %8s\n" "config" "text" "data" "bss" "total" "diff"
+full_total=
+for entry in $CONFIGS; do
+    name=${entry%%:*}
+    options=${entry#*:}
+    mkdir -p $OUT/$name
+    cp sdkconfig.h $OUT/$name/sdkconfig.h
+    for option in ${options//,/ }; do
+        sed -i "/^#define $option /d" $OUT/$name/sdkconfig.h
+    done
+    make -s -B CC="$CC" INSTR=off MDNS_SIZE_REPORT=on SDKCONFIG_DIR=$OUT/$name MDNS_C_DEPENDENCY_INJECTION= mdns.o mdns_console.o > /dev/null
+    mv mdns.o mdns_console.o $OUT/$name/
+    read -r text data bss total _ <<< "$($SIZE -t $OUT/$name/mdns.o $OUT/$name/mdns_console.o | tail -n 1)"
+    full_total=${full_total:-$total}
+    printf "%-16s %8d %8d %8d %8d %8d\n" $name $text $data $bss $total $((total - full_total))
+done
@@ -1,7 +1,16 @@
-from flask import Flask, request, jsonify
+from flask import Flask, request, jsonify, make_response
+import argparse
 import os
+import re
+import threading
+import time
 import requests
 import json
+import cbor_codec
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor, wait
+from requests.adapters import HTTPAdapter
+from urllib.parse import quote, urlsplit
 
 app = Flask(__name__)
 
@@ -10,11 +19,190 @@ os.makedirs(SENSOR_FOLDER, exist_ok=True)
 
 ESP32_IP = 'http://192.168.1.196:8000'
 
+DEVICE_MAX_CONCURRENCY = 3   # requests in flight to each ESP32, its httpd has only a few sockets
+RESPONSE_TTL = 1.0           # seconds a GET result is shared between clients
+UPSTREAM_TIMEOUT = 5
+CACHE_MAX_ENTRIES = 256      # per cache, clients choose the ?ids= so the URLs are not a fixed set
+
+SERVICE_TYPE = '_sensor._tcp.local.'   # advertised by the firmware and esp32_sim.py
+FLEET_MAX_DEVICES = 64
+FLEET_TIMEOUT = 2.0          # per device, a slow board is reported as such instead of holding up the rest
+
+UPSTREAM_ACCEPT = f'{cbor_codec.CONTENT_TYPE}, application/json;q=0.5'   # smaller bodies from the boards
+
+# Keep-alive connections to the ESP32s, reused instead of one TCP connection per request
+session = requests.Session()
+session.mount('http://', HTTPAdapter(pool_connections=FLEET_MAX_DEVICES, pool_maxsize=DEVICE_MAX_CONCURRENCY))
+device_slots = {}
+device_slots_lock = threading.Lock()
+
+def device_request(method, url, timeout=UPSTREAM_TIMEOUT, **kwargs):
+    with device_slots_lock:
+        slots = device_slots.setdefault(urlsplit(url).netloc, threading.BoundedSemaphore(DEVICE_MAX_CONCURRENCY))
+    with slots:
+        return session.request(method, url, timeout=timeout, **kwargs)
+
+def decode_body(response):
+    if response.headers.get('Content-Type', '').startswith(cbor_codec.CONTENT_TYPE):
+        return cbor_codec.loads(response.content)
+    return response.json()
+
+class LruCache:
+    """At most max_entries values, the least recently used ones make room for new ones.
+    With expired given, a value for which it returns True is dropped instead of returned."""
+    def __init__(self, max_entries, expired=None):
+        self.max_entries = max_entries
+        self.expired = expired
+        self.entries = OrderedDict()
+        self.lock = threading.Lock()
+
+    def get(self, key):
+        with self.lock:
+            value = self.entries.get(key)
+            if value is None:
+                return None
+            if self.expired and self.expired(value):
+                del self.entries[key]
+                return None
+            self.entries.move_to_end(key)
+            return value
+
+    def put(self, key, value):
+        with self.lock:
+            self.entries[key] = value
+            self.entries.move_to_end(key)
+            while self.expired and self.entries:
+                oldest = next(iter(self.entries.values()))
+                if not self.expired(oldest):
+                    break
+                self.entries.popitem(last=False)
+            while len(self.entries) > self.max_entries:
+                self.entries.popitem(last=False)
+
+    def pop(self, key):
+        with self.lock:
+            self.entries.pop(key, None)
+
+def ids_query(ids):
+    """?ids= for an upstream URL, sorted and without duplicates so that the same set of
+    sensors is a single cache entry however the client lists them."""
+    ids = {i.strip() for i in (ids or '').split(',')} - {''}
+    if not ids:
+        return ''
+    ordered = sorted(ids, key=lambda i: (not i.isdigit(), int(i) if i.isdigit() else 0, i))
+    return f'?ids={quote(",".join(ordered), safe=",")}'
+
+# Last 200 response per upstream URL, revalidated with If-None-Match
+upstream_cache = LruCache(CACHE_MAX_ENTRIES)
+
+def revalidate(url, timeout=UPSTREAM_TIMEOUT):
+    """GET through the ESP32's ETags, an unchanged resource costs the ESP32 a 304."""
+    headers = {'Accept': UPSTREAM_ACCEPT}
+    cached = upstream_cache.get(url)
+    if cached:
+        headers['If-None-Match'] = cached['etag']
+
+    response = device_request('GET', url, timeout=timeout, headers=headers)
+    if response.status_code == 304 and cached:
+        body, status, etag = cached['body'], 200, cached['etag']
+    else:
+        body, status, etag = decode_body(response), response.status_code, response.headers.get('ETag')
+        if status == 200 and etag:
+            upstream_cache.put(url, {'etag': etag, 'body': body})
+        else:
+            upstream_cache.pop(url)
+    return {'status': status, 'body': body, 'etag': etag,
+            'cache_control': response.headers.get('Cache-Control')}
+
+class InFlight:
+    def __init__(self):
+        self.done = threading.Event()
+        self.result = None
+        self.error = None
+
+# Results shared for RESPONSE_TTL and GETs in progress, both by upstream URL
+fresh_results = LruCache(CACHE_MAX_ENTRIES, expired=lambda fresh: fresh[0] <= time.monotonic())
+in_flight = {}
+shared_lock = threading.Lock()
+
+def result_ttl(result):
+    if result['status'] != 200:
+        return 0
+    match = re.search(r'max-age=(\d+)', result['cache_control'] or '')
+    return max(RESPONSE_TTL, int(match.group(1))) if match else RESPONSE_TTL
+
+def shared_get(url, timeout=UPSTREAM_TIMEOUT):
+    """Concurrent GETs of the same URL wait for a single upstream request, and its
+    result answers the following ones for a short while."""
+    with shared_lock:
+        fresh = fresh_results.get(url)
+        if fresh:
+            return fresh[1]
+        call = in_flight.get(url)
+        leader = call is None
+        if leader:
+            call = in_flight[url] = InFlight()
+
+    if not leader:
+        call.done.wait()
+        if call.error:
+            raise call.error
+        return call.result
+
+    try:
+        call.result = revalidate(url, timeout)
+        ttl = result_ttl(call.result)
+        with shared_lock:
+            if ttl:
+                fresh_results.put(url, (time.monotonic() + ttl, call.result))
+            else:
+                fresh_results.pop(url)
+    except Exception as e:
+        # whatever failed, e.g. an undecodable body, the waiting requests raise it too
+        call.error = e
+        raise
+    finally:
+        with shared_lock:
+            del in_flight[url]
+        call.done.set()
+    return call.result
+
+def conditional_get(url):
+    """Proxies a GET in the format the client accepts, whichever one the board sent,
+    answering with a 304 if the client has the current version."""
+    result = shared_get(url)
+    status, etag = result['status'], result['etag']
+    cbor = cbor_codec.accepted(request.headers.get('Accept'))
+    if etag:
+        # one tag per representation, the JSON and the CBOR of a version are different bytes
+        etag = f'{etag[:-1]}-{"cbor" if cbor else "json"}"'
+    if status == 200 and etag and etag in request.headers.get('If-None-Match', ''):
+        response = make_response('', 304)
+    elif cbor:
+        response = make_response(cbor_codec.dumps(result['body']), status)
+        response.headers['Content-Type'] = cbor_codec.CONTENT_TYPE
+    else:
+        response = make_response(jsonify(result['body']), status)
+    if etag and status == 200:
+        response.headers['ETag'] = etag
+    if result['cache_control']:
+        response.headers['Cache-Control'] = result['cache_control']
+    response.headers['Vary'] = 'Accept'
+    return response
+
 @app.route('/sensor/<sensor_id>', methods=['GET'])
 def get_sensor_value(sensor_id):
     try:
-        response = requests.get(f'{ESP32_IP}/sensor/{sensor_id}')
-        return jsonify(response.json()), response.status_code
+        return conditional_get(f'{ESP32_IP}/sensor/{sensor_id}')
+    except requests.exceptions.RequestException as e:
+        return jsonify({"error": f"ESP32 request failed: {str(e)}"}), 500
+
+@app.route('/sensors', methods=['GET'])
+def get_sensor_values():
+    # one upstream request for all the sensors instead of one per id
+    url = f'{ESP32_IP}/sensors{ids_query(request.args.get("ids"))}'
+    try:
+        return conditional_get(url)
     except requests.exceptions.RequestException as e:
         return jsonify({"error": f"ESP32 request failed: {str(e)}"}), 500
 
@@ -29,7 +217,7 @@ def create_config(sensor_id):
         json.dump({"sensor_id": sensor_id, "config": body_content}, f, indent=2)
 
     try:
-        response = requests.post(f'{ESP32_IP}/sensor/{sensor_id}', json=body_content)
+        response = device_request('POST', f'{ESP32_IP}/sensor/{sensor_id}', json=body_content)
         return jsonify(response.json()), response.status_code
     except requests.exceptions.RequestException as e:
         return jsonify({"error": f"ESP32 POST failed: {str(e)}"}), 500
@@ -45,10 +233,104 @@ def update_config(sensor_id, config_file):
         json.dump({"sensor_id": sensor_id, "updated_config": body_content}, f, indent=2)
 
     try:
-        response = requests.put(f'{ESP32_IP}/sensor/{sensor_id}/{config_file}', json=body_content)
+        response = device_request('PUT', f'{ESP32_IP}/sensor/{sensor_id}/{config_file}', json=body_content)
         return jsonify(response.json()), response.status_code
     except requests.exceptions.RequestException as e:
         return jsonify({"error": f"ESP32 PUT failed: {str(e)}"}), 500
 
+class DeviceTable:
+    """The boards the fleet routes fan out to, by name, kept up to date by mDNS."""
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.devices = {}
+
+    def add(self, name, url, sensors=None):
+        with self.lock:
+            if name not in self.devices and len(self.devices) >= FLEET_MAX_DEVICES:
+                return
+            self.devices[name] = {'name': name, 'url': url, 'sensors': sensors, 'last_seen': time.time()}
+
+    def remove(self, name):
+        with self.lock:
+            self.devices.pop(name, None)
+
+    def snapshot(self):
+        with self.lock:
+            return [dict(device) for device in self.devices.values()]
+
+device_table = DeviceTable()
+fleet_pool = ThreadPoolExecutor(max_workers=FLEET_MAX_DEVICES)
+
+class DiscoveryListener:
+    """zeroconf ServiceBrowser callbacks, a board joins the table when it is resolved."""
+    def add_service(self, zc, type_, name):
+        info = zc.get_service_info(type_, name, timeout=3000)
+        addresses = info.parsed_addresses() if info else []
+        if not addresses:
+            return
+        props = {k.decode(): (v or b'').decode() for k, v in info.properties.items()}
+        sensors = props.get('sensors')
+        device_table.add(name.split('.')[0], f'http://{addresses[0]}:{info.port}',
+                         sensors.split(',') if sensors else None)
+
+    def update_service(self, zc, type_, name):
+        self.add_service(zc, type_, name)
+
+    def remove_service(self, zc, type_, name):
+        device_table.remove(name.split('.')[0])
+
+def start_discovery():
+    from zeroconf import Zeroconf, ServiceBrowser
+    zc = Zeroconf()
+    return zc, ServiceBrowser(zc, SERVICE_TYPE, DiscoveryListener())
+
+def device_sensors(device, ids):
+    url = f"{device['url']}/sensors{ids_query(ids)}"
+    result = shared_get(url, timeout=FLEET_TIMEOUT)
+    if result['status'] != 200:
+        raise RuntimeError(f"HTTP {result['status']}")
+    return result['body'].get('sensors', [])
+
+@app.route('/fleet/devices', methods=['GET'])
+def get_fleet_devices():
+    return jsonify({'devices': device_table.snapshot()})
+
+@app.route('/fleet/sensors', methods=['GET'])
+def get_fleet_sensors():
+    # all the boards at once, each within FLEET_TIMEOUT; the ones that fail or time out are listed with an error
+    ids = request.args.get('ids')
+    devices = device_table.snapshot()
+    start = time.monotonic()
+    futures = {fleet_pool.submit(device_sensors, device, ids): device for device in devices}
+    wait(futures, timeout=FLEET_TIMEOUT)
+
+    results = []
+    for future, device in futures.items():
+        entry = {'device': device['name'], 'url': device['url']}
+        if not future.done():
+            entry['error'] = 'timeout'
+        elif future.exception():
+            entry['error'] = str(future.exception())
+        else:
+            entry['sensors'] = future.result()
+        results.append(entry)
+    return jsonify({'devices': results,
+                    'complete': all('sensors' in entry for entry in results),
+                    'elapsed_ms': round((time.monotonic() - start) * 1000)})
+
 if __name__ == '__main__':
-    app.run(host='0.0.0.0', port=5000)
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--fleet', action='store_true', help=f'discover the boards advertising {SERVICE_TYPE}')
+    parser.add_argument('--device', action='append', default=[], metavar='URL',
+                        help='a board for the fleet routes, in addition to the discovered ones')
+    args = parser.parse_args()
+
+    for url in args.device:
+        device_table.add(urlsplit(url).netloc, url.rstrip('/'))
+    if args.fleet:
+        discovery = start_discovery()
+    elif not args.device:
+        device_table.add('esp32', ESP32_IP)   # the /fleet routes cover the single board as well
+
+    # requests to each ESP32 are bounded by device_slots, not by serving clients one at a time
+    app.run(host='0.0.0.0', port=5000, threaded=True)
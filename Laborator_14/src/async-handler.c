@@ -0,0 +1,261 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+
+#include "async-handler.h"
+
+#define ASYNC_HEAD_MAX          160
+#define ASYNC_WRITE_PARTS       4       // head, chunk size, data, CRLF
+
+static const char *TAG = "ASYNC_HANDLER";
+
+typedef struct {
+    async_job_fn_t fn;
+    httpd_handle_t server;
+    int fd;
+    void *tag;
+    const char *type;
+    const char *vary;
+    _Alignas(max_align_t) uint8_t arg[ASYNC_JOB_ARG_MAX];
+} async_job_t;
+
+/*
+ * Bytes for the httpd task to send. The worker stops waiting after ASYNC_WRITE_TIMEOUT_MS,
+ * so the write is shared with the queued work and freed by whichever lets go last.
+ */
+typedef struct {
+    atomic_int refs;
+    atomic_bool done;
+    httpd_handle_t server;
+    int fd;
+    void *tag;
+    TaskHandle_t worker;
+    esp_err_t err;
+    size_t len;
+    char data[];                // copied, the worker's buffers are gone once it stops waiting
+} async_write_t;
+
+static QueueHandle_t s_queue = NULL;
+static uint32_t s_tag = 0;      // last session tag, only the httpd task submits
+
+/* The tag is a number, not memory */
+static void tag_free(void *ctx) {
+}
+
+static bool socket_send_all(httpd_handle_t server, int fd, const char *buf, size_t len) {
+    while (len) {
+        // a timeout means the socket took no data for send_wait_timeout, a client that stopped reading
+        int ret = httpd_socket_send(server, fd, buf, len, 0);
+        if (ret <= 0) {
+            return false;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+static void write_release(async_write_t *write) {
+    if (atomic_fetch_sub(&write->refs, 1) == 1) {
+        free(write);
+    }
+}
+
+static void write_work(void *arg) {
+    async_write_t *write = (async_write_t *)arg;
+    write->err = ESP_OK;
+    // the client may have closed the connection while the job ran, and the fd may be another client's by now
+    if (httpd_sess_get_ctx(write->server, write->fd) != write->tag) {
+        write->err = ESP_ERR_INVALID_STATE;
+    } else if (!socket_send_all(write->server, write->fd, write->data, write->len)) {
+        write->err = ESP_ERR_HTTPD_RESP_SEND;
+    }
+    atomic_store(&write->done, true);
+    xTaskNotifyGive(write->worker);
+    write_release(write);
+}
+
+/* Sockets belong to the httpd task, so the worker's writes run there as queued work */
+static esp_err_t resp_write(async_resp_t *resp, const char *parts[], const size_t lens[]) {
+    size_t len = 0;
+    for (int i = 0; i < ASYNC_WRITE_PARTS; i++) {
+        len += lens[i];
+    }
+    async_write_t *write = malloc(sizeof(async_write_t) + len);
+    if (!write) {
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_init(&write->refs, 2);
+    atomic_init(&write->done, false);
+    write->server = resp->server;
+    write->fd = resp->fd;
+    write->tag = resp->tag;
+    write->worker = xTaskGetCurrentTaskHandle();
+    write->len = 0;
+    for (int i = 0; i < ASYNC_WRITE_PARTS; i++) {
+        if (lens[i]) {
+            memcpy(write->data + write->len, parts[i], lens[i]);
+            write->len += lens[i];
+        }
+    }
+    if (httpd_queue_work(resp->server, write_work, write) != ESP_OK) {
+        free(write);
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+
+    // a notification may be left over from a write given up on before, the done flag tells them apart
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(ASYNC_WRITE_TIMEOUT_MS);
+    for (TickType_t waited = 0; waited < timeout; waited = xTaskGetTickCount() - start) {
+        ulTaskNotifyTake(pdTRUE, timeout - waited);
+        if (atomic_load(&write->done)) {
+            err = write->err;
+            break;
+        }
+    }
+    write_release(write);
+    return err;
+}
+
+static void close_work(void *arg) {
+    async_resp_t *resp = (async_resp_t *)arg;
+    if (httpd_sess_get_ctx(resp->server, resp->fd) == resp->tag) {
+        httpd_sess_trigger_close(resp->server, resp->fd);
+    }
+    free(resp);
+}
+
+/* What the server does when a handler fails on its own task, the client sees the response cut short */
+static void resp_close(const async_resp_t *resp) {
+    async_resp_t *copy = malloc(sizeof(async_resp_t));
+    if (!copy) {
+        return;
+    }
+    *copy = *resp;
+    if (httpd_queue_work(resp->server, close_work, copy) != ESP_OK) {
+        free(copy);
+    }
+}
+
+static int resp_head(async_resp_t *resp, char *head, const char *length_header) {
+    int len = snprintf(head, ASYNC_HEAD_MAX, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n%s%s%s%s\r\n",
+                       resp->type, resp->vary ? "Vary: " : "", resp->vary ? resp->vary : "",
+                       resp->vary ? "\r\n" : "", length_header);
+    resp->head_sent = true;
+    return len < ASYNC_HEAD_MAX ? len : -1;
+}
+
+static esp_err_t resp_send(resp_sink_t *sink, const char *buf, size_t len) {
+    async_resp_t *resp = (async_resp_t *)sink;
+    if (resp->head_sent) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    char length[32];
+    snprintf(length, sizeof(length), "Content-Length: %u\r\n", (unsigned)len);
+    char head[ASYNC_HEAD_MAX];
+    int head_len = resp_head(resp, head, length);
+    if (head_len < 0) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    const char *parts[ASYNC_WRITE_PARTS] = { head, buf };
+    const size_t lens[ASYNC_WRITE_PARTS] = { head_len, len };
+    return resp_write(resp, parts, lens);
+}
+
+static esp_err_t resp_send_chunk(resp_sink_t *sink, const char *buf, size_t len) {
+    async_resp_t *resp = (async_resp_t *)sink;
+    char head[ASYNC_HEAD_MAX];
+    int head_len = 0;
+    if (!resp->head_sent) {
+        head_len = resp_head(resp, head, "Transfer-Encoding: chunked\r\n");
+        if (head_len < 0) {
+            return ESP_ERR_HTTPD_RESP_HDR;
+        }
+    }
+    char size[16];
+    int size_len = snprintf(size, sizeof(size), "%x\r\n", (unsigned)len);
+    const char *parts[ASYNC_WRITE_PARTS] = { head, size, buf, "\r\n" };
+    const size_t lens[ASYNC_WRITE_PARTS] = { head_len, size_len, len, 2 };
+    return resp_write(resp, parts, lens);
+}
+
+static void async_worker_task(void *arg) {
+    async_job_t job;
+    for (;;) {
+        if (xQueueReceive(s_queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        async_resp_t resp = {
+            .sink = { .send = resp_send, .send_chunk = resp_send_chunk },
+            .server = job.server,
+            .fd = job.fd,
+            .tag = job.tag,
+            .type = job.type,
+            .vary = job.vary,
+        };
+        if (job.fn(&resp, job.arg) != ESP_OK) {
+            resp_close(&resp);
+        }
+    }
+}
+
+esp_err_t async_handler_start(void) {
+    if (s_queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_queue = xQueueCreate(ASYNC_QUEUE_LEN, sizeof(async_job_t));
+    if (!s_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < ASYNC_WORKER_COUNT; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "async_%u", (unsigned char)i);
+        if (xTaskCreatePinnedToCore(async_worker_task, name, ASYNC_WORKER_STACK_SIZE, NULL,
+                                    ASYNC_WORKER_PRIORITY, NULL, i % portNUM_PROCESSORS) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t async_handler_submit(httpd_req_t *req, const char *type, const char *vary,
+                               async_job_fn_t job, const void *arg, size_t arg_len) {
+    if (arg_len > ASYNC_JOB_ARG_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // only the httpd task submits, so a free slot seen here is still free below
+    if (!s_queue || uxQueueSpacesAvailable(s_queue) == 0) {
+        ESP_LOGW(TAG, "Workers busy, rejecting %s", req->uri);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_sendstr(req, "{\"error\": \"Server busy, retry later.\"}");
+        return ESP_OK;
+    }
+
+    // tags the session, a client that reconnects on the same fd gets a new one and none of the old writes
+    if (++s_tag == 0) {
+        s_tag = 1;
+    }
+    req->sess_ctx = (void *)(uintptr_t)s_tag;
+    req->free_ctx = tag_free;
+
+    async_job_t item = {
+        .fn = job,
+        .server = req->handle,
+        .fd = httpd_req_to_sockfd(req),
+        .tag = req->sess_ctx,
+        .type = type,
+        .vary = vary,
+    };
+    memcpy(item.arg, arg, arg_len);
+    xQueueSend(s_queue, &item, 0);
+    return ESP_OK;
+}
@@ -0,0 +1,51 @@
+#ifndef _ASYNC_HANDLER_H_
+#define _ASYNC_HANDLER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include "resp-writer.h"
+
+#define ASYNC_WORKER_COUNT      2       // one pinned to each core
+#define ASYNC_WORKER_STACK_SIZE 6144    // the jobs keep a response buffer on the stack
+#define ASYNC_WORKER_PRIORITY   5       // same as the httpd task
+#define ASYNC_QUEUE_LEN         7       // max_open_sockets of the server, a socket has one request at a time
+#define ASYNC_JOB_ARG_MAX       96      // bytes of handler state copied to the worker
+#define ASYNC_WRITE_TIMEOUT_MS  10000   // a write waits for the httpd task, then up to send_wait_timeout for the socket
+
+/* Response of a job, written to the client's socket by the httpd task on the worker's behalf */
+typedef struct {
+    resp_sink_t sink;       // for resp_writer_init_sink() and json_writer_init_sink()
+    httpd_handle_t server;
+    int fd;
+    void *tag;              // the session context set when the job was queued
+    const char *type;       // Content-Type, the status is 200 OK
+    const char *vary;       // NULL for no Vary header
+    bool head_sent;
+} async_resp_t;
+
+/* Runs on a worker and writes the whole response, arg is the worker's copy of the handler's state */
+typedef esp_err_t (*async_job_fn_t)(async_resp_t *resp, void *arg);
+
+/* Starts the worker tasks, call before the server takes requests */
+esp_err_t async_handler_start(void);
+
+/*
+ * Called from a route handler on the httpd task once it has checked the request and
+ * answered what it rejects: hands job to a worker, which sends a 200 response of the
+ * given type, and returns at once so the server goes on with the other sockets. The
+ * arg_len bytes at arg are copied, type and vary must stay valid (string literals).
+ *
+ * Only needs the ESP-IDF v5.0 API, httpd_queue_work() and httpd_socket_send(): the
+ * request ends when the handler returns, so the job cannot read its headers or body,
+ * and the server keeps reading the socket. Clients wait for the response before their
+ * next request on the connection, as HTTP/1.1 clients without pipelining do. With all
+ * workers busy and the queue full the client gets a 503. The session context of the
+ * socket is taken over to tell the client apart from a later one on the same fd.
+ */
+esp_err_t async_handler_submit(httpd_req_t *req, const char *type, const char *vary,
+                               async_job_fn_t job, const void *arg, size_t arg_len);
+
+#endif
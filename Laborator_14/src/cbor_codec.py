@@ -0,0 +1,182 @@
+"""The CBOR (RFC 8949) subset the firmware writes with json-writer.c, and back.
+
+loads() takes the indefinite length maps and arrays, half/single/double floats and
+the tag 262 embedded JSON of the firmware. Half and single precision values are
+returned as the shortest decimal that gives the same float, 27.97 and not
+27.969999313354492, like the JSON the firmware sends.
+"""
+import json
+import math
+import struct
+
+CONTENT_TYPE = 'application/cbor'
+TAG_EMBEDDED_JSON = 262
+BREAK = object()
+
+def accepted(accept):
+    """True if an Accept header lists CBOR without q=0, like json_format_negotiate() on the board."""
+    for media_range in (accept or '').split(','):
+        media_type, *params = [part.strip() for part in media_range.split(';')]
+        if media_type == CONTENT_TYPE:
+            q = next((p[2:] for p in params if p.startswith('q=')), '1')
+            try:
+                return float(q) > 0
+            except ValueError:
+                return True
+    return False
+
+def _shortest(value, fmt):
+    packed = struct.pack(fmt, value)
+    for digits in range(1, 18):
+        candidate = float(f'{value:.{digits}g}')
+        if struct.pack(fmt, candidate) == packed:
+            return candidate
+    return value
+
+class _Decoder:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise ValueError('truncated CBOR')
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+    def argument(self, info):
+        if info < 24:
+            return info
+        if info == 31:
+            return None     # indefinite length
+        if info > 27:
+            raise ValueError(f'bad CBOR additional info {info}')
+        return int.from_bytes(self.take(1 << (info - 24)), 'big')
+
+    def until_break(self):
+        while True:
+            item = self.item()
+            if item is BREAK:
+                return
+            yield item
+
+    def string(self, major, length):
+        if length is not None:
+            return self.take(length)
+        parts = []
+        for chunk in self.until_break():
+            parts.append(chunk.encode() if major == 3 else chunk)
+        return b''.join(parts)
+
+    def item(self):
+        initial = self.take(1)[0]
+        major, info = initial >> 5, initial & 0x1F
+        if major == 7:
+            if info == 20:
+                return False
+            if info == 21:
+                return True
+            if info in (22, 23):
+                return None
+            if info == 25:
+                return _shortest(struct.unpack('>e', self.take(2))[0], '>e')
+            if info == 26:
+                return _shortest(struct.unpack('>f', self.take(4))[0], '>f')
+            if info == 27:
+                return struct.unpack('>d', self.take(8))[0]
+            if info == 31:
+                return BREAK
+            raise ValueError(f'unsupported CBOR simple value {info}')
+
+        length = self.argument(info)
+        if major == 0:
+            return length
+        if major == 1:
+            return -1 - length
+        if major == 2:
+            return self.string(major, length)
+        if major == 3:
+            return self.string(major, length).decode()
+        if major == 4:
+            if length is None:
+                return list(self.until_break())
+            return [self.item() for _ in range(length)]
+        if major == 5:
+            result = {}
+            if length is None:
+                for key in self.until_break():
+                    result[key] = self.item()
+            else:
+                for _ in range(length):
+                    key = self.item()
+                    result[key] = self.item()
+            return result
+        # major 6, a tag
+        value = self.item()
+        if length == TAG_EMBEDDED_JSON:
+            return json.loads(value)
+        return value
+
+def loads(data):
+    decoder = _Decoder(bytes(data))
+    value = decoder.item()
+    if value is BREAK or decoder.pos != len(decoder.data):
+        raise ValueError('malformed CBOR')
+    return value
+
+def _head(major, value):
+    if value < 24:
+        return bytes([major << 5 | value])
+    for info, size in ((24, 1), (25, 2), (26, 4), (27, 8)):
+        if value < 1 << (8 * size):
+            return bytes([major << 5 | info]) + value.to_bytes(size, 'big')
+    raise ValueError('integer too large for CBOR')
+
+def _float(value):
+    if not math.isfinite(value):
+        return b'\xf6'      # null, like the firmware's json_float()
+    for fmt, initial in (('>e', 0xf9), ('>f', 0xfa)):
+        try:
+            packed = struct.pack(fmt, value)
+        except OverflowError:
+            continue
+        if struct.unpack(fmt, packed)[0] == value:
+            return bytes([initial]) + packed
+    return b'\xfb' + struct.pack('>d', value)
+
+def _encode(value, out):
+    if value is None:
+        out.append(b'\xf6')
+    elif value is True:
+        out.append(b'\xf5')
+    elif value is False:
+        out.append(b'\xf4')
+    elif isinstance(value, int):
+        out.append(_head(0, value) if value >= 0 else _head(1, -1 - value))
+    elif isinstance(value, float):
+        out.append(_float(value))
+    elif isinstance(value, str):
+        encoded = value.encode()
+        out.append(_head(3, len(encoded)))
+        out.append(encoded)
+    elif isinstance(value, (bytes, bytearray)):
+        out.append(_head(2, len(value)))
+        out.append(bytes(value))
+    elif isinstance(value, (list, tuple)):
+        out.append(_head(4, len(value)))
+        for item in value:
+            _encode(item, out)
+    elif isinstance(value, dict):
+        out.append(_head(5, len(value)))
+        for key, item in value.items():
+            _encode(key, out)
+            _encode(item, out)
+    else:
+        raise TypeError(f'cannot encode {type(value).__name__} as CBOR')
+
+def dumps(value):
+    """Definite length CBOR, the whole document is at hand on this side."""
+    out = []
+    _encode(value, out)
+    return b''.join(out)
@@ -0,0 +1,128 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "esp_log.h"
+
+#include "sensor-registry.h"
+#include "config-store.h"
+
+static const char *TAG = "CONFIG_STORE";
+
+/*
+ * Blob saved under the sensor id, a header followed by the config bytes. Blobs of
+ * an unknown version are ignored instead of being misread.
+ */
+#define CONFIG_BLOB_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t flags;      // unused, 0
+    uint16_t len;
+} config_blob_header_t;
+
+typedef struct {
+    config_blob_header_t header;
+    char data[SENSOR_CONFIG_MAX_LEN];
+} config_blob_t;
+
+static nvs_handle_t s_nvs;
+static TaskHandle_t s_task = NULL;
+
+static void config_load(sensor_t *sensor) {
+    config_blob_t blob;
+    size_t size = sizeof(blob);
+    esp_err_t err = nvs_get_blob(s_nvs, sensor->id, &blob, &size);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return;
+    }
+    if (err != ESP_OK || size < sizeof(blob.header)) {
+        ESP_LOGW(TAG, "Cannot read the config of sensor %s: %s", sensor->id, esp_err_to_name(err));
+        return;
+    }
+    if (blob.header.version != CONFIG_BLOB_VERSION || blob.header.len != size - sizeof(blob.header)) {
+        ESP_LOGW(TAG, "Ignoring config of sensor %s, version %u", sensor->id, blob.header.version);
+        return;
+    }
+    err = sensor_config_restore(sensor, blob.data, blob.header.len);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot restore the config of sensor %s: %s", sensor->id, esp_err_to_name(err));
+    }
+}
+
+static esp_err_t config_save(sensor_t *sensor, const config_blob_t *blob) {
+    return nvs_set_blob(s_nvs, sensor->id, blob, sizeof(blob->header) + blob->header.len);
+}
+
+static void config_store_task(void *arg) {
+    config_blob_t blob = { .header = { .version = CONFIG_BLOB_VERSION } };
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // updates arriving while we wait are picked up by this same pass
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_STORE_DELAY_MS));
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        // sensors whose blob is set but not committed yet
+        uint8_t written_mask[(SENSOR_REGISTRY_MAX + 7) / 8] = { 0 };
+        size_t written = 0;
+        bool failed = false;
+        for (size_t i = 0; i < sensor_count(); i++) {
+            sensor_t *sensor = sensor_at(i);
+            size_t len;
+            if (!sensor_config_take_dirty(sensor, blob.data, &len)) {
+                continue;
+            }
+            blob.header.len = len;
+            esp_err_t err = config_save(sensor, &blob);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Saving the config of sensor %s failed: %s", sensor->id, esp_err_to_name(err));
+                sensor_config_mark_dirty(sensor);
+                failed = true;
+                continue;
+            }
+            written_mask[i / 8] |= 1 << (i % 8);
+            written++;
+        }
+        if (written) {
+            esp_err_t err = nvs_commit(s_nvs);
+            if (err == ESP_OK) {
+                ESP_LOGI(TAG, "Saved %u configs", (unsigned)written);
+            } else {
+                ESP_LOGE(TAG, "Commit failed: %s", esp_err_to_name(err));
+                for (size_t i = 0; i < sensor_count(); i++) {
+                    if (written_mask[i / 8] & (1 << (i % 8))) {
+                        sensor_config_mark_dirty(sensor_at(i));
+                    }
+                }
+                failed = true;
+            }
+        }
+        if (failed) {
+            xTaskNotifyGive(s_task);    // the next pass, CONFIG_STORE_DELAY_MS from now, retries
+        }
+    }
+}
+
+esp_err_t config_store_init(void) {
+    if (s_task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = nvs_open(CONFIG_STORE_NAMESPACE, NVS_READWRITE, &s_nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (size_t i = 0; i < sensor_count(); i++) {
+        config_load(sensor_at(i));
+    }
+    if (xTaskCreate(config_store_task, "config_store", CONFIG_STORE_STACK_SIZE, NULL, CONFIG_STORE_PRIORITY, &s_task) != pdPASS) {
+        nvs_close(s_nvs);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void config_store_schedule(void) {
+    if (s_task) {
+        xTaskNotifyGive(s_task);
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef _CONFIG_STORE_H_
+#define _CONFIG_STORE_H_
+
+#include "esp_err.h"
+
+#define CONFIG_STORE_NAMESPACE      "sensor_cfg"
+#define CONFIG_STORE_DELAY_MS       2000    // changes within this window end up in one write
+#define CONFIG_STORE_STACK_SIZE     3072
+#define CONFIG_STORE_PRIORITY       2
+
+/*
+ * Loads the configs saved in NVS into the registered sensors and starts the task
+ * writing them back. Call after nvs_flash_init() and after all sensors are registered.
+ */
+esp_err_t config_store_init(void);
+
+/*
+ * Asks for the changed configs to be saved. The write happens CONFIG_STORE_DELAY_MS
+ * later, so a burst of updates costs a single flash write per sensor.
+ */
+void config_store_schedule(void);
+
+#endif
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_mac.h"
+#include "esp_log.h"
+#include "mdns.h"
+
+#include "sensor-registry.h"
+#include "device-advertise.h"
+
+static const char *TAG = "ADVERTISE";
+
+/* Comma separated ids of the registered sensors, cut at the last id which fits */
+static void sensor_id_list(char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (size_t i = 0; i < sensor_count(); i++) {
+        const char *id = sensor_at(i)->id;
+        size_t id_len = strlen(id);
+        if (len + (len ? 1 : 0) + id_len >= size) {
+            ESP_LOGW(TAG, "Sensor list truncated at %u of %u ids", (unsigned)i, (unsigned)sensor_count());
+            break;
+        }
+        if (len) {
+            buf[len++] = ',';
+        }
+        memcpy(buf + len, id, id_len + 1);
+        len += id_len;
+    }
+}
+
+esp_err_t device_advertise_start(uint16_t port) {
+    uint8_t mac[6];
+    char hostname[16];
+    esp_err_t err = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    if (err != ESP_OK) {
+        return err;
+    }
+    snprintf(hostname, sizeof(hostname), "sensor-%02x%02x%02x", mac[3], mac[4], mac[5]);
+
+    err = mdns_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = mdns_hostname_set(hostname);
+    if (err == ESP_OK) {
+        err = mdns_instance_name_set(hostname);
+    }
+    if (err != ESP_OK) {
+        mdns_free();
+        return err;
+    }
+
+    char ids[ADVERTISE_IDS_MAX_LEN + 1];    // copied by mdns_service_add
+    sensor_id_list(ids, sizeof(ids));
+    mdns_txt_item_t txt[] = {
+        { "api", ADVERTISE_API_VERSION },
+        { "sensors", ids },
+    };
+    err = mdns_service_add(NULL, ADVERTISE_SERVICE_TYPE, ADVERTISE_PROTO, port, txt, sizeof(txt) / sizeof(txt[0]));
+    if (err != ESP_OK) {
+        mdns_free();
+        return err;
+    }
+    ESP_LOGI(TAG, "Advertising %s.%s.%s.local on port %u", hostname, ADVERTISE_SERVICE_TYPE, ADVERTISE_PROTO, port);
+    return ESP_OK;
+}
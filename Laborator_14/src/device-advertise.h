@@ -0,0 +1,20 @@
+#ifndef _DEVICE_ADVERTISE_H_
+#define _DEVICE_ADVERTISE_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ADVERTISE_SERVICE_TYPE  "_sensor"
+#define ADVERTISE_PROTO         "_tcp"
+#define ADVERTISE_API_VERSION   "1"
+#define ADVERTISE_IDS_MAX_LEN   200     // a TXT value holds at most 255 bytes
+
+/*
+ * Announces the REST API over mDNS as "sensor-XXXXXX._sensor._tcp.local" on the
+ * given port, XXXXXX being the end of the station MAC. The TXT record carries the
+ * API version and the registered sensor ids, so the proxy can find every board on
+ * the network without a configured address. Call after the sensors are registered.
+ */
+esp_err_t device_advertise_start(uint16_t port);
+
+#endif
@@ -1,46 +1,421 @@
-from flask import Flask, request, jsonify
-import random
-import os
+"""Simulated ESP32 sensor boards, from one to hundreds in a single process.
+
+Each board is an asyncio HTTP/1.1 server with the firmware's API: GET /sensor/<id>,
+/sensors?ids=, /sensor/<id>/config and POST/PUT of the config, with the same ETags,
+Cache-Control and CBOR negotiation. Sensor values follow a mean reverting random
+walk sampled every second, like a real sensor instead of independent draws.
+
+    python esp32_sim.py                              # one board on port 8000, as before
+    python esp32_sim.py --devices 200 --base-port 9000 --stats-s 5
+    python esp32_sim.py --devices 50 --base-address 127.0.1.1 --base-port 80
+    python esp32_sim.py --devices 20 --latency-ms 40 --jitter-ms 20 --error-rate 0.02 --offline-rate 0.1
+
+With --base-address every board gets its own loopback address on the same port,
+like a LAN of boards on port 80 (Linux routes all of 127.0.0.0/8 to lo).
+"""
+import argparse
+import asyncio
+import ipaddress
 import json
+import math
+import random
+import resource
+import socket
+import time
+import zlib
+from urllib.parse import parse_qs, unquote, urlsplit
+
+import cbor_codec
+
+SERVICE_TYPE = '_sensor._tcp.local.'
+SENSOR_RANGES = [(20.0, 30.0), (50.0, 60.0), (0.0, 100.0), (900.0, 1100.0)]
+SAMPLE_PERIOD = 1.0         # seconds, SIM_SENSOR_PERIOD_MS of the firmware
+WALK_TAU = 30.0             # seconds for a deviation from the middle of the range to decay by 1/e
+MAX_HEAD = 8192            # request line and headers
+MAX_BODY = 2048             # SENSOR_CONFIG_MAX_LEN is smaller, a bigger body is refused like a 413
+
+STATUS_TEXT = {200: 'OK', 201: 'Created', 304: 'Not Modified', 400: 'Bad Request', 404: 'Not Found',
+               405: 'Method Not Allowed', 406: 'Not Acceptable', 409: 'Conflict', 413: 'Payload Too Large',
+               500: 'Internal Server Error', 503: 'Service Unavailable'}
+
+class Sensor:
+    """Mean reverting random walk in [low, high], advanced a sample period at a time when read."""
+    def __init__(self, sensor_id, low, high, rng):
+        self.id = sensor_id
+        self.low, self.high = low, high
+        self.mean = (low + high) / 2
+        self.sigma = (high - low) / 6
+        self.rng = rng
+        self.value = rng.uniform(low, high)
+        self.start = time.monotonic()
+        self.count = 1
+
+    def sample(self):
+        """(value, sample count, seconds until the next sample)"""
+        elapsed = time.monotonic() - self.start
+        due = int(elapsed / SAMPLE_PERIOD) + 1
+        steps = due - self.count
+        if steps > 0:
+            # exact for any number of steps, a board which was not read for an hour still moves the right amount
+            decay = math.exp(-steps * SAMPLE_PERIOD / WALK_TAU)
+            noise = self.sigma * math.sqrt(1 - decay * decay)
+            self.value = self.mean + (self.value - self.mean) * decay + self.rng.gauss(0, noise)
+            self.value = min(self.high, max(self.low, self.value))
+            self.count = due
+        return round(self.value, 2), self.count, due * SAMPLE_PERIOD - elapsed
+
+class Request:
+    def __init__(self, method, target, headers, body):
+        self.method = method
+        parts = urlsplit(target)
+        self.path = unquote(parts.path)
+        self.query = parse_qs(parts.query)
+        self.headers = headers
+        self.body = body
+
+class Response:
+    def __init__(self, status, body=None, headers=None):
+        self.status = status
+        self.body = body
+        self.headers = headers or {}
+
+def error(status, message):
+    return Response(status, {'error': message})
+
+class Device:
+    def __init__(self, name, host, port, sensor_count, options, rng):
+        self.name = name
+        self.host = host
+        self.port = port
+        self.options = options
+        self.rng = rng
+        self.boot_id = rng.getrandbits(32)
+        self.sensors = {}
+        for i in range(sensor_count):
+            low, high = SENSOR_RANGES[i % len(SENSOR_RANGES)]
+            self.sensors[str(i + 1)] = Sensor(str(i + 1), low, high, rng)
+        self.configs = {}   # id -> (version, config)
+        self.server = None
+        self.connections = set()
+        self.stats = {'requests': 0, 'errors': 0, 'dropped': 0, 'hung': 0}
+
+    def etag(self, kind, version, cbor):
+        # same layout as http_cache_etag(), uppercase kind for the CBOR representation
+        return f'"{self.boot_id:08x}-{kind.upper() if cbor else kind}{version}"'
+
+    # -- API
+
+    def route(self, req):
+        parts = [p for p in req.path.split('/') if p]
+        if req.method == 'GET' and parts == ['sensors']:
+            return self.get_sensors(req)
+        if len(parts) >= 2 and parts[0] == 'sensor':
+            sensor = self.sensors.get(parts[1])
+            if len(parts) == 2 and req.method == 'GET':
+                return self.get_sensor(req, sensor)
+            if len(parts) == 2 and req.method == 'POST':
+                return self.post_config(req, sensor)
+            if len(parts) == 3 and parts[2] == 'config' and req.method == 'GET':
+                return self.get_config(req, sensor)
+            if len(parts) == 3 and req.method == 'PUT':
+                # the firmware's route is /sensor/<id>/config, REST.py forwards /sensor/<id>/<file>
+                return self.put_config(req, sensor)
+        return error(404, 'Not found')
+
+    def cached(self, req, etag, cache_control, body, negotiated=True):
+        headers = {'ETag': etag, 'Cache-Control': cache_control}
+        if negotiated:
+            headers['Vary'] = 'Accept'
+        if etag in req.headers.get('if-none-match', '') or req.headers.get('if-none-match') == '*':
+            return Response(304, None, headers)
+        return Response(200, body, headers)
+
+    def get_sensor(self, req, sensor):
+        if not sensor:
+            return error(404, 'Sensor not found')
+        value, version, next_in = sensor.sample()
+        cbor = cbor_codec.accepted(req.headers.get('accept'))
+        max_age = int(next_in)
+        return self.cached(req, self.etag('s', version, cbor), f'max-age={max_age}' if max_age else 'no-cache',
+                           {'sensor_id': sensor.id, 'value': value})
+
+    def get_sensors(self, req):
+        ids = req.query.get('ids', [None])[0]
+        ids = [i for i in ids.split(',') if i] if ids else list(self.sensors)
+        sensors, versions = [], []
+        for sensor_id in ids:
+            sensor = self.sensors.get(sensor_id)
+            if sensor:
+                value, version, _ = sensor.sample()
+                sensors.append({'sensor_id': sensor_id, 'value': value})
+            else:
+                version = 0xFFFFFFFF
+                sensors.append({'sensor_id': sensor_id, 'error': 'Sensor not found'})
+            versions.append(version)
+        cbor = cbor_codec.accepted(req.headers.get('accept'))
+        version = zlib.crc32(json.dumps(versions).encode())
+        return self.cached(req, self.etag('b', version, cbor), 'no-cache', {'sensors': sensors})
+
+    def get_config(self, req, sensor):
+        if not sensor:
+            return error(404, 'Sensor not found')
+        if sensor.id not in self.configs:
+            return error(404, 'Sensor has no config')
+        version, config = self.configs[sensor.id]
+        return self.cached(req, self.etag('c', version, False), 'no-cache',
+                           {'sensor_id': sensor.id, 'config': config}, negotiated=False)
+
+    def read_config(self, req, default):
+        if not req.body:
+            return default, None
+        try:
+            return json.loads(req.body), None
+        except ValueError:
+            return None, error(400, 'Config is not valid JSON')
+
+    def post_config(self, req, sensor):
+        if not sensor:
+            return error(404, 'Unknown sensor')
+        if sensor.id in self.configs:
+            return error(409, 'Config file already exists for this sensor.')
+        config, failed = self.read_config(req, {})
+        if failed:
+            return failed
+        self.configs[sensor.id] = (1, config)
+        return Response(201, {'message': 'Config created (simulated)'})
+
+    def put_config(self, req, sensor):
+        if not sensor:
+            return error(404, 'Unknown sensor')
+        if sensor.id not in self.configs:
+            return error(406, 'Config file does not exist; cannot update.')
+        config, failed = self.read_config(req, {})
+        if failed:
+            return failed
+        self.configs[sensor.id] = (self.configs[sensor.id][0] + 1, config)
+        return Response(200, {'message': 'Config updated (simulated)', 'received': config})
+
+    # -- HTTP
+
+    async def serve(self, reader, writer):
+        task = asyncio.current_task()
+        self.connections.add(task)
+        try:
+            while True:
+                req = await read_request(reader)
+                if req is None:
+                    break
+                if isinstance(req, Response):
+                    await write_response(writer, req, None, False)
+                    break
+                keep_alive = req.headers.get('connection', '').lower() != 'close'
+                if not await self.handle(req, writer, keep_alive) or not keep_alive:
+                    break
+        except (ConnectionError, asyncio.IncompleteReadError, asyncio.CancelledError):
+            # CancelledError is stop() resetting the connection
+            pass
+        finally:
+            self.connections.discard(task)
+            writer.close()
+
+    async def handle(self, req, writer, keep_alive):
+        """Answers one request after the simulated delay and failures, False to drop the connection."""
+        options = self.options
+        self.stats['requests'] += 1
+        delay = max(0.0, self.rng.gauss(options.latency_ms, options.jitter_ms)) / 1000
+        if delay:
+            await asyncio.sleep(delay)
+
+        fault = self.rng.random()
+        if fault < options.drop_rate:
+            self.stats['dropped'] += 1
+            return False
+        fault -= options.drop_rate
+        if fault < options.hang_rate:
+            self.stats['hung'] += 1
+            await asyncio.sleep(options.hang_s)
+            return False
+        fault -= options.hang_rate
+        if fault < options.error_rate:
+            self.stats['errors'] += 1
+            response = error(500, 'Simulated failure')
+        else:
+            response = self.route(req)
+        cbor = response.status == 200 and response.headers.get('Vary') == 'Accept' and \
+            cbor_codec.accepted(req.headers.get('accept'))
+        await write_response(writer, response, req.method, keep_alive, cbor)
+        return True
+
+    async def start(self):
+        self.server = await asyncio.start_server(self.serve, self.host, self.port, limit=MAX_HEAD,
+                                                 reuse_address=True, backlog=16)
+
+    async def stop(self):
+        """Like a board losing power, open connections are reset and new ones refused."""
+        if self.server:
+            self.server.close()
+            for task in list(self.connections):
+                task.cancel()
+            await self.server.wait_closed()
+            self.server = None
+
+    async def flap(self):
+        # each minute a board goes offline with probability offline_rate, the boards roll at different moments
+        options = self.options
+        await asyncio.sleep(self.rng.uniform(0, 60))
+        while True:
+            if self.rng.random() < options.offline_rate:
+                await self.stop()
+                await asyncio.sleep(options.offline_s)
+                self.boot_id = self.rng.getrandbits(32)     # a reboot, the old ETags are no longer valid
+                await self.start()
+            await asyncio.sleep(60)
+
+async def read_request(reader):
+    """Request, None at the end of the connection or an error Response for a bad one."""
+    try:
+        head = await reader.readuntil(b'\r\n\r\n')
+    except asyncio.IncompleteReadError:
+        return None
+    except asyncio.LimitOverrunError:
+        return error(400, 'Request header too large')
+    lines = head.decode('latin-1').split('\r\n')
+    request_line = lines[0].split(' ')
+    if len(request_line) != 3:
+        return error(400, 'Bad request line')
+    headers = {}
+    for line in lines[1:]:
+        if ':' in line:
+            name, value = line.split(':', 1)
+            headers[name.strip().lower()] = value.strip()
+    try:
+        length = int(headers.get('content-length', '0') or 0)
+    except ValueError:
+        length = -1
+    if length < 0:
+        return error(400, 'Bad Content-Length')
+    if length > MAX_BODY:
+        return error(413, 'Config is too large.')
+    body = await reader.readexactly(length) if length else b''
+    return Request(request_line[0], request_line[1], headers, body)
+
+async def write_response(writer, response, method, keep_alive, cbor=False):
+    if response.body is None:
+        body, content_type = b'', None
+    elif cbor:
+        body, content_type = cbor_codec.dumps(response.body), cbor_codec.CONTENT_TYPE
+    else:
+        body, content_type = json.dumps(response.body).encode(), 'application/json'
+    head = [f'HTTP/1.1 {response.status} {STATUS_TEXT.get(response.status, "")}']
+    if content_type:
+        head.append(f'Content-Type: {content_type}')
+    head.append(f'Content-Length: {len(body)}')
+    head += [f'{name}: {value}' for name, value in response.headers.items()]
+    if not keep_alive:
+        head.append('Connection: close')
+    writer.write(('\r\n'.join(head) + '\r\n\r\n').encode() + (body if method != 'HEAD' else b''))
+    await writer.drain()
+
+def local_ip():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        s.connect(('10.255.255.255', 1))
+        return s.getsockname()[0]
+    except Exception:
+        return '127.0.0.1'
+    finally:
+        s.close()
+
+async def advertise(devices):
+    """Announces every board over mDNS like the firmware does, for REST.py --fleet."""
+    try:
+        from zeroconf import ServiceInfo
+        from zeroconf.asyncio import AsyncZeroconf
+    except ImportError:
+        print('[INFO] zeroconf is not installed, not advertising over mDNS')
+        return None
+    lan_ip = local_ip()
+    zc = AsyncZeroconf()
+    for device in devices:
+        address = lan_ip if device.host == '0.0.0.0' else device.host
+        info = ServiceInfo(SERVICE_TYPE, f'{device.name}.{SERVICE_TYPE}',
+                           addresses=[socket.inet_aton(address)], port=device.port,
+                           properties={'api': '1', 'sensors': ','.join(device.sensors)},
+                           server=f'{device.name}.local.')
+        await zc.async_register_service(info)
+    print(f'[INFO] advertised {len(devices)} boards as {SERVICE_TYPE}')
+    return zc
+
+async def report(devices, interval):
+    previous = 0
+    while True:
+        await asyncio.sleep(interval)
+        total = {key: sum(d.stats[key] for d in devices) for key in devices[0].stats}
+        online = sum(1 for d in devices if d.server)
+        print(f'[STATS] {(total["requests"] - previous) / interval:.0f} req/s, {online}/{len(devices)} online, '
+              f'{total["errors"]} errors, {total["dropped"]} dropped, {total["hung"]} hung')
+        previous = total['requests']
+
+def raise_fd_limit(needed):
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if soft != resource.RLIM_INFINITY and soft < needed:
+        target = needed if hard == resource.RLIM_INFINITY else min(needed, hard)
+        resource.setrlimit(resource.RLIMIT_NOFILE, (target, hard))
+
+async def main(options):
+    rng = random.Random(options.seed)
+    devices = []
+    for i in range(options.devices):
+        if options.base_address:
+            host, port = str(ipaddress.ip_address(options.base_address) + i), options.base_port
+        else:
+            host, port = options.host, options.base_port + i
+        name = f'sensor-sim{i:04d}' if options.devices > 1 else f'sensor-sim{port}'
+        devices.append(Device(name, host, port, options.sensors, options, random.Random(rng.getrandbits(64))))
+
+    # a listening socket per board plus its clients
+    raise_fd_limit(options.devices * 8 + 64)
+    await asyncio.gather(*(device.start() for device in devices))
+    first, last = devices[0], devices[-1]
+    print(f'[INFO] {len(devices)} boards on {first.host}:{first.port} .. {last.host}:{last.port}')
 
-app = Flask(__name__)
-
-SENSOR_FOLDER = './sensors'
-os.makedirs(SENSOR_FOLDER, exist_ok=True)
-
-@app.route('/sensor/<sensor_id>', methods=['GET'])
-def get_sensor(sensor_id):
-    if sensor_id not in ['1', '2']:
-        return jsonify({'error': 'Sensor not found'}), 404
-    if sensor_id == '1':
-        value = round(random.uniform(20.0, 30.0), 2)
-    elif sensor_id == '2':
-        value = round(random.uniform(50.0, 60.0), 2)
-    return jsonify({'sensor_id': sensor_id, 'value': value})
-
-@app.route('/sensor/<sensor_id>', methods=['POST'])
-def post_sensor(sensor_id):
-    config_path = os.path.join(SENSOR_FOLDER, f'sensor_{sensor_id}.json')
-    if os.path.exists(config_path):
-        return jsonify({'error': 'Config file already exists for this sensor.'}), 409
-    
-    body = request.get_json(force=True, silent=True) or {"default": "config"}
-    with open(config_path, 'w') as f:
-        json.dump({"sensor_id": sensor_id, "config": body}, f, indent=2)
-    
-    return jsonify({'message': 'Config created (simulated)'}), 201
-
-@app.route('/sensor/<sensor_id>/<config_file>', methods=['PUT'])
-def put_sensor(sensor_id, config_file):
-    config_path = os.path.join(SENSOR_FOLDER, config_file)
-    if not os.path.exists(config_path):
-        return jsonify({'error': 'Config file does not exist; cannot update.'}), 406
-    
-    body = request.get_json(force=True, silent=True) or {"updated": "config"}
-    with open(config_path, 'w') as f:
-        json.dump({"sensor_id": sensor_id, "updated_config": body}, f, indent=2)
-    
-    return jsonify({'message': 'Config updated (simulated)', 'received': body}), 200
+    tasks = []
+    if options.offline_rate > 0:
+        tasks += [asyncio.create_task(device.flap()) for device in devices]
+    if options.stats_s > 0:
+        tasks.append(asyncio.create_task(report(devices, options.stats_s)))
+    zc = await advertise(devices) if options.mdns else None
+    try:
+        await asyncio.Event().wait()
+    finally:
+        if zc:
+            await zc.async_unregister_all_services()
+            await zc.async_close()
 
 if __name__ == '__main__':
-    app.run(host='0.0.0.0', port=8000)
+    parser = argparse.ArgumentParser(description='Simulated ESP32 sensor boards')
+    parser.add_argument('--devices', type=int, default=1)
+    parser.add_argument('--sensors', type=int, default=2, help='sensors per board')
+    parser.add_argument('--port', '--base-port', dest='base_port', type=int, default=8000,
+                        help='port of the first board, the next ones count up from it')
+    parser.add_argument('--host', default='0.0.0.0', help='address the boards listen on')
+    parser.add_argument('--base-address', metavar='IP',
+                        help='an address per board counting up from IP, all on --base-port')
+    parser.add_argument('--latency-ms', type=float, default=0, help='mean response delay')
+    parser.add_argument('--jitter-ms', type=float, default=0, help='standard deviation of the delay')
+    parser.add_argument('--error-rate', type=float, default=0, help='fraction of requests answered with a 500')
+    parser.add_argument('--drop-rate', type=float, default=0, help='fraction of requests whose connection is closed')
+    parser.add_argument('--hang-rate', type=float, default=0, help='fraction of requests never answered')
+    parser.add_argument('--hang-s', type=float, default=30, help='how long a hung request holds its connection')
+    parser.add_argument('--offline-rate', type=float, default=0,
+                        help='chance per board and minute of going offline')
+    parser.add_argument('--offline-s', type=float, default=10, help='how long an offline board stays down')
+    parser.add_argument('--mdns', action=argparse.BooleanOptionalAction, default=True,
+                        help=f'advertise the boards as {SERVICE_TYPE} (needs zeroconf)')
+    parser.add_argument('--stats-s', type=float, default=0, help='print request rates every N seconds')
+    parser.add_argument('--seed', type=int, help='for repeatable values and failures')
+    options = parser.parse_args()
+    try:
+        asyncio.run(main(options))
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#include "http-cache.h"
+
+#define IF_NONE_MATCH_MAX_LEN   128
+#define NOT_MODIFIED_MAX_LEN    160
+
+static uint32_t s_boot_id = 0;
+
+void http_cache_etag(char *etag, char kind, uint32_t version) {
+    if (s_boot_id == 0) {
+        s_boot_id = esp_random() | 1;
+    }
+    snprintf(etag, HTTP_CACHE_ETAG_LEN, "\"%08lx-%c%lu\"", (unsigned long)s_boot_id, kind, (unsigned long)version);
+}
+
+bool http_cache_not_modified(httpd_req_t *req, const char *etag) {
+    char value[IF_NONE_MATCH_MAX_LEN];
+    size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+    if (len == 0 || len >= sizeof(value) ||
+            httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    // the tags are quoted, so a substring match cannot hit part of another tag
+    return strcmp(value, "*") == 0 || strstr(value, etag) != NULL;
+}
+
+void http_cache_set_headers(httpd_req_t *req, const char *etag, const char *cache_control) {
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", cache_control);
+}
+
+void http_cache_max_age(char *cache_control, int64_t expires_us) {
+    int64_t remaining_us = expires_us - esp_timer_get_time();
+    if (remaining_us <= 0) {
+        strcpy(cache_control, "no-cache");
+        return;
+    }
+    // rounded up, with a 1 s sample period rounding down would never allow caching
+    snprintf(cache_control, HTTP_CACHE_CONTROL_LEN, "max-age=%lld", (long long)((remaining_us + 999999) / 1000000));
+}
+
+esp_err_t http_cache_send_not_modified(httpd_req_t *req, const char *etag, const char *cache_control, const char *vary) {
+    char head[NOT_MODIFIED_MAX_LEN];
+    int len = snprintf(head, sizeof(head), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nCache-Control: %s\r\n%s%s%s\r\n",
+                       etag, cache_control, vary ? "Vary: " : "", vary ? vary : "", vary ? "\r\n" : "");
+    if (len < 0 || len >= (int)sizeof(head)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return httpd_send(req, head, len) == len ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,42 @@
+#ifndef _HTTP_CACHE_H_
+#define _HTTP_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define HTTP_CACHE_ETAG_LEN     24
+#define HTTP_CACHE_CONTROL_LEN  24
+
+/*
+ * ETag of version `version` of a resource of kind `kind` ('s' sample, 'c' config...).
+ * The tags include a random boot id, version counters restart at every boot and
+ * must not validate what a client cached before it.
+ */
+void http_cache_etag(char *etag, char kind, uint32_t version);
+
+/* True if the request's If-None-Match lists etag (or is "*") */
+bool http_cache_not_modified(httpd_req_t *req, const char *etag);
+
+/*
+ * Sets the ETag and Cache-Control headers. The header values are not copied by
+ * httpd, etag and cache_control must stay valid until the response is sent.
+ */
+void http_cache_set_headers(httpd_req_t *req, const char *etag, const char *cache_control);
+
+/*
+ * "max-age=N" for a resource which changes at expires_us (esp_timer time), N rounded up
+ * to whole seconds, "no-cache" if that is already due
+ */
+void http_cache_max_age(char *cache_control, int64_t expires_us);
+
+/*
+ * Sends a 304 with the validators of the response it stands for (vary may be NULL).
+ * httpd_resp_send() always adds Content-Type and Content-Length, which a 304 must
+ * not carry for a different representation, so the head is written to the socket.
+ */
+esp_err_t http_cache_send_not_modified(httpd_req_t *req, const char *etag, const char *cache_control, const char *vary);
+
+#endif
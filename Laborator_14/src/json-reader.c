@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json-reader.h"
+
+enum {
+    STATE_VALUE,        // a value is expected
+    STATE_FIRST_VALUE,  // after '[', a value or ']'
+    STATE_KEY,          // after ',' in an object
+    STATE_FIRST_KEY,    // after '{', a key or '}'
+    STATE_AFTER_VALUE,  // ',' or the end of the container
+    STATE_DONE,         // the top level value is complete
+    STATE_ERROR,
+};
+
+/* Next input byte without consuming it, -1 at the end of the input */
+static int reader_peek(json_reader_t *reader) {
+    if (reader->pos == reader->len) {
+        if (reader->eof) {
+            return -1;
+        }
+        int n = reader->read(reader->ctx, reader->buf, sizeof(reader->buf));
+        if (n <= 0) {
+            reader->eof = true;
+            if (n < 0) {
+                reader->state = STATE_ERROR;
+            }
+            return -1;
+        }
+        reader->pos = 0;
+        reader->len = n;
+    }
+    return (unsigned char)reader->buf[reader->pos];
+}
+
+/* Consumes the peeked byte, copying it to the capture buffer */
+static void reader_take(json_reader_t *reader) {
+    if (reader->capture) {
+        if (reader->capture_len < reader->capture_size) {
+            reader->capture[reader->capture_len++] = reader->buf[reader->pos];
+        } else {
+            reader->capture_overflow = true;
+        }
+    }
+    reader->pos++;
+}
+
+static int reader_skip_ws(json_reader_t *reader) {
+    for (;;) {
+        int c = reader_peek(reader);
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return c;
+        }
+        reader->pos++;
+    }
+}
+
+static void value_append(json_reader_t *reader, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (reader->value_len == JSON_READER_VALUE_MAX) {
+            reader->truncated = true;
+            return;
+        }
+        reader->value[reader->value_len++] = data[i];
+    }
+}
+
+static void value_append_utf8(json_reader_t *reader, uint32_t cp) {
+    char out[4];
+    size_t len;
+    if (cp < 0x80) {
+        out[0] = cp;
+        len = 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        len = 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        len = 3;
+    } else {
+        out[0] = 0xF0 | (cp >> 18);
+        out[1] = 0x80 | ((cp >> 12) & 0x3F);
+        out[2] = 0x80 | ((cp >> 6) & 0x3F);
+        out[3] = 0x80 | (cp & 0x3F);
+        len = 4;
+    }
+    value_append(reader, out, len);
+}
+
+static int read_hex4(json_reader_t *reader) {
+    int value = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = reader_peek(reader);
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return -1;
+        }
+        reader_take(reader);
+        value = value << 4 | digit;
+    }
+    return value;
+}
+
+/* Reads a string, the opening quote is the next byte */
+static bool read_string(json_reader_t *reader) {
+    reader->value_len = 0;
+    reader->truncated = false;
+    reader_take(reader);
+    for (;;) {
+        int c = reader_peek(reader);
+        if (c < 0x20) {     // also the end of the input
+            return false;
+        }
+        reader_take(reader);
+        if (c == '"') {
+            break;
+        }
+        if (c != '\\') {
+            char ch = c;
+            value_append(reader, &ch, 1);
+            continue;
+        }
+
+        c = reader_peek(reader);
+        if (c < 0) {
+            return false;
+        }
+        reader_take(reader);
+        const char *simple = strchr("\"\\/bfnrt", c);
+        if (simple && c) {
+            static const char decoded[] = "\"\\/\b\f\n\r\t";
+            value_append(reader, &decoded[simple - "\"\\/bfnrt"], 1);
+            continue;
+        }
+        if (c != 'u') {
+            return false;
+        }
+        int cp = read_hex4(reader);
+        if (cp < 0 || (cp >= 0xDC00 && cp <= 0xDFFF)) {
+            return false;
+        }
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            // a high surrogate must be followed by the low one
+            if (reader_peek(reader) != '\\') {
+                return false;
+            }
+            reader_take(reader);
+            if (reader_peek(reader) != 'u') {
+                return false;
+            }
+            reader_take(reader);
+            int low = read_hex4(reader);
+            if (low < 0xDC00 || low > 0xDFFF) {
+                return false;
+            }
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        value_append_utf8(reader, cp);
+    }
+    reader->value[reader->value_len] = '\0';
+    return true;
+}
+
+static bool is_digit(int c) {
+    return c >= '0' && c <= '9';
+}
+
+#define NUMBER_DIGITS_MAX   40          // significant digits kept, more than a double tells apart
+#define NUMBER_EXP_MAX      100000      // a larger exponent gives infinity or zero anyway
+
+/* Consumes the digit at the input and appends it to value */
+static void take_digit(json_reader_t *reader, char c) {
+    reader_take(reader);
+    value_append(reader, &c, 1);
+}
+
+/*
+ * Reads a number of any length. value holds it as written if it fits, otherwise its
+ * first NUMBER_DIGITS_MAX significant digits with the exponent adjusted for the rest,
+ * which strtod() turns into the same double.
+ */
+static bool read_number(json_reader_t *reader) {
+    char digits[NUMBER_DIGITS_MAX];
+    size_t count = 0;
+    long scale = 0;         // decimal exponent of the last kept digit
+    long exponent = 0;
+    bool negative = false;
+    reader->value_len = 0;
+    reader->truncated = false;
+
+    int c = reader_peek(reader);
+    if (c == '-') {
+        negative = true;
+        reader_take(reader);
+        value_append(reader, "-", 1);
+        c = reader_peek(reader);
+    }
+    if (c == '0') {
+        take_digit(reader, '0');
+    } else if (!is_digit(c)) {
+        return false;
+    } else {
+        while (is_digit(c = reader_peek(reader))) {
+            take_digit(reader, c);
+            if (count < NUMBER_DIGITS_MAX) {
+                digits[count++] = c;
+            } else {
+                scale++;
+            }
+        }
+    }
+    if (reader_peek(reader) == '.') {
+        reader_take(reader);
+        value_append(reader, ".", 1);
+        if (!is_digit(reader_peek(reader))) {
+            return false;
+        }
+        while (is_digit(c = reader_peek(reader))) {
+            take_digit(reader, c);
+            if (count == 0 && c == '0') {
+                scale--;    // a leading zero of e.g. 0.001
+            } else if (count < NUMBER_DIGITS_MAX) {
+                digits[count++] = c;
+                scale--;
+            }
+        }
+    }
+    c = reader_peek(reader);
+    if (c == 'e' || c == 'E') {
+        reader_take(reader);
+        value_append(reader, "e", 1);
+        bool exp_negative = false;
+        c = reader_peek(reader);
+        if (c == '+' || c == '-') {
+            char sign = c;
+            exp_negative = c == '-';
+            reader_take(reader);
+            value_append(reader, &sign, 1);
+        }
+        if (!is_digit(reader_peek(reader))) {
+            return false;
+        }
+        while (is_digit(c = reader_peek(reader))) {
+            take_digit(reader, c);
+            if (exponent < NUMBER_EXP_MAX) {
+                exponent = exponent * 10 + (c - '0');
+            }
+        }
+        if (exp_negative) {
+            exponent = -exponent;
+        }
+    }
+    if (reader->truncated) {
+        int len = snprintf(reader->value, sizeof(reader->value), "%s%.*se%ld", negative ? "-" : "",
+                           count ? (int)count : 1, count ? digits : "0", count ? exponent + scale : 0);
+        reader->value_len = len;
+        reader->truncated = false;
+    }
+    reader->value[reader->value_len] = '\0';
+    reader->number = strtod(reader->value, NULL);
+    return true;
+}
+
+static bool read_literal(json_reader_t *reader, const char *literal) {
+    for (; *literal; literal++) {
+        if (reader_peek(reader) != *literal) {
+            return false;
+        }
+        reader_take(reader);
+    }
+    return true;
+}
+
+static json_token_t value_done(json_reader_t *reader, json_token_t token) {
+    reader->state = reader->depth ? STATE_AFTER_VALUE : STATE_DONE;
+    return token;
+}
+
+static json_token_t reader_fail(json_reader_t *reader) {
+    reader->state = STATE_ERROR;
+    return JSON_ERROR;
+}
+
+static json_token_t container_open(json_reader_t *reader, bool object) {
+    if (reader->depth == JSON_READER_MAX_DEPTH) {
+        return reader_fail(reader);
+    }
+    reader_take(reader);
+    uint32_t bit = 1u << reader->depth++;
+    reader->objects = object ? reader->objects | bit : reader->objects & ~bit;
+    reader->state = object ? STATE_FIRST_KEY : STATE_FIRST_VALUE;
+    return object ? JSON_OBJ_BEGIN : JSON_ARR_BEGIN;
+}
+
+static json_token_t container_close(json_reader_t *reader, int c) {
+    bool object = reader->objects & (1u << (reader->depth - 1));
+    if (c != (object ? '}' : ']')) {
+        return reader_fail(reader);
+    }
+    reader_take(reader);
+    reader->depth--;
+    return value_done(reader, object ? JSON_OBJ_END : JSON_ARR_END);
+}
+
+void json_reader_init(json_reader_t *reader, json_read_fn_t read, void *ctx) {
+    memset(reader, 0, sizeof(*reader));
+    reader->read = read;
+    reader->ctx = ctx;
+    reader->state = STATE_VALUE;
+}
+
+void json_reader_capture(json_reader_t *reader, char *buf, size_t size) {
+    reader->capture = buf;
+    reader->capture_size = size;
+    reader->capture_len = 0;
+    reader->capture_overflow = false;
+}
+
+json_token_t json_reader_next(json_reader_t *reader) {
+    for (;;) {
+        if (reader->state == STATE_ERROR) {
+            return JSON_ERROR;
+        }
+        int c = reader_skip_ws(reader);
+        if (reader->state == STATE_ERROR) {     // the read failed
+            return JSON_ERROR;
+        }
+
+        switch (reader->state) {
+        case STATE_DONE:
+            return c < 0 ? JSON_END : reader_fail(reader);
+
+        case STATE_AFTER_VALUE:
+            if (c == ',') {
+                reader_take(reader);
+                reader->state = reader->objects & (1u << (reader->depth - 1)) ? STATE_KEY : STATE_VALUE;
+                continue;
+            }
+            return container_close(reader, c);
+
+        case STATE_FIRST_KEY:
+            if (c == '}') {
+                return container_close(reader, c);
+            }
+            /* fall through */
+        case STATE_KEY:
+            if (c != '"' || !read_string(reader) || reader_skip_ws(reader) != ':') {
+                return reader_fail(reader);
+            }
+            reader_take(reader);
+            reader->state = STATE_VALUE;
+            return JSON_KEY;
+
+        case STATE_FIRST_VALUE:
+            if (c == ']') {
+                return container_close(reader, c);
+            }
+            /* fall through */
+        case STATE_VALUE:
+            switch (c) {
+            case '{':
+                return container_open(reader, true);
+            case '[':
+                return container_open(reader, false);
+            case '"':
+                return read_string(reader) ? value_done(reader, JSON_STRING) : reader_fail(reader);
+            case 't':
+                return read_literal(reader, "true") ? value_done(reader, JSON_TRUE) : reader_fail(reader);
+            case 'f':
+                return read_literal(reader, "false") ? value_done(reader, JSON_FALSE) : reader_fail(reader);
+            case 'n':
+                return read_literal(reader, "null") ? value_done(reader, JSON_NULL) : reader_fail(reader);
+            default:
+                if (c == '-' || is_digit(c)) {
+                    return read_number(reader) ? value_done(reader, JSON_NUMBER) : reader_fail(reader);
+                }
+                return reader_fail(reader);
+            }
+
+        default:
+            return reader_fail(reader);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef _JSON_READER_H_
+#define _JSON_READER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_READER_BUF_SIZE    64
+#define JSON_READER_VALUE_MAX   63
+#define JSON_READER_MAX_DEPTH   32
+
+typedef enum {
+    JSON_OBJ_BEGIN,
+    JSON_OBJ_END,
+    JSON_ARR_BEGIN,
+    JSON_ARR_END,
+    JSON_KEY,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL,
+    JSON_END,       // the document is complete
+    JSON_ERROR,     // malformed input or read error, sticky
+} json_token_t;
+
+/* Fills buf with up to len bytes, returns the count, 0 at the end of the input, < 0 on error */
+typedef int (*json_read_fn_t)(void *ctx, char *buf, size_t len);
+
+/*
+ * Incremental pull parser, the input is pulled through a small buffer so documents
+ * of any size are parsed without heap allocation. Each call to json_reader_next()
+ * returns the next token; keys and strings are unescaped into value (truncated
+ * to JSON_READER_VALUE_MAX bytes, see truncated), numbers are also in number.
+ * Numbers of any length are accepted, one too long for value is kept there as its
+ * significant digits and an exponent.
+ *
+ * With json_reader_capture() the input is also copied to a buffer without the
+ * whitespace between tokens, which gives a compact copy of a validated document.
+ */
+typedef struct {
+    json_read_fn_t read;
+    void *ctx;
+    char buf[JSON_READER_BUF_SIZE];
+    size_t pos;
+    size_t len;
+    bool eof;
+
+    uint8_t state;
+    uint8_t depth;
+    uint32_t objects;       // bit per depth, set for objects and clear for arrays
+
+    char value[JSON_READER_VALUE_MAX + 1];
+    size_t value_len;
+    bool truncated;
+    double number;
+
+    char *capture;
+    size_t capture_size;
+    size_t capture_len;
+    bool capture_overflow;
+} json_reader_t;
+
+void json_reader_init(json_reader_t *reader, json_read_fn_t read, void *ctx);
+
+void json_reader_capture(json_reader_t *reader, char *buf, size_t size);
+
+json_token_t json_reader_next(json_reader_t *reader);
+
+#endif
@@ -0,0 +1,317 @@
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json-writer.h"
+
+#define ACCEPT_MAX_LEN  128
+
+/* CBOR major types and simple values */
+#define CBOR_UINT           0x00
+#define CBOR_NEGINT         0x20
+#define CBOR_BYTES          0x40
+#define CBOR_TEXT           0x60
+#define CBOR_ARRAY          0x80
+#define CBOR_MAP            0xA0
+#define CBOR_TAG            0xC0
+#define CBOR_FALSE          0xF4
+#define CBOR_TRUE           0xF5
+#define CBOR_NULL           0xF6
+#define CBOR_HALF           0xF9
+#define CBOR_SINGLE         0xFA
+#define CBOR_DOUBLE         0xFB
+#define CBOR_INDEFINITE     0x1F
+#define CBOR_BREAK          0xFF
+#define CBOR_TAG_JSON       262     // embedded JSON, a byte string
+
+static void cbor_byte(json_writer_t *writer, uint8_t byte) {
+    resp_writer_write(&writer->out, (const char *)&byte, 1);
+}
+
+/* Big endian value in size bytes after the initial byte */
+static void cbor_initial(json_writer_t *writer, uint8_t initial, uint64_t value, int size) {
+    char buf[9];
+    buf[0] = initial;
+    for (int i = 0; i < size; i++) {
+        buf[size - i] = value >> (8 * i);
+    }
+    resp_writer_write(&writer->out, buf, size + 1);
+}
+
+static void cbor_head(json_writer_t *writer, uint8_t major, uint64_t value) {
+    if (value < 24) {
+        cbor_byte(writer, major | value);
+    } else if (value <= 0xFF) {
+        cbor_initial(writer, major | 24, value, 1);
+    } else if (value <= 0xFFFF) {
+        cbor_initial(writer, major | 25, value, 2);
+    } else if (value <= 0xFFFFFFFF) {
+        cbor_initial(writer, major | 26, value, 4);
+    } else {
+        cbor_initial(writer, major | 27, value, 8);
+    }
+}
+
+static void cbor_text(json_writer_t *writer, const char *value, size_t len) {
+    cbor_head(writer, CBOR_TEXT, len);
+    resp_writer_write(&writer->out, value, len);
+}
+
+/* Half precision bits of value if it has an exact normal (or zero) half representation */
+static bool half_from_float_exact(float value, uint16_t *half) {
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    int32_t exp = (int32_t)((x >> 23) & 0xFF) - 127;
+    uint32_t mant = x & 0x7FFFFF;
+    if ((x & 0x7FFFFFFF) == 0) {
+        *half = sign;
+        return true;
+    }
+    if (exp < -14 || exp > 15 || (mant & 0x1FFF)) {
+        return false;
+    }
+    *half = sign | ((exp + 15) << 10) | (mant >> 13);
+    return true;
+}
+
+/*
+ * value rounded to decimals like the text format. Up to FLT_DIG significant digits
+ * the nearest single (or half) precision float reads back as the same decimal,
+ * so only longer values need a double.
+ */
+static void cbor_float(json_writer_t *writer, double value, int decimals) {
+    bool narrow = false;
+    if (decimals >= 0 && decimals <= FLT_DIG) {
+        double scale = pow(10, decimals);
+        double scaled = round(value * scale);
+        value = scaled / scale;
+        narrow = fabs(scaled) < pow(10, FLT_DIG);
+    }
+    float single = (float)value;
+    uint16_t half;
+    if (!narrow && (double)single != value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        cbor_initial(writer, CBOR_DOUBLE, bits, 8);
+    } else if (half_from_float_exact(single, &half)) {
+        cbor_initial(writer, CBOR_HALF, half, 2);
+    } else {
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        cbor_initial(writer, CBOR_SINGLE, bits, 4);
+    }
+}
+
+/* Writes the separator needed before a value at the current position */
+static void json_value_prefix(json_writer_t *writer) {
+    if (writer->format == JSON_FORMAT_CBOR) {
+        return;     // CBOR items need no separators
+    }
+    if (writer->after_key) {
+        writer->after_key = false;
+        return;
+    }
+    if (writer->depth == 0) {
+        return;
+    }
+    uint32_t bit = 1u << (writer->depth - 1);
+    if (writer->has_items & bit) {
+        resp_writer_write(&writer->out, ",", 1);
+    }
+    writer->has_items |= bit;
+}
+
+static void json_open(json_writer_t *writer, char c) {
+    json_value_prefix(writer);
+    if (writer->format == JSON_FORMAT_CBOR) {
+        cbor_byte(writer, (c == '{' ? CBOR_MAP : CBOR_ARRAY) | CBOR_INDEFINITE);
+    } else {
+        resp_writer_write(&writer->out, &c, 1);
+    }
+    if (writer->depth < JSON_WRITER_MAX_DEPTH) {
+        writer->depth++;
+        writer->has_items &= ~(1u << (writer->depth - 1));
+    }
+}
+
+static void json_close(json_writer_t *writer, char c) {
+    if (writer->depth) {
+        writer->depth--;
+    }
+    if (writer->format == JSON_FORMAT_CBOR) {
+        cbor_byte(writer, CBOR_BREAK);
+    } else {
+        resp_writer_write(&writer->out, &c, 1);
+    }
+}
+
+static void json_escaped(json_writer_t *writer, const char *value, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    resp_writer_write(&writer->out, "\"", 1);
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        // runs of plain characters are copied in one go
+        resp_writer_write(&writer->out, value + start, i - start);
+        start = i + 1;
+        switch (c) {
+        case '"':  resp_writer_write(&writer->out, "\\\"", 2); break;
+        case '\\': resp_writer_write(&writer->out, "\\\\", 2); break;
+        case '\n': resp_writer_write(&writer->out, "\\n", 2); break;
+        case '\r': resp_writer_write(&writer->out, "\\r", 2); break;
+        case '\t': resp_writer_write(&writer->out, "\\t", 2); break;
+        default: {
+            char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            resp_writer_write(&writer->out, esc, sizeof(esc));
+        }
+        }
+    }
+    resp_writer_write(&writer->out, value + start, len - start);
+    resp_writer_write(&writer->out, "\"", 1);
+}
+
+void json_writer_init(json_writer_t *writer, httpd_req_t *req) {
+    json_writer_init_format(writer, req, JSON_FORMAT_TEXT);
+}
+
+void json_writer_init_format(json_writer_t *writer, httpd_req_t *req, json_format_t format) {
+    resp_writer_init(&writer->out, req);
+    writer->format = format;
+    writer->has_items = 0;
+    writer->depth = 0;
+    writer->after_key = false;
+}
+
+void json_writer_init_sink(json_writer_t *writer, resp_sink_t *sink, json_format_t format) {
+    json_writer_init_format(writer, NULL, format);
+    writer->out.sink = sink;
+}
+
+json_format_t json_format_negotiate(httpd_req_t *req) {
+    char accept[ACCEPT_MAX_LEN];
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return JSON_FORMAT_TEXT;
+    }
+    // media ranges separated by commas, CBOR is used if it is listed without q=0
+    char *save;
+    for (char *range = strtok_r(accept, ",", &save); range; range = strtok_r(NULL, ",", &save)) {
+        range += strspn(range, " \t");
+        if (strncmp(range, CBOR_CONTENT_TYPE, strlen(CBOR_CONTENT_TYPE)) != 0) {
+            continue;
+        }
+        char *q = strstr(range, "q=");
+        return q && strtod(q + 2, NULL) <= 0 ? JSON_FORMAT_TEXT : JSON_FORMAT_CBOR;
+    }
+    return JSON_FORMAT_TEXT;
+}
+
+const char *json_format_content_type(json_format_t format) {
+    return format == JSON_FORMAT_CBOR ? CBOR_CONTENT_TYPE : JSON_CONTENT_TYPE;
+}
+
+void json_obj_begin(json_writer_t *writer) {
+    json_open(writer, '{');
+}
+
+void json_obj_end(json_writer_t *writer) {
+    json_close(writer, '}');
+}
+
+void json_arr_begin(json_writer_t *writer) {
+    json_open(writer, '[');
+}
+
+void json_arr_end(json_writer_t *writer) {
+    json_close(writer, ']');
+}
+
+void json_key(json_writer_t *writer, const char *key) {
+    json_value_prefix(writer);
+    if (writer->format == JSON_FORMAT_CBOR) {
+        cbor_text(writer, key, strlen(key));
+        return;
+    }
+    json_escaped(writer, key, strlen(key));
+    resp_writer_write(&writer->out, ":", 1);
+    writer->after_key = true;
+}
+
+void json_str(json_writer_t *writer, const char *value) {
+    json_strn(writer, value, strlen(value));
+}
+
+void json_strn(json_writer_t *writer, const char *value, size_t len) {
+    json_value_prefix(writer);
+    if (writer->format == JSON_FORMAT_CBOR) {
+        cbor_text(writer, value, len);
+        return;
+    }
+    json_escaped(writer, value, len);
+}
+
+void json_int(json_writer_t *writer, long long value) {
+    json_value_prefix(writer);
+    if (writer->format == JSON_FORMAT_CBOR) {
+        if (value < 0) {
+            cbor_head(writer, CBOR_NEGINT, (uint64_t)(-(value + 1)));
+        } else {
+            cbor_head(writer, CBOR_UINT, value);
+        }
+        return;
+    }
+    resp_writer_printf(&writer->out, "%lld", value);
+}
+
+static void json_null_literal(json_writer_t *writer) {
+    if (writer->format == JSON_FORMAT_CBOR) {
+        cbor_byte(writer, CBOR_NULL);
+        return;
+    }
+    resp_writer_write(&writer->out, "null", 4);
+}
+
+void json_float(json_writer_t *writer, double value, int decimals) {
+    json_value_prefix(writer);
+    if (!isfinite(value)) {
+        json_null_literal(writer);
+        return;
+    }
+    if (writer->format == JSON_FORMAT_CBOR) {
+        cbor_float(writer, value, decimals);
+        return;
+    }
+    resp_writer_printf(&writer->out, "%.*f", decimals, value);
+}
+
+void json_bool(json_writer_t *writer, bool value) {
+    json_value_prefix(writer);
+    if (writer->format == JSON_FORMAT_CBOR) {
+        cbor_byte(writer, value ? CBOR_TRUE : CBOR_FALSE);
+        return;
+    }
+    resp_writer_write(&writer->out, value ? "true" : "false", value ? 4 : 5);
+}
+
+void json_null(json_writer_t *writer) {
+    json_value_prefix(writer);
+    json_null_literal(writer);
+}
+
+void json_raw(json_writer_t *writer, const char *json, size_t len) {
+    json_value_prefix(writer);
+    if (writer->format == JSON_FORMAT_CBOR) {
+        cbor_head(writer, CBOR_TAG, CBOR_TAG_JSON);
+        cbor_head(writer, CBOR_BYTES, len);
+    }
+    resp_writer_write(&writer->out, json, len);
+}
+
+esp_err_t json_writer_finish(json_writer_t *writer) {
+    return resp_writer_finish(&writer->out);
+}
@@ -0,0 +1,67 @@
+#ifndef _JSON_WRITER_H_
+#define _JSON_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_http_server.h"
+
+#include "resp-writer.h"
+
+#define JSON_WRITER_MAX_DEPTH   32
+
+#define JSON_CONTENT_TYPE       "application/json"
+#define CBOR_CONTENT_TYPE       "application/cbor"
+
+typedef enum {
+    JSON_FORMAT_TEXT,
+    JSON_FORMAT_CBOR,       // the same values as CBOR (RFC 8949), a smaller body and no number formatting
+} json_format_t;
+
+/*
+ * JSON encoder writing straight into the response through a resp_writer_t, no heap
+ * allocation. Commas and colons are placed by the writer, strings are escaped.
+ * Nesting deeper than JSON_WRITER_MAX_DEPTH is not supported.
+ *
+ * With JSON_FORMAT_CBOR the same calls produce CBOR: objects and arrays become maps
+ * and arrays of indefinite length, so nothing has to be counted ahead, and floats
+ * are written as half, single or double precision, the shortest that is exact enough.
+ */
+typedef struct {
+    resp_writer_t out;
+    json_format_t format;
+    uint32_t has_items;     // bit per depth, set once the container got its first value
+    uint8_t depth;
+    bool after_key;
+} json_writer_t;
+
+void json_writer_init(json_writer_t *writer, httpd_req_t *req);
+void json_writer_init_format(json_writer_t *writer, httpd_req_t *req, json_format_t format);
+/* Writes to sink instead of a request, see resp_writer_init_sink() */
+void json_writer_init_sink(json_writer_t *writer, resp_sink_t *sink, json_format_t format);
+
+/* JSON_FORMAT_CBOR if the Accept header of the request takes application/cbor */
+json_format_t json_format_negotiate(httpd_req_t *req);
+
+const char *json_format_content_type(json_format_t format);
+
+void json_obj_begin(json_writer_t *writer);
+void json_obj_end(json_writer_t *writer);
+void json_arr_begin(json_writer_t *writer);
+void json_arr_end(json_writer_t *writer);
+
+void json_key(json_writer_t *writer, const char *key);
+void json_str(json_writer_t *writer, const char *value);
+void json_strn(json_writer_t *writer, const char *value, size_t len);
+void json_int(json_writer_t *writer, long long value);
+/* NaN and infinities are written as null. CBOR gets the same rounding, as a float where that is exact enough */
+void json_float(json_writer_t *writer, double value, int decimals);
+void json_bool(json_writer_t *writer, bool value);
+void json_null(json_writer_t *writer);
+/* Value which is already valid JSON, e.g. a stored config. CBOR embeds it as a tag 262 byte string */
+void json_raw(json_writer_t *writer, const char *json, size_t len);
+
+/* Sends what is left and completes the response */
+esp_err_t json_writer_finish(json_writer_t *writer);
+
+#endif
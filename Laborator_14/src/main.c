@@ -1,4 +1,7 @@
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
@@ -7,121 +10,547 @@
 #include "nvs_flash.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
+#include "esp_timer.h"
+
+#include "sensor-registry.h"
+#include "sensor-history.h"
+#include "sensor-sampler.h"
+#include "uri-router.h"
+#include "json-writer.h"
+#include "json-reader.h"
+#include "sensor-stream.h"
+#include "config-store.h"
+#include "http-cache.h"
+#include "async-handler.h"
+#include "device-advertise.h"
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+#define HTTPD_STACK_SIZE 6144
+
+#define SIM_SENSOR_PERIOD_MS 1000
+
+#define HISTORY_DEFAULT_RANGE_S 3600
+#define SENSORS_QUERY_MAX       256         // /sensors query string, about 60 ids
+#define HISTORY_TIME_MAX_S      INT32_MAX   // 68 years either way, keeps the ms values far from overflowing
+
 static const char *TAG = "REST_SERVER";
 
-static bool config_created_1 = false;
-static bool config_created_2 = false;
+static uri_router_t router;
 
-float simulate_sensor_value(const char* sensor_id) {
-    if (strcmp(sensor_id, "1") == 0) {
-        return 20.0 + ((float)rand() / RAND_MAX) * (30.0 - 20.0);
-    } else if (strcmp(sensor_id, "2") == 0) {
-        return 50.0 + ((float)rand() / RAND_MAX) * (60.0 - 50.0);
-    } else {
-        return -1.0f;
+/* Simulated sensor, returns a random value in [min, max] */
+typedef struct {
+    float min;
+    float max;
+} sim_sensor_t;
+
+static esp_err_t sim_sensor_read(void *ctx, float *value) {
+    sim_sensor_t *sim = (sim_sensor_t *)ctx;
+    *value = sim->min + ((float)rand() / RAND_MAX) * (sim->max - sim->min);
+    return ESP_OK;
+}
+
+static const sensor_driver_t sim_sensor_driver = {
+    .name = "sim",
+    .read = sim_sensor_read,
+};
+
+static sim_sensor_t sim_sensors[] = {
+    { .min = 20.0, .max = 30.0 },
+    { .min = 50.0, .max = 60.0 },
+};
+
+static void register_sensors(void) {
+    char id[SENSOR_ID_MAX_LEN + 1];
+    for (size_t i = 0; i < sizeof(sim_sensors) / sizeof(sim_sensors[0]); i++) {
+        snprintf(id, sizeof(id), "%u", (unsigned)(i + 1));
+        ESP_ERROR_CHECK(sensor_register(id, &sim_sensor_driver, &sim_sensors[i], SIM_SENSOR_PERIOD_MS));
     }
 }
 
-static esp_err_t get_handler(httpd_req_t *req) {
-    char sensor_id[8];
-    sscanf(req->uri, "/sensor/%7s", sensor_id);
+static sensor_t *find_sensor_param(const route_params_t *params) {
+    size_t len;
+    const char *id = route_param(params, "id", &len);
+    return id ? sensor_find(id, len) : NULL;
+}
 
-    float sensor_value = simulate_sensor_value(sensor_id);
-    if (sensor_value < 0) {
+/*
+ * Format of the response asked for by the Accept header. The two renderings of a
+ * resource are different representations, the CBOR one is tagged with the
+ * uppercase kind so a client's cached JSON never validates it.
+ */
+static json_format_t negotiate_format(httpd_req_t *req, char *kind) {
+    json_format_t format = json_format_negotiate(req);
+    if (format == JSON_FORMAT_CBOR && kind) {
+        *kind = toupper((unsigned char)*kind);
+    }
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    return format;
+}
+
+static esp_err_t get_handler(httpd_req_t *req, const route_params_t *params) {
+    sensor_t *sensor = find_sensor_param(params);
+    if (!sensor) {
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Sensor not found");
         return ESP_OK;
     }
 
-    char resp_str[64];
-    snprintf(resp_str, sizeof(resp_str), "{\"sensor_id\": \"%s\", \"value\": %.2f}", sensor_id, sensor_value);
+    // the version is read before the sample, so the tag is never newer than the body
+    unsigned version = sample_ring_count(&sensor->samples);
+    sensor_sample_t sample;
+    if (!sensor_latest(sensor, &sample)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"error\": \"No sample yet.\"}");
+        return ESP_OK;
+    }
+
+    // cacheable until the sampler takes the next sample
+    char kind = 's';
+    json_format_t format = negotiate_format(req, &kind);
+    char etag[HTTP_CACHE_ETAG_LEN];
+    char cache_control[HTTP_CACHE_CONTROL_LEN];
+    http_cache_etag(etag, kind, version);
+    http_cache_max_age(cache_control, sample.timestamp_us + (int64_t)sensor->period_ms * 1000);
+    http_cache_set_headers(req, etag, cache_control);
+    if (http_cache_not_modified(req, etag)) {
+        return http_cache_send_not_modified(req, etag, cache_control, "Accept");
+    }
+
+    httpd_resp_set_type(req, json_format_content_type(format));
+    json_writer_t json;
+    json_writer_init_format(&json, req, format);
+    json_obj_begin(&json);
+    json_key(&json, "sensor_id");
+    json_str(&json, sensor->id);
+    json_key(&json, "value");
+    json_float(&json, sample.value, 2);
+    json_obj_end(&json);
+    return json_writer_finish(&json);
+}
+
+static esp_err_t get_config_handler(httpd_req_t *req, const route_params_t *params) {
+    sensor_t *sensor = find_sensor_param(params);
+    if (!sensor) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Sensor not found");
+        return ESP_OK;
+    }
+
+    char config[SENSOR_CONFIG_MAX_LEN];
+    size_t config_len;
+    uint32_t version;
+    if (!sensor_config_get(sensor, config, &config_len, &version)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Sensor has no config");
+        return ESP_OK;
+    }
+
+    // configs change at any time, clients revalidate on every use
+    char etag[HTTP_CACHE_ETAG_LEN];
+    http_cache_etag(etag, 'c', version);
+    http_cache_set_headers(req, etag, "no-cache");
+    if (http_cache_not_modified(req, etag)) {
+        return http_cache_send_not_modified(req, etag, "no-cache", NULL);
+    }
 
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
+    json_writer_t json;
+    json_writer_init(&json, req);
+    json_obj_begin(&json);
+    json_key(&json, "sensor_id");
+    json_str(&json, sensor->id);
+    json_key(&json, "config");
+    json_raw(&json, config, config_len);
+    json_obj_end(&json);
+    return json_writer_finish(&json);
+}
+
+/*
+ * Reads a time parameter in seconds. There is no wall clock on the board, values
+ * <= 0 are relative to now and positive values are seconds since boot. Returns
+ * ESP_ERR_NOT_FOUND if the parameter is missing, ESP_ERR_INVALID_ARG if it is not
+ * a number or out of range.
+ */
+static esp_err_t query_time_ms(const char *query, const char *key, int64_t now_ms, int64_t *time_ms) {
+    char value[24];
+    if (!query || httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    char *end;
+    errno = 0;
+    long long seconds = strtoll(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE ||
+            seconds > HISTORY_TIME_MAX_S || seconds < -HISTORY_TIME_MAX_S) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *time_ms = seconds <= 0 ? now_ms + seconds * 1000 : seconds * 1000;
     return ESP_OK;
 }
 
-static esp_err_t post_handler(httpd_req_t *req) {
-    char sensor_id[8];
-    sscanf(req->uri, "/sensor/%7s", sensor_id);
+typedef struct {
+    history_query_t history;
+    int64_t now_ms;
+    json_format_t format;
+} history_job_t;
+
+/* Runs on an async worker, streamed as chunks so the point count does not depend on a buffer */
+static esp_err_t history_write(async_resp_t *resp, void *arg) {
+    history_job_t *job = (history_job_t *)arg;
+    history_query_t *history = &job->history;
+    json_writer_t json;
+    json_writer_init_sink(&json, &resp->sink, job->format);
+    json_obj_begin(&json);
+    json_key(&json, "sensor_id");
+    json_str(&json, history->sensor->id);
+    json_key(&json, "now");
+    json_int(&json, job->now_ms / 1000);
+    json_key(&json, "from");
+    json_int(&json, history->from_ms / 1000);
+    json_key(&json, "to");
+    json_int(&json, history->to_ms / 1000);
+    json_key(&json, "step");
+    json_int(&json, history->step_ms / 1000);
+    json_key(&json, "columns");
+    json_arr_begin(&json);
+    static const char *columns[] = { "t", "min", "max", "avg", "count" };
+    for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); i++) {
+        json_str(&json, columns[i]);
+    }
+    json_arr_end(&json);
+    json_key(&json, "points");
+    json_arr_begin(&json);
+
+    history_point_t point;
+    while (sensor_history_query_next(history, &point) && json.out.err == ESP_OK) {
+        json_arr_begin(&json);
+        json_int(&json, point.start_ms / 1000);
+        json_float(&json, point.min, 2);
+        json_float(&json, point.max, 2);
+        json_float(&json, point.avg, 2);
+        json_int(&json, point.count);
+        json_arr_end(&json);
+    }
+    json_arr_end(&json);
+    json_obj_end(&json);
+    return json_writer_finish(&json);
+}
+
+/* GET /sensor/:id/history?from=&to=&step=, checked here and walked by an async worker */
+static esp_err_t history_handler(httpd_req_t *req, const route_params_t *params) {
+    sensor_t *sensor = find_sensor_param(params);
+    if (!sensor) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Sensor not found");
+        return ESP_OK;
+    }
 
-    bool *config_flag = (strcmp(sensor_id, "1") == 0) ? &config_created_1 :
-                        (strcmp(sensor_id, "2") == 0) ? &config_created_2 : NULL;
+    char query_buf[96];
+    const char *query = NULL;
+    size_t query_len = httpd_req_get_url_query_len(req);
+    if (query_len && query_len < sizeof(query_buf) &&
+            httpd_req_get_url_query_str(req, query_buf, sizeof(query_buf)) == ESP_OK) {
+        query = query_buf;
+    }
+
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    int64_t to_ms = now_ms;
+    int64_t from_ms = 0;
+    int64_t step_ms = 0;
+    esp_err_t to_err = query_time_ms(query, "to", now_ms, &to_ms);
+    esp_err_t from_err = query_time_ms(query, "from", now_ms, &from_ms);
+    esp_err_t step_err = query_time_ms(query, "step", 0, &step_ms);
+    if (to_err == ESP_ERR_INVALID_ARG || from_err == ESP_ERR_INVALID_ARG || step_err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid time range");
+        return ESP_OK;
+    }
+    if (from_err == ESP_ERR_NOT_FOUND) {
+        from_ms = to_ms - HISTORY_DEFAULT_RANGE_S * 1000;
+    }
+    if (step_ms < 0) {
+        step_ms = 0;
+    }
+    if (from_ms < 0) {
+        from_ms = 0;
+    }
+
+    history_query_t history;
+    if (sensor_history_query_init(&history, sensor, from_ms, to_ms, step_ms) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid time range");
+        return ESP_OK;
+    }
+
+    history_job_t job = { .history = history, .now_ms = now_ms, .format = json_format_negotiate(req) };
+    return async_handler_submit(req, json_format_content_type(job.format), "Accept", history_write, &job, sizeof(job));
+}
+
+static void write_sensor_value(const char *id, size_t id_len, void *ctx) {
+    json_writer_t *json = (json_writer_t *)ctx;
+    sensor_t *sensor = sensor_find(id, id_len);
+    sensor_sample_t sample;
+    json_obj_begin(json);
+    json_key(json, "sensor_id");
+    json_strn(json, id, id_len);
+    if (!sensor) {
+        json_key(json, "error");
+        json_str(json, "Sensor not found");
+    } else if (!sensor_latest(sensor, &sample)) {
+        json_key(json, "value");
+        json_null(json);
+        json_key(json, "error");
+        json_str(json, "No sample yet.");
+    } else {
+        json_key(json, "value");
+        json_float(json, sample.value, 2);
+    }
+    json_obj_end(json);
+}
 
-    if (config_flag == NULL) {
+/* Folds the sample count of the sensor into an FNV-1a hash, the version of a batch */
+static void hash_sensor_version(const char *id, size_t id_len, void *ctx) {
+    uint32_t *hash = (uint32_t *)ctx;
+    sensor_t *sensor = sensor_find(id, id_len);
+    unsigned version = sensor ? sample_ring_count(&sensor->samples) : UINT32_MAX;
+    for (size_t i = 0; i < sizeof(version); i++) {
+        *hash ^= (version >> (8 * i)) & 0xFF;
+        *hash *= 16777619u;
+    }
+}
+
+/* Calls visit for each id of the comma separated list, or for every sensor if ids is NULL */
+static void visit_sensor_ids(const char *ids, void (*visit)(const char *id, size_t len, void *ctx), void *ctx) {
+    if (!ids) {
+        for (size_t i = 0; i < sensor_count(); i++) {
+            sensor_t *sensor = sensor_at(i);
+            visit(sensor->id, strlen(sensor->id), ctx);
+        }
+        return;
+    }
+    for (;;) {
+        const char *end = strchr(ids, ',');
+        size_t len = end ? (size_t)(end - ids) : strlen(ids);
+        if (len) {
+            visit(ids, len, ctx);
+        }
+        if (!end) {
+            break;
+        }
+        ids = end + 1;
+    }
+}
+
+/* GET /sensors?ids=1,2,... (all sensors without ids), one document instead of a request per sensor */
+static esp_err_t sensors_handler(httpd_req_t *req, const route_params_t *params) {
+    char query[SENSORS_QUERY_MAX];
+    char ids_buf[SENSORS_QUERY_MAX];
+    const char *ids = NULL;
+    size_t query_len = httpd_req_get_url_query_len(req);
+    if (query_len >= sizeof(query)) {
+        httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "Too many sensor ids");
+        return ESP_OK;
+    }
+    if (query_len && httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+            httpd_query_key_value(query, "ids", ids_buf, sizeof(ids_buf)) == ESP_OK) {
+        ids = ids_buf;
+    }
+
+    // the sensors of a batch are sampled at different times, it is only revalidated
+    uint32_t hash = 2166136261u;
+    visit_sensor_ids(ids, hash_sensor_version, &hash);
+    char kind = 'b';
+    json_format_t format = negotiate_format(req, &kind);
+    char etag[HTTP_CACHE_ETAG_LEN];
+    http_cache_etag(etag, kind, hash);
+    http_cache_set_headers(req, etag, "no-cache");
+    if (http_cache_not_modified(req, etag)) {
+        return http_cache_send_not_modified(req, etag, "no-cache", "Accept");
+    }
+
+    httpd_resp_set_type(req, json_format_content_type(format));
+    json_writer_t json;
+    json_writer_init_format(&json, req, format);
+    json_obj_begin(&json);
+    json_key(&json, "sensors");
+    json_arr_begin(&json);
+    visit_sensor_ids(ids, write_sensor_value, &json);
+    json_arr_end(&json);
+    json_obj_end(&json);
+    return json_writer_finish(&json);
+}
+
+typedef struct {
+    httpd_req_t *req;
+    size_t remaining;
+    esp_err_t err;      // why the body stopped short, ESP_ERR_TIMEOUT if the client went quiet
+} body_source_t;
+
+static int body_read(void *ctx, char *buf, size_t len) {
+    body_source_t *body = (body_source_t *)ctx;
+    if (body->remaining == 0) {
+        return 0;
+    }
+    // no retry on a timeout, the handler holds the only httpd task while it waits
+    int ret = httpd_req_recv(body->req, buf, MIN(len, body->remaining));
+    if (ret <= 0) {
+        body->err = ret == HTTPD_SOCK_ERR_TIMEOUT ? ESP_ERR_TIMEOUT : ESP_FAIL;
+        return -1;
+    }
+    body->remaining -= ret;
+    return ret;
+}
+
+/*
+ * Streams the request body, whatever its size, through the JSON parser and leaves a
+ * compact copy of it in buf. ESP_ERR_INVALID_SIZE if that does not fit in size bytes,
+ * ESP_ERR_INVALID_ARG if the body is not JSON, ESP_ERR_TIMEOUT if the client stopped
+ * sending it and ESP_FAIL if the connection closed.
+ */
+static esp_err_t read_json_body(httpd_req_t *req, char *buf, size_t size, size_t *len) {
+    body_source_t body = { .req = req, .remaining = req->content_len, .err = ESP_OK };
+    json_reader_t reader;
+    json_reader_init(&reader, body_read, &body);
+    json_reader_capture(&reader, buf, size);
+
+    json_token_t token;
+    do {
+        token = json_reader_next(&reader);
+        if (reader.capture_overflow) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    } while (token != JSON_END && token != JSON_ERROR);
+    if (token == JSON_ERROR) {
+        return body.err != ESP_OK ? body.err : ESP_ERR_INVALID_ARG;
+    }
+    *len = reader.capture_len;
+    return ESP_OK;
+}
+
+/* Answers a read_json_body() error, the handler returns the result: ESP_FAIL closes the connection */
+static esp_err_t send_body_error(httpd_req_t *req, esp_err_t err) {
+    if (err == ESP_ERR_TIMEOUT) {
+        httpd_resp_send_408(req);
+        return ESP_FAIL;
+    }
+    if (err == ESP_FAIL) {
+        return ESP_FAIL;
+    }
+    if (err == ESP_ERR_INVALID_SIZE) {
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"error\": \"Config is too large.\"}");
+    } else {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Config is not valid JSON");
+    }
+    return ESP_OK;
+}
+
+static esp_err_t post_handler(httpd_req_t *req, const route_params_t *params) {
+    sensor_t *sensor = find_sensor_param(params);
+    if (sensor == NULL) {
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown sensor");
         return ESP_OK;
     }
 
-    if (*config_flag) {
+    // sensor_config_create checks again under the lock, this only saves reading the body
+    uint32_t version;
+    if (sensor_config_get(sensor, NULL, NULL, &version)) {
         httpd_resp_set_status(req, "409 Conflict");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_sendstr(req, "{\"error\": \"Config file already exists for this sensor.\"}");
         return ESP_OK;
     }
 
-    *config_flag = true;
+    char buf[SENSOR_CONFIG_MAX_LEN];
+    size_t len = 2;
+    memcpy(buf, "{}", 2);   // no body, an empty config
+    if (req->content_len) {
+        esp_err_t err = read_json_body(req, buf, sizeof(buf), &len);
+        if (err != ESP_OK) {
+            return send_body_error(req, err);
+        }
+    }
+
+    esp_err_t err = sensor_config_create(sensor, buf, len);
+    if (err == ESP_ERR_NO_MEM) {
+        httpd_resp_set_status(req, "507 Insufficient Storage");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"error\": \"No memory left for the config.\"}");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"error\": \"Config file already exists for this sensor.\"}");
+        return ESP_OK;
+    }
+    config_store_schedule();
     httpd_resp_sendstr(req, "Config created (simulated)");
     return ESP_OK;
 }
 
-static esp_err_t put_handler(httpd_req_t *req) {
-    char sensor_id[8];
-    sscanf(req->uri, "/sensor/%7s/config", sensor_id);
-
-    bool *config_flag = (strcmp(sensor_id, "1") == 0) ? &config_created_1 :
-                        (strcmp(sensor_id, "2") == 0) ? &config_created_2 : NULL;
-
-    if (config_flag == NULL) {
+static esp_err_t put_handler(httpd_req_t *req, const route_params_t *params) {
+    sensor_t *sensor = find_sensor_param(params);
+    if (sensor == NULL) {
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown sensor");
         return ESP_OK;
     }
 
-    if (!*config_flag) {
+    uint32_t version;
+    if (!sensor_config_get(sensor, NULL, NULL, &version)) {
         httpd_resp_set_status(req, "406 Not Acceptable");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_sendstr(req, "{\"error\": \"Config file does not exist; cannot update.\"}");
         return ESP_OK;
     }
 
-    char buf[100];
-    int ret = httpd_req_recv(req, buf, MIN(req->content_len, sizeof(buf)));
-    if (ret <= 0) {
-        return ESP_FAIL;
+    char buf[SENSOR_CONFIG_MAX_LEN];
+    size_t len;
+    esp_err_t err = read_json_body(req, buf, sizeof(buf), &len);
+    if (err != ESP_OK) {
+        return send_body_error(req, err);
     }
 
+    if (sensor_config_update(sensor, buf, len) != ESP_OK) {
+        httpd_resp_set_status(req, "406 Not Acceptable");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"error\": \"Config file does not exist; cannot update.\"}");
+        return ESP_OK;
+    }
+    config_store_schedule();
     httpd_resp_sendstr(req, "Config updated (simulated)");
     return ESP_OK;
 }
 
-httpd_uri_t get_uri = {
-    .uri      = "/sensor/*",
-    .method   = HTTP_GET,
-    .handler  = get_handler,
-};
-
-httpd_uri_t post_uri = {
-    .uri      = "/sensor/*",
-    .method   = HTTP_POST,
-    .handler  = post_handler,
-};
-
-httpd_uri_t put_uri = {
-    .uri      = "/sensor/*/config",
-    .method   = HTTP_PUT,
-    .handler  = put_handler,
-};
+/*
+ * The history walk runs on the async workers, a long query no longer holds up the other
+ * sockets. POST and PUT stay on the httpd task: it reads the rest of a body there anyway
+ * once the handler returns, and the flash write already happens on the config store's task.
+ */
+static void register_routes(void) {
+    ESP_ERROR_CHECK(router_add(&router, HTTP_GET, "/sensor/:id", get_handler));
+    ESP_ERROR_CHECK(router_add(&router, HTTP_POST, "/sensor/:id", post_handler));
+    ESP_ERROR_CHECK(router_add(&router, HTTP_PUT, "/sensor/:id/config", put_handler));
+    ESP_ERROR_CHECK(router_add(&router, HTTP_GET, "/sensor/:id/config", get_config_handler));
+    ESP_ERROR_CHECK(router_add(&router, HTTP_GET, "/sensor/:id/history", history_handler));
+    ESP_ERROR_CHECK(router_add(&router, HTTP_GET, "/sensors", sensors_handler));
+}
 
 void start_webserver(void) {
+    static const httpd_method_t methods[] = { HTTP_GET, HTTP_POST, HTTP_PUT };
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.stack_size = HTTPD_STACK_SIZE;   // handlers keep a config and a response buffer on the stack
 
+    register_routes();
+    ESP_ERROR_CHECK(async_handler_start());
     if (httpd_start(&server, &config) == ESP_OK) {
-        httpd_register_uri_handler(server, &get_uri);
-        httpd_register_uri_handler(server, &post_uri);
-        httpd_register_uri_handler(server, &put_uri);
+        // before the router, whose "/*" handlers would match /ws as well
+        ESP_ERROR_CHECK(sensor_stream_register(server));
+        router_register(server, &router, methods, sizeof(methods) / sizeof(methods[0]));
+        // the proxy's fleet mode finds the board by this instead of a configured address
+        esp_err_t err = device_advertise_start(config.server_port);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "mDNS advertising failed: %s", esp_err_to_name(err));
+        }
     }
 }
 
@@ -131,6 +560,9 @@ void app_main(void) {
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     srand(time(NULL));
+    register_sensors();
+    ESP_ERROR_CHECK(config_store_init());
+    ESP_ERROR_CHECK(sensor_sampler_start());
 
     ESP_LOGI(TAG, "Starting web server");
     start_webserver();
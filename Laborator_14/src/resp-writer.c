@@ -0,0 +1,81 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "resp-writer.h"
+
+static esp_err_t send_chunk(resp_writer_t *writer, const char *buf, size_t len) {
+    if (writer->sink) {
+        return writer->sink->send_chunk(writer->sink, buf, len);
+    }
+    return httpd_resp_send_chunk(writer->req, buf, len);
+}
+
+static void resp_writer_flush(resp_writer_t *writer) {
+    if (writer->len && writer->err == ESP_OK) {
+        writer->err = send_chunk(writer, writer->buf, writer->len);
+        writer->chunked = true;
+    }
+    writer->len = 0;
+}
+
+void resp_writer_init(resp_writer_t *writer, httpd_req_t *req) {
+    writer->req = req;
+    writer->sink = NULL;
+    writer->err = ESP_OK;
+    writer->chunked = false;
+    writer->len = 0;
+}
+
+void resp_writer_init_sink(resp_writer_t *writer, resp_sink_t *sink) {
+    resp_writer_init(writer, NULL);
+    writer->sink = sink;
+}
+
+void resp_writer_write(resp_writer_t *writer, const char *data, size_t len) {
+    while (len) {
+        if (writer->len == sizeof(writer->buf)) {
+            resp_writer_flush(writer);
+        }
+        size_t n = sizeof(writer->buf) - writer->len;
+        n = n < len ? n : len;
+        memcpy(writer->buf + writer->len, data, n);
+        writer->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void resp_writer_printf(resp_writer_t *writer, const char *fmt, ...) {
+    va_list args;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t space = sizeof(writer->buf) - writer->len;
+        va_start(args, fmt);
+        int n = vsnprintf(writer->buf + writer->len, space, fmt, args);
+        va_end(args);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n < space) {
+            writer->len += n;
+            return;
+        }
+        // did not fit, send what is buffered and format again into the empty buffer
+        resp_writer_flush(writer);
+    }
+    writer->len = sizeof(writer->buf) - 1;  // longer than the whole buffer, keep it truncated
+}
+
+esp_err_t resp_writer_finish(resp_writer_t *writer) {
+    if (!writer->chunked) {
+        if (writer->sink) {
+            return writer->sink->send(writer->sink, writer->buf, writer->len);
+        }
+        return httpd_resp_send(writer->req, writer->buf, writer->len);
+    }
+    resp_writer_flush(writer);
+    if (writer->err != ESP_OK) {
+        return writer->err;
+    }
+    return send_chunk(writer, NULL, 0);
+}
@@ -0,0 +1,46 @@
+#ifndef _RESP_WRITER_H_
+#define _RESP_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_http_server.h"
+
+#define RESP_WRITER_BUF_SIZE    512
+
+/*
+ * Where a response goes when there is no httpd_req_t to send it with, e.g. on an
+ * async worker (see async-handler.h). The calls mirror httpd_resp_send() and
+ * httpd_resp_send_chunk(): the first one sends the head, a chunk of length 0 ends the body.
+ */
+typedef struct resp_sink {
+    esp_err_t (*send)(struct resp_sink *sink, const char *buf, size_t len);
+    esp_err_t (*send_chunk)(struct resp_sink *sink, const char *buf, size_t len);
+} resp_sink_t;
+
+/*
+ * Buffers a response body and sends it with chunked encoding whenever the buffer
+ * fills, so a handler can write any amount with a fixed stack footprint. A body
+ * which fits in the buffer is sent as a plain response with a Content-Length. The
+ * first send error sticks and is returned by resp_writer_finish().
+ */
+typedef struct {
+    httpd_req_t *req;
+    resp_sink_t *sink;  // used instead of req if set
+    esp_err_t err;
+    bool chunked;       // part of the body was sent already
+    size_t len;
+    char buf[RESP_WRITER_BUF_SIZE];
+} resp_writer_t;
+
+void resp_writer_init(resp_writer_t *writer, httpd_req_t *req);
+void resp_writer_init_sink(resp_writer_t *writer, resp_sink_t *sink);
+
+void resp_writer_write(resp_writer_t *writer, const char *data, size_t len);
+
+/* printf into the buffer, a single call must not produce more than RESP_WRITER_BUF_SIZE - 1 bytes */
+void resp_writer_printf(resp_writer_t *writer, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Sends what is left and completes the response */
+esp_err_t resp_writer_finish(resp_writer_t *writer);
+
+#endif
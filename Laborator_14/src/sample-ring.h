@@ -0,0 +1,70 @@
+#ifndef _SAMPLE_RING_H_
+#define _SAMPLE_RING_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SAMPLE_RING_LEN 8
+
+typedef struct {
+    int64_t timestamp_us;   // esp_timer_get_time() when the sample was taken
+    float value;
+} sensor_sample_t;
+
+typedef struct {
+    atomic_uint seq;        // odd while the slot is being written
+    sensor_sample_t sample;
+} sample_slot_t;
+
+/*
+ * Single producer / multiple consumer ring of the last samples of a sensor.
+ * The producer never waits for readers, a reader that raced with the producer
+ * sees the slot's sequence number change and takes an older slot.
+ */
+typedef struct {
+    atomic_uint written;    // number of samples pushed so far
+    sample_slot_t slots[SAMPLE_RING_LEN];
+} sample_ring_t;
+
+/* Only to be called from the single producer */
+static inline void sample_ring_push(sample_ring_t *ring, const sensor_sample_t *sample) {
+    unsigned n = atomic_load_explicit(&ring->written, memory_order_relaxed);
+    sample_slot_t *slot = &ring->slots[n % SAMPLE_RING_LEN];
+    unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->sample = *sample;
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&ring->written, n + 1, memory_order_release);
+}
+
+/*
+ * Copies the newest sample, false if nothing was pushed yet. Never waits for the
+ * producer: the readers may outrank it, so a producer preempted in the middle of a
+ * slot would not get to finish it while a reader spins. A slot caught being written
+ * is skipped for the one before it, which the producer is not touching.
+ */
+static inline bool sample_ring_latest(sample_ring_t *ring, sensor_sample_t *sample) {
+    unsigned n = atomic_load_explicit(&ring->written, memory_order_acquire);
+    for (unsigned back = 1; back <= n && back < SAMPLE_RING_LEN; back++) {
+        sample_slot_t *slot = &ring->slots[(n - back) % SAMPLE_RING_LEN];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        *sample = slot->sample;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline unsigned sample_ring_count(sample_ring_t *ring) {
+    return atomic_load_explicit(&ring->written, memory_order_acquire);
+}
+
+#endif
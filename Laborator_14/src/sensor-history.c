@@ -0,0 +1,319 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+#include "sensor-history.h"
+
+typedef struct {
+    uint32_t width_ms;
+    uint16_t capacity;
+} history_level_cfg_t;
+
+static const history_level_cfg_t s_levels[HISTORY_LEVELS] = {
+    { 10 * 1000,      360 },    // 10 s buckets for 1 hour
+    { 60 * 1000,      720 },    // 1 min buckets for 12 hours
+    { 15 * 60 * 1000, 672 },    // 15 min buckets for 7 days
+};
+
+/*
+ * Closed bucket, 12 bytes instead of 16 for min/max/avg as floats and the count. The
+ * average stays a float, min and max are stored as half precision distances from it,
+ * which keeps them within 0.05% of the bucket's spread.
+ */
+typedef struct {
+    float avg;
+    uint32_t count;     // samples in the bucket, 0 if it is empty
+    uint16_t below;     // avg - min
+    uint16_t above;     // max - avg
+} history_bucket_t;
+
+typedef struct {
+    uint32_t head;              // index (time / width) of the open bucket
+    bool started;
+    uint32_t open_count;        // the open bucket is kept in full precision
+    float open_min;
+    float open_max;
+    float open_avg;
+    history_bucket_t *buckets;
+} history_level_t;
+
+struct sensor_history {
+    history_level_t levels[HISTORY_LEVELS];
+};
+
+static SemaphoreHandle_t s_history_lock = NULL;
+
+static uint16_t half_from_float(float value) {
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    int32_t exp = (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = x & 0x7FFFFF;
+
+    if (((x >> 23) & 0xFF) == 0xFF || exp >= 31) {
+        return sign | 0x7C00;   // spreads are never NaN, saturate to infinity
+    }
+    if (exp <= 0) {
+        if (exp < -10) {
+            return sign;
+        }
+        mant |= 0x800000;
+        uint32_t shift = 14 - exp;
+        uint32_t half = mant >> shift;
+        if ((mant >> (shift - 1)) & 1) {
+            half++;
+        }
+        return sign | half;
+    }
+    uint32_t half = sign | ((uint32_t)exp << 10) | (mant >> 13);
+    if (mant & 0x1000) {
+        half++;     // a carry into the exponent is still the right rounding
+    }
+    return half;
+}
+
+static float half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exp = (half >> 10) & 0x1F;
+    uint32_t mant = half & 0x3FF;
+    uint32_t x;
+
+    if (exp == 0) {
+        if (mant == 0) {
+            x = sign;
+        } else {
+            exp = 127 - 15 + 1;
+            while (!(mant & 0x400)) {
+                mant <<= 1;
+                exp--;
+            }
+            x = sign | (exp << 23) | ((mant & 0x3FF) << 13);
+        }
+    } else if (exp == 31) {
+        x = sign | 0x7F800000 | (mant << 13);
+    } else {
+        x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+    }
+    float value;
+    memcpy(&value, &x, sizeof(value));
+    return value;
+}
+
+static void *history_alloc(size_t size) {
+    void *p = NULL;
+#if defined(CONFIG_SPIRAM) || defined(BOARD_HAS_PSRAM)
+    p = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+    if (!p) {
+        p = calloc(1, size);
+    }
+    return p;
+}
+
+static sensor_history_t *history_new(void) {
+    size_t buckets = 0;
+    for (int i = 0; i < HISTORY_LEVELS; i++) {
+        buckets += s_levels[i].capacity;
+    }
+    sensor_history_t *history = calloc(1, sizeof(sensor_history_t));
+    history_bucket_t *storage = history_alloc(buckets * sizeof(history_bucket_t));
+    if (!history || !storage) {
+        free(history);
+        free(storage);
+        return NULL;
+    }
+    for (int i = 0; i < HISTORY_LEVELS; i++) {
+        history->levels[i].buckets = storage;
+        storage += s_levels[i].capacity;
+    }
+    return history;
+}
+
+static void level_close_open_bucket(history_level_t *level, const history_level_cfg_t *cfg) {
+    history_bucket_t *bucket = &level->buckets[level->head % cfg->capacity];
+    bucket->count = level->open_count;
+    if (level->open_count == 0) {
+        return;
+    }
+    bucket->avg = level->open_avg;
+    bucket->below = half_from_float(level->open_avg - level->open_min);
+    bucket->above = half_from_float(level->open_max - level->open_avg);
+}
+
+static void level_add(history_level_t *level, const history_level_cfg_t *cfg, int64_t time_ms, float value) {
+    uint32_t index = time_ms / cfg->width_ms;
+    if (!level->started) {
+        level->started = true;
+        level->head = index;
+        for (int i = 0; i < cfg->capacity; i++) {
+            level->buckets[i].count = 0;
+        }
+    }
+    if (index != level->head) {
+        level_close_open_bucket(level, cfg);
+        // buckets skipped while no sample came in are empty
+        uint32_t gap = index - level->head;
+        for (uint32_t i = 1; i < gap && i <= cfg->capacity; i++) {
+            level->buckets[(level->head + i) % cfg->capacity].count = 0;
+        }
+        level->head = index;
+        level->open_count = 0;
+    }
+
+    if (level->open_count == 0) {
+        level->open_min = value;
+        level->open_max = value;
+        level->open_avg = value;
+    } else {
+        level->open_min = value < level->open_min ? value : level->open_min;
+        level->open_max = value > level->open_max ? value : level->open_max;
+        level->open_avg += (value - level->open_avg) / (level->open_count + 1);
+    }
+    level->open_count++;
+}
+
+esp_err_t sensor_history_init(void) {
+    if (s_history_lock) {
+        return ESP_OK;
+    }
+    s_history_lock = xSemaphoreCreateMutex();
+    return s_history_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t sensor_history_add(sensor_t *sensor, const sensor_sample_t *sample) {
+    if (!s_history_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!sensor->history) {
+        sensor_history_t *history = history_new();
+        if (!history) {
+            return ESP_ERR_NO_MEM;
+        }
+        xSemaphoreTake(s_history_lock, portMAX_DELAY);
+        sensor->history = history;
+        xSemaphoreGive(s_history_lock);
+    }
+
+    int64_t time_ms = sample->timestamp_us / 1000;
+    xSemaphoreTake(s_history_lock, portMAX_DELAY);
+    for (int i = 0; i < HISTORY_LEVELS; i++) {
+        level_add(&sensor->history->levels[i], &s_levels[i], time_ms, sample->value);
+    }
+    xSemaphoreGive(s_history_lock);
+    return ESP_OK;
+}
+
+esp_err_t sensor_history_query_init(history_query_t *query, sensor_t *sensor, int64_t from_ms, int64_t to_ms, int64_t step_ms) {
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    if (from_ms < 0 || to_ms <= from_ms || from_ms > now_ms) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // nothing is kept from before the coarsest level's range nor from the future
+    int64_t oldest_ms = now_ms - (int64_t)s_levels[HISTORY_LEVELS - 1].width_ms * s_levels[HISTORY_LEVELS - 1].capacity;
+    if (from_ms < oldest_ms) {
+        from_ms = oldest_ms;
+    }
+    if (to_ms > now_ms + 1) {
+        to_ms = now_ms + 1;
+    }
+    if (step_ms < s_levels[0].width_ms) {
+        step_ms = s_levels[0].width_ms;
+    }
+
+    // the finest level still holding from_ms, then the coarsest whose buckets fit in a step
+    int level = 0;
+    while (level < HISTORY_LEVELS - 1 &&
+           from_ms < now_ms - (int64_t)s_levels[level].width_ms * s_levels[level].capacity) {
+        level++;
+    }
+    while (level < HISTORY_LEVELS - 1 && s_levels[level + 1].width_ms <= step_ms) {
+        level++;
+    }
+
+    int64_t width = s_levels[level].width_ms;
+    from_ms -= from_ms % width;
+    step_ms = (step_ms + width - 1) / width * width;
+    if ((to_ms - from_ms + step_ms - 1) / step_ms > HISTORY_MAX_POINTS) {
+        step_ms = (to_ms - from_ms + HISTORY_MAX_POINTS - 1) / HISTORY_MAX_POINTS;
+        step_ms = (step_ms + width - 1) / width * width;
+    }
+
+    query->sensor = sensor;
+    query->level = level;
+    query->from_ms = from_ms;
+    query->to_ms = to_ms;
+    query->step_ms = step_ms;
+    query->next_ms = from_ms;
+    return ESP_OK;
+}
+
+/*
+ * Merges the level's buckets covering [start_ms, start_ms + step_ms) into point, call with the
+ * lock held. The point's average is weighted by the samples in each bucket.
+ */
+static void level_collect(const history_level_t *level, const history_level_cfg_t *cfg,
+                          int64_t start_ms, int64_t step_ms, history_point_t *point) {
+    int64_t first = start_ms / cfg->width_ms;
+    int64_t last = (start_ms + step_ms) / cfg->width_ms;    // exclusive
+    int64_t oldest = level->head >= cfg->capacity ? level->head - cfg->capacity + 1 : 0;
+    double sum = 0;
+    uint32_t samples = 0;
+
+    point->start_ms = start_ms;
+    point->count = 0;
+    for (int64_t index = first < oldest ? oldest : first; index < last && index <= level->head; index++) {
+        float avg, min, max;
+        uint32_t count;
+        if (index == level->head) {
+            avg = level->open_avg;
+            min = level->open_min;
+            max = level->open_max;
+            count = level->open_count;
+        } else {
+            const history_bucket_t *bucket = &level->buckets[index % cfg->capacity];
+            avg = bucket->avg;
+            min = avg - half_to_float(bucket->below);
+            max = avg + half_to_float(bucket->above);
+            count = bucket->count;
+        }
+        if (count == 0) {
+            continue;
+        }
+        if (point->count == 0 || min < point->min) {
+            point->min = min;
+        }
+        if (point->count == 0 || max > point->max) {
+            point->max = max;
+        }
+        sum += (double)avg * count;
+        samples += count;
+        point->count++;
+    }
+    if (point->count) {
+        point->avg = sum / samples;
+    }
+}
+
+bool sensor_history_query_next(history_query_t *query, history_point_t *point) {
+    while (query->next_ms < query->to_ms) {
+        int64_t start_ms = query->next_ms;
+        query->next_ms += query->step_ms;
+
+        xSemaphoreTake(s_history_lock, portMAX_DELAY);
+        sensor_history_t *history = query->sensor->history;
+        if (!history || !history->levels[query->level].started) {
+            xSemaphoreGive(s_history_lock);
+            return false;
+        }
+        level_collect(&history->levels[query->level], &s_levels[query->level], start_ms, query->step_ms, point);
+        xSemaphoreGive(s_history_lock);
+
+        if (point->count) {
+            return true;
+        }
+    }
+    return false;
+}
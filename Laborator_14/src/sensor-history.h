@@ -0,0 +1,53 @@
+#ifndef _SENSOR_HISTORY_H_
+#define _SENSOR_HISTORY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "sensor-registry.h"
+
+#define HISTORY_LEVELS      3
+#define HISTORY_MAX_POINTS  500
+
+/* One aggregated point of a history query, times in ms since boot */
+typedef struct {
+    int64_t start_ms;
+    float min;
+    float max;
+    float avg;          // weighted by the samples in each bucket
+    uint32_t count;     // rollup buckets merged into the point
+} history_point_t;
+
+typedef struct {
+    sensor_t *sensor;
+    int level;
+    int64_t from_ms;
+    int64_t to_ms;
+    int64_t step_ms;
+    int64_t next_ms;
+} history_query_t;
+
+/* Creates the lock guarding the stores, called by the sampler before it starts */
+esp_err_t sensor_history_init(void);
+
+/*
+ * Adds a sample to the sensor's rollups. Called from the sampler task, the store
+ * is allocated on the first sample (from PSRAM if available).
+ */
+esp_err_t sensor_history_add(sensor_t *sensor, const sensor_sample_t *sample);
+
+/*
+ * Prepares a query over [from_ms, to_ms) with points step_ms wide. A range starting in
+ * the future is rejected, the range is clamped to what the rollups hold. Uses the finest
+ * rollup which still holds from_ms, or a coarser one if its buckets fit in a step,
+ * then rounds the step up to a multiple of the bucket width and, if needed, widens
+ * it so the query returns at most HISTORY_MAX_POINTS points. The adjusted range and
+ * step are left in the query.
+ */
+esp_err_t sensor_history_query_init(history_query_t *query, sensor_t *sensor, int64_t from_ms, int64_t to_ms, int64_t step_ms);
+
+/* Next non-empty point of the query, false when done */
+bool sensor_history_query_next(history_query_t *query, history_point_t *point);
+
+#endif
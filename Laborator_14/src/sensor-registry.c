@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "sensor-registry.h"
+
+/* Open addressing index over the registered sensors, twice as many slots as sensors */
+#define SENSOR_INDEX_SLOTS  (2 * SENSOR_REGISTRY_MAX)
+#define SENSOR_INDEX_EMPTY  UINT16_MAX
+
+static sensor_t *s_sensors[SENSOR_REGISTRY_MAX];
+static size_t s_sensor_count = 0;
+static uint16_t s_index[SENSOR_INDEX_SLOTS];
+static bool s_index_ready = false;
+static SemaphoreHandle_t s_config_lock = NULL;
+
+static uint32_t sensor_hash(const char *id, size_t len) {
+    uint32_t hash = 2166136261u;    // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)id[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool sensor_id_equals(const sensor_t *sensor, const char *id, size_t len) {
+    return strncmp(sensor->id, id, len) == 0 && sensor->id[len] == '\0';
+}
+
+esp_err_t sensor_register(const char *id, const sensor_driver_t *driver, void *ctx, uint32_t period_ms) {
+    size_t len = id ? strlen(id) : 0;
+    if (len == 0 || len > SENSOR_ID_MAX_LEN || !driver || !driver->read || period_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_index_ready) {
+        s_config_lock = xSemaphoreCreateMutex();
+        if (!s_config_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+        memset(s_index, 0xFF, sizeof(s_index));
+        s_index_ready = true;
+    }
+    if (sensor_find(id, len)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_sensor_count == SENSOR_REGISTRY_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    sensor_t *sensor = calloc(1, sizeof(sensor_t));
+    if (!sensor) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(sensor->id, id, len + 1);
+    sensor->driver = driver;
+    sensor->ctx = ctx;
+    sensor->period_ms = period_ms;
+
+    uint32_t slot = sensor_hash(id, len) % SENSOR_INDEX_SLOTS;
+    while (s_index[slot] != SENSOR_INDEX_EMPTY) {
+        slot = (slot + 1) % SENSOR_INDEX_SLOTS;
+    }
+    s_index[slot] = s_sensor_count;
+    s_sensors[s_sensor_count++] = sensor;
+    return ESP_OK;
+}
+
+sensor_t *sensor_find(const char *id, size_t len) {
+    if (!s_index_ready || len == 0 || len > SENSOR_ID_MAX_LEN) {
+        return NULL;
+    }
+    uint32_t slot = sensor_hash(id, len) % SENSOR_INDEX_SLOTS;
+    while (s_index[slot] != SENSOR_INDEX_EMPTY) {
+        sensor_t *sensor = s_sensors[s_index[slot]];
+        if (sensor_id_equals(sensor, id, len)) {
+            return sensor;
+        }
+        slot = (slot + 1) % SENSOR_INDEX_SLOTS;
+    }
+    return NULL;
+}
+
+size_t sensor_count(void) {
+    return s_sensor_count;
+}
+
+sensor_t *sensor_at(size_t index) {
+    return index < s_sensor_count ? s_sensors[index] : NULL;
+}
+
+esp_err_t sensor_read(sensor_t *sensor, float *value) {
+    return sensor->driver->read(sensor->ctx, value);
+}
+
+bool sensor_latest(sensor_t *sensor, sensor_sample_t *sample) {
+    return sample_ring_latest(&sensor->samples, sample);
+}
+
+/* Call with s_config_lock held */
+static esp_err_t sensor_config_store(sensor_t *sensor, const char *data, size_t len) {
+    if (!sensor->config) {
+        sensor->config = malloc(SENSOR_CONFIG_MAX_LEN);
+        if (!sensor->config) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    sensor->config_len = len < SENSOR_CONFIG_MAX_LEN ? len : SENSOR_CONFIG_MAX_LEN;
+    if (sensor->config_len) {
+        memcpy(sensor->config, data, sensor->config_len);
+    }
+    sensor->has_config = true;
+    sensor->config_version++;
+    return ESP_OK;
+}
+
+esp_err_t sensor_config_create(sensor_t *sensor, const char *data, size_t len) {
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(s_config_lock, portMAX_DELAY);
+    if (!sensor->has_config) {
+        err = sensor_config_store(sensor, data, len);
+        sensor->config_dirty = err == ESP_OK;
+    }
+    xSemaphoreGive(s_config_lock);
+    return err;
+}
+
+esp_err_t sensor_config_update(sensor_t *sensor, const char *data, size_t len) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(s_config_lock, portMAX_DELAY);
+    if (sensor->has_config) {
+        err = sensor_config_store(sensor, data, len);
+        sensor->config_dirty = true;
+    }
+    xSemaphoreGive(s_config_lock);
+    return err;
+}
+
+bool sensor_config_get(sensor_t *sensor, char *buf, size_t *len, uint32_t *version) {
+    bool has_config;
+    xSemaphoreTake(s_config_lock, portMAX_DELAY);
+    has_config = sensor->has_config;
+    if (has_config && buf) {
+        memcpy(buf, sensor->config, sensor->config_len);
+        *len = sensor->config_len;
+    }
+    if (has_config) {
+        *version = sensor->config_version;
+    }
+    xSemaphoreGive(s_config_lock);
+    return has_config;
+}
+
+esp_err_t sensor_config_restore(sensor_t *sensor, const char *data, size_t len) {
+    xSemaphoreTake(s_config_lock, portMAX_DELAY);
+    esp_err_t err = sensor_config_store(sensor, data, len);
+    xSemaphoreGive(s_config_lock);
+    return err;
+}
+
+bool sensor_config_take_dirty(sensor_t *sensor, char *buf, size_t *len) {
+    bool dirty;
+    xSemaphoreTake(s_config_lock, portMAX_DELAY);
+    dirty = sensor->config_dirty;
+    if (dirty) {
+        memcpy(buf, sensor->config, sensor->config_len);
+        *len = sensor->config_len;
+        sensor->config_dirty = false;
+    }
+    xSemaphoreGive(s_config_lock);
+    return dirty;
+}
+
+void sensor_config_mark_dirty(sensor_t *sensor) {
+    xSemaphoreTake(s_config_lock, portMAX_DELAY);
+    sensor->config_dirty = true;
+    xSemaphoreGive(s_config_lock);
+}
@@ -0,0 +1,82 @@
+#ifndef _SENSOR_REGISTRY_H_
+#define _SENSOR_REGISTRY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "sample-ring.h"
+
+#define SENSOR_ID_MAX_LEN       15
+#define SENSOR_CONFIG_MAX_LEN   512
+#define SENSOR_REGISTRY_MAX     256
+
+/* Callbacks of a sensor type, ctx is the per-sensor pointer given to sensor_register() */
+typedef struct {
+    const char *name;
+    esp_err_t (*read)(void *ctx, float *value);
+} sensor_driver_t;
+
+typedef struct sensor_history sensor_history_t;
+
+typedef struct {
+    char id[SENSOR_ID_MAX_LEN + 1];
+    const sensor_driver_t *driver;
+    void *ctx;
+    uint32_t period_ms;         // sampling period
+    int64_t next_sample_us;     // owned by the sampler task
+    sample_ring_t samples;
+    sensor_history_t *history;  // rollups, allocated by the sampler on the first sample
+    bool has_config;
+    bool config_dirty;          // changed since it was last persisted
+    uint32_t config_version;    // bumped on every change, used for the ETag
+    size_t config_len;
+    char *config;               // SENSOR_CONFIG_MAX_LEN bytes, allocated with the first config
+} sensor_t;
+
+/*
+ * Sensors are registered at boot, before the web server starts, and never removed,
+ * so lookups need no locking. A config buffer is only allocated for the sensors
+ * which get a config, a registry of sensors without one stays small. The config is changed from the httpd task and read
+ * by the config store, the sensor_config_* functions take a lock.
+ */
+esp_err_t sensor_register(const char *id, const sensor_driver_t *driver, void *ctx, uint32_t period_ms);
+
+/* Lookup by id, len is the id length (the id does not need to be NUL terminated) */
+sensor_t *sensor_find(const char *id, size_t len);
+
+size_t sensor_count(void);
+sensor_t *sensor_at(size_t index);
+
+/* Reads the sensor through its driver, only the sampler task should call this */
+esp_err_t sensor_read(sensor_t *sensor, float *value);
+
+/* Latest sample taken by the sampler task, false if there is none yet */
+bool sensor_latest(sensor_t *sensor, sensor_sample_t *sample);
+
+/* ESP_ERR_INVALID_STATE if the sensor has a config already, ESP_ERR_NO_MEM if there is no room for it */
+esp_err_t sensor_config_create(sensor_t *sensor, const char *data, size_t len);
+
+/* ESP_ERR_NOT_FOUND if the sensor has no config yet */
+esp_err_t sensor_config_update(sensor_t *sensor, const char *data, size_t len);
+
+/*
+ * Copies the config into buf (SENSOR_CONFIG_MAX_LEN bytes) and its version, false if
+ * the sensor has none. buf may be NULL to only get the version.
+ */
+bool sensor_config_get(sensor_t *sensor, char *buf, size_t *len, uint32_t *version);
+
+/* Sets a config loaded from flash, it is not marked dirty. ESP_ERR_NO_MEM if there is no room for it */
+esp_err_t sensor_config_restore(sensor_t *sensor, const char *data, size_t len);
+
+/*
+ * Copies the config into buf (SENSOR_CONFIG_MAX_LEN bytes) and clears the dirty flag.
+ * False if the config has not changed since the last call.
+ */
+bool sensor_config_take_dirty(sensor_t *sensor, char *buf, size_t *len);
+
+/* Marks the config dirty again after taking it failed to reach flash, the next flush retries it */
+void sensor_config_mark_dirty(sensor_t *sensor);
+
+#endif
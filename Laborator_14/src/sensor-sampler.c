@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "sensor-registry.h"
+#include "sensor-history.h"
+#include "sensor-sampler.h"
+
+static const char *TAG = "SAMPLER";
+
+/* Min-heap of the sensors ordered by their next sample time */
+static sensor_t **s_heap = NULL;
+static size_t s_heap_len = 0;
+
+static void heap_swap(size_t a, size_t b) {
+    sensor_t *tmp = s_heap[a];
+    s_heap[a] = s_heap[b];
+    s_heap[b] = tmp;
+}
+
+static void heap_sift_up(size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (s_heap[parent]->next_sample_us <= s_heap[i]->next_sample_us) {
+            break;
+        }
+        heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+static void heap_sift_down(size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < s_heap_len && s_heap[left]->next_sample_us < s_heap[smallest]->next_sample_us) {
+            smallest = left;
+        }
+        if (right < s_heap_len && s_heap[right]->next_sample_us < s_heap[smallest]->next_sample_us) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void sample_sensor(sensor_t *sensor) {
+    sensor_sample_t sample;
+    if (sensor_read(sensor, &sample.value) != ESP_OK) {
+        ESP_LOGW(TAG, "Reading sensor %s failed", sensor->id);
+        return;
+    }
+    sample.timestamp_us = esp_timer_get_time();
+    sample_ring_push(&sensor->samples, &sample);
+    if (sensor_history_add(sensor, &sample) != ESP_OK) {
+        ESP_LOGW(TAG, "No memory for the history of sensor %s", sensor->id);
+    }
+}
+
+static void sampler_task(void *arg) {
+    for (;;) {
+        sensor_t *sensor = s_heap[0];
+        int64_t now = esp_timer_get_time();
+        if (sensor->next_sample_us > now) {
+            TickType_t ticks = ((sensor->next_sample_us - now) / 1000 + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+            vTaskDelay(ticks ? ticks : 1);
+            continue;
+        }
+
+        sample_sensor(sensor);
+
+        // a slow read must not make the sensor catch up with a burst of samples
+        sensor->next_sample_us += (int64_t)sensor->period_ms * 1000;
+        if (sensor->next_sample_us <= now) {
+            sensor->next_sample_us = now + (int64_t)sensor->period_ms * 1000;
+        }
+        heap_sift_down(0);
+    }
+}
+
+esp_err_t sensor_sampler_start(void) {
+    if (s_heap) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t count = sensor_count();
+    if (count == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_err_t err = sensor_history_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_heap = malloc(count * sizeof(sensor_t *));
+    if (!s_heap) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < count; i++) {
+        sensor_t *sensor = sensor_at(i);
+        sensor->next_sample_us = now;
+        s_heap[s_heap_len++] = sensor;
+        heap_sift_up(s_heap_len - 1);
+    }
+
+    if (xTaskCreate(sampler_task, "sampler", SAMPLER_TASK_STACK_SIZE, NULL, SAMPLER_TASK_PRIORITY, NULL) != pdPASS) {
+        free(s_heap);
+        s_heap = NULL;
+        s_heap_len = 0;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,15 @@
+#ifndef _SENSOR_SAMPLER_H_
+#define _SENSOR_SAMPLER_H_
+
+#include "esp_err.h"
+
+#define SAMPLER_TASK_STACK_SIZE 3072
+#define SAMPLER_TASK_PRIORITY   4
+
+/*
+ * Starts the task which reads every registered sensor at its period and pushes the
+ * samples into the sensor's ring. Call once, after all sensors are registered.
+ */
+esp_err_t sensor_sampler_start(void);
+
+#endif
@@ -0,0 +1,307 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "sensor-registry.h"
+#include "sensor-stream.h"
+
+static const char *TAG = "STREAM";
+
+/* Client state, only touched from the httpd task (handlers and queued work) */
+typedef struct {
+    int fd;                     // -1 when the slot is free
+    uint32_t interval_ms;
+    int64_t next_push_us;
+    size_t count;
+    sensor_t **sensors;         // subscribed sensors
+    unsigned *seen;             // sample count of each sensor at the last push
+} stream_client_t;
+
+static httpd_handle_t s_server = NULL;
+static stream_client_t s_clients[STREAM_MAX_CLIENTS];
+static atomic_int s_client_count;
+static atomic_bool s_push_queued;
+static char s_frame[STREAM_FRAME_SIZE];
+
+static stream_client_t *client_find(int fd) {
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (s_clients[i].fd == fd) {
+            return &s_clients[i];
+        }
+    }
+    return NULL;
+}
+
+static void client_free(stream_client_t *client) {
+    if (client->fd < 0) {
+        return;
+    }
+    free(client->sensors);
+    client->sensors = NULL;
+    client->seen = NULL;
+    client->count = 0;
+    client->fd = -1;
+    atomic_fetch_sub(&s_client_count, 1);
+}
+
+/* Applies "ids=1,2&interval_ms=500" to the client, unknown ids are ignored */
+static esp_err_t client_subscribe(stream_client_t *client, const char *query) {
+    char *ids = NULL;
+    size_t count = 0;
+    if (query) {
+        size_t len = strlen(query) + 1;
+        ids = malloc(len);
+        if (!ids) {
+            return ESP_ERR_NO_MEM;
+        }
+        if (httpd_query_key_value(query, "ids", ids, len) != ESP_OK) {
+            free(ids);
+            ids = NULL;
+        }
+    }
+    if (ids) {
+        count = 1;
+        for (const char *p = ids; *p; p++) {
+            count += *p == ',';
+        }
+    } else {
+        count = sensor_count();
+    }
+
+    // one block for both arrays, freed through client->sensors
+    sensor_t **sensors = malloc(count * (sizeof(sensor_t *) + sizeof(unsigned)) + 1);
+    if (!sensors) {
+        free(ids);
+        return ESP_ERR_NO_MEM;
+    }
+    unsigned *seen = (unsigned *)(sensors + count);
+    size_t n = 0;
+    if (ids) {
+        char *save;
+        for (char *id = strtok_r(ids, ",", &save); id; id = strtok_r(NULL, ",", &save)) {
+            sensor_t *sensor = sensor_find(id, strlen(id));
+            if (sensor) {
+                sensors[n++] = sensor;
+            }
+        }
+        free(ids);
+    } else {
+        for (; n < count; n++) {
+            sensors[n] = sensor_at(n);
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        seen[i] = 0;    // the first push sends every sensor that has a sample
+    }
+
+    uint32_t interval_ms = client->fd >= 0 && client->sensors ? client->interval_ms : STREAM_DEFAULT_INTERVAL_MS;
+    char value[12];
+    if (query && httpd_query_key_value(query, "interval_ms", value, sizeof(value)) == ESP_OK) {
+        interval_ms = strtoul(value, NULL, 10);
+        interval_ms = interval_ms < STREAM_MIN_INTERVAL_MS ? STREAM_MIN_INTERVAL_MS : interval_ms;
+    }
+
+    free(client->sensors);
+    client->sensors = sensors;
+    client->seen = seen;
+    client->count = n;
+    client->interval_ms = interval_ms;
+    client->next_push_us = 0;
+    return ESP_OK;
+}
+
+static esp_err_t send_frame(int fd, size_t len) {
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)s_frame,
+        .len = len,
+    };
+    return httpd_ws_send_frame_async(s_server, fd, &frame);
+}
+
+/* Sends the client's changed sensors, split over several frames if they do not fit in one */
+static esp_err_t client_push(stream_client_t *client) {
+    static const char head[] = "{\"sensors\": [";
+    size_t len = 0;
+    for (size_t i = 0; i < client->count; i++) {
+        sensor_t *sensor = client->sensors[i];
+        unsigned written = sample_ring_count(&sensor->samples);
+        sensor_sample_t sample;
+        if (written == client->seen[i] || !sensor_latest(sensor, &sample)) {
+            continue;
+        }
+
+        char item[80];
+        int item_len;
+        if (isfinite(sample.value)) {
+            item_len = snprintf(item, sizeof(item), "{\"sensor_id\": \"%s\", \"value\": %.2f, \"ts\": %lld}",
+                                sensor->id, sample.value, (long long)(sample.timestamp_us / 1000));
+        } else {
+            // JSON has no nan or inf, as in the REST responses
+            item_len = snprintf(item, sizeof(item), "{\"sensor_id\": \"%s\", \"value\": null, \"ts\": %lld}",
+                                sensor->id, (long long)(sample.timestamp_us / 1000));
+        }
+        client->seen[i] = written;
+        if (item_len < 0 || item_len >= (int)sizeof(item)) {
+            ESP_LOGD(TAG, "Skipping a sample of sensor %s, too long for a frame item", sensor->id);
+            continue;
+        }
+        if (len && len + 2 + item_len + 2 > sizeof(s_frame)) {
+            memcpy(s_frame + len, "]}", 2);
+            esp_err_t err = send_frame(client->fd, len + 2);
+            if (err != ESP_OK) {
+                return err;
+            }
+            len = 0;
+        }
+        if (len == 0) {
+            memcpy(s_frame, head, sizeof(head) - 1);
+            len = sizeof(head) - 1;
+        } else {
+            memcpy(s_frame + len, ", ", 2);
+            len += 2;
+        }
+        memcpy(s_frame + len, item, item_len);
+        len += item_len;
+    }
+    if (len == 0) {
+        return ESP_OK;
+    }
+    memcpy(s_frame + len, "]}", 2);
+    return send_frame(client->fd, len + 2);
+}
+
+static void push_work(void *arg) {
+    atomic_store(&s_push_queued, false);
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        stream_client_t *client = &s_clients[i];
+        if (client->fd < 0 || now < client->next_push_us) {
+            continue;
+        }
+        if (httpd_ws_get_fd_info(s_server, client->fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            client_free(client);
+            continue;
+        }
+        if (client_push(client) != ESP_OK) {
+            ESP_LOGW(TAG, "Dropping client %d", client->fd);
+            client_free(client);
+            continue;
+        }
+        client->next_push_us = now + (int64_t)client->interval_ms * 1000;
+    }
+}
+
+static void tick_callback(void *arg) {
+    // at most one push in the httpd queue, a slow client must not make them pile up
+    if (atomic_load(&s_client_count) == 0 || atomic_exchange(&s_push_queued, true)) {
+        return;
+    }
+    if (httpd_queue_work(s_server, push_work, NULL) != ESP_OK) {
+        atomic_store(&s_push_queued, false);
+    }
+}
+
+static esp_err_t stream_handshake(httpd_req_t *req) {
+    int fd = httpd_req_to_sockfd(req);
+    stream_client_t *client = client_find(fd);
+    if (!client) {
+        // a closed client's slot is only released by the next push, check them now
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            if (s_clients[i].fd >= 0 && httpd_ws_get_fd_info(s_server, s_clients[i].fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+                client_free(&s_clients[i]);
+            }
+        }
+        client = client_find(-1);
+        if (!client) {
+            ESP_LOGW(TAG, "Too many stream clients");
+            return ESP_FAIL;
+        }
+        client->fd = fd;
+        atomic_fetch_add(&s_client_count, 1);
+    }
+
+    char *query = NULL;
+    size_t query_len = httpd_req_get_url_query_len(req);
+    if (query_len) {
+        query = malloc(query_len + 1);
+        if (query && httpd_req_get_url_query_str(req, query, query_len + 1) != ESP_OK) {
+            free(query);
+            query = NULL;
+        }
+    }
+    esp_err_t err = client_subscribe(client, query);
+    free(query);
+    if (err != ESP_OK) {
+        client_free(client);
+    }
+    return err;
+}
+
+static esp_err_t stream_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) {
+        return stream_handshake(req);
+    }
+
+    httpd_ws_frame_t frame = { .type = HTTPD_WS_TYPE_TEXT };
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // the payload is read even for the frames we ignore, the next frame starts after it
+    int fd = httpd_req_to_sockfd(req);
+    if (frame.len >= sizeof(s_frame)) {
+        ESP_LOGW(TAG, "Closing client %d, frame of %u bytes", fd, (unsigned)frame.len);
+        return ESP_FAIL;    // the server closes the socket
+    }
+    // pushes run on this same task, s_frame is free until the handler returns
+    frame.payload = (uint8_t *)s_frame;
+    err = httpd_ws_recv_frame(req, &frame, sizeof(s_frame) - 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (frame.type != HTTPD_WS_TYPE_TEXT) {
+        return ESP_OK;
+    }
+    s_frame[frame.len] = '\0';
+
+    stream_client_t *client = client_find(fd);
+    return client ? client_subscribe(client, s_frame) : ESP_OK;
+}
+
+esp_err_t sensor_stream_register(httpd_handle_t server) {
+    if (s_server) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_server = server;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        s_clients[i].fd = -1;
+    }
+
+    httpd_uri_t uri = {
+        .uri          = "/ws",
+        .method       = HTTP_GET,
+        .handler      = stream_handler,
+        .is_websocket = true,
+    };
+    esp_err_t err = httpd_register_uri_handler(server, &uri);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = tick_callback,
+        .name = "stream",
+    };
+    esp_timer_handle_t timer;
+    err = esp_timer_create(&timer_args, &timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_timer_start_periodic(timer, STREAM_TICK_MS * 1000);
+}
@@ -0,0 +1,29 @@
+#ifndef _SENSOR_STREAM_H_
+#define _SENSOR_STREAM_H_
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define STREAM_MAX_CLIENTS          4
+#define STREAM_TICK_MS              100     // how often new samples are looked for
+#define STREAM_MIN_INTERVAL_MS      100
+#define STREAM_DEFAULT_INTERVAL_MS  1000
+#define STREAM_FRAME_SIZE           1024
+
+/*
+ * WebSocket endpoint /ws pushing new samples to subscribed clients. The subscription
+ * is given as a query string, in the handshake URL or later as a text frame:
+ *
+ *     ids=1,2&interval_ms=500
+ *
+ * Without ids every sensor is streamed. A client gets at most one frame per interval,
+ * holding the latest sample of each subscribed sensor that changed since its previous
+ * frame, older samples in between are coalesced away:
+ *
+ *     {"sensors": [{"sensor_id": "1", "value": 23.51, "ts": 120345}]}
+ *
+ * ts is in ms since boot. Must be registered before the router's wildcard handlers.
+ */
+esp_err_t sensor_stream_register(httpd_handle_t server);
+
+#endif
@@ -1,4 +1,5 @@
 import requests
+import cbor_codec
 
 FLASK_SERVER = 'http://localhost:5000'
 
@@ -22,6 +23,31 @@ def test_get_sensor(sensor_id):
     check(f"GET sensor {sensor_id} status", r.status_code == expected_status)
     check(f"GET sensor {sensor_id} keys", all(k in r.json() for k in expected_keys))
 
+def test_get_sensors(ids, expected_ids):
+    print(f"\nGET /sensors?ids={ids}")
+    r = requests.get(f"{FLASK_SERVER}/sensors", params={'ids': ids} if ids else None)
+    check(f"GET sensors {ids} status", r.status_code == 200)
+    sensors = r.json().get('sensors', [])
+    check(f"GET sensors {ids} ids", [s.get('sensor_id') for s in sensors] == expected_ids)
+    check(f"GET sensors {ids} values", all('value' in s or 'error' in s for s in sensors))
+
+def test_fleet_sensors():
+    print("\nGET /fleet/sensors")
+    r = requests.get(f"{FLASK_SERVER}/fleet/sensors")
+    check("GET fleet sensors status", r.status_code == 200)
+    devices = r.json().get('devices', [])
+    check("GET fleet sensors devices", len(devices) > 0)
+    check("GET fleet sensors results", all('sensors' in d or 'error' in d for d in devices))
+
+def test_get_sensors_cbor(ids):
+    print(f"\nGET /sensors?ids={ids} as CBOR")
+    r_json = requests.get(f"{FLASK_SERVER}/sensors", params={'ids': ids})
+    r = requests.get(f"{FLASK_SERVER}/sensors", params={'ids': ids}, headers={'Accept': 'application/cbor'})
+    check("GET sensors CBOR content type", r.headers.get('Content-Type', '').startswith('application/cbor'))
+    sensors = cbor_codec.loads(r.content).get('sensors', [])
+    check("GET sensors CBOR ids", [s.get('sensor_id') for s in sensors] == ids.split(','))
+    check("GET sensors CBOR smaller", len(r.content) < len(r_json.content))
+
 def test_post_config(sensor_id, expect_success):
     print(f"\nPOST /sensor/{sensor_id}")
     data = {"scale": "metric"}
@@ -45,6 +71,15 @@ def main():
     test_get_sensor('1')
     test_get_sensor('2')
 
+    # Batch read, by ids and all sensors
+    test_get_sensors('1,2', ['1', '2'])
+    test_get_sensors('2,9', ['2', '9'])
+    test_get_sensors(None, ['1', '2'])
+    test_get_sensors_cbor('1,2')
+
+    # Fan out over every known device, only the configured one without --fleet
+    test_fleet_sensors()
+
     # 2️⃣ Test POST create config (should succeed)
     test_post_config('1', expect_success=True)
     test_post_config('2', expect_success=True)
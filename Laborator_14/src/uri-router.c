@@ -0,0 +1,207 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uri-router.h"
+
+#define ROUTER_METHODS  (HTTP_PUT + 1)  // HTTP_DELETE, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT
+
+/* One path segment of the route trie */
+struct route_node {
+    char *segment;                  // literal segment, NULL for the root and parameter nodes
+    size_t segment_len;
+    char *param;                    // parameter name of a ':' node
+    route_node_t *children;         // literal children
+    route_node_t *param_child;
+    route_node_t *next;             // next literal sibling
+    route_handler_t handlers[ROUTER_METHODS];
+};
+
+static route_node_t *node_new(const char *segment, size_t len) {
+    route_node_t *node = calloc(1, sizeof(route_node_t));
+    if (!node) {
+        return NULL;
+    }
+    char *copy = malloc(len + 1);
+    if (!copy) {
+        free(node);
+        return NULL;
+    }
+    memcpy(copy, segment, len);
+    copy[len] = '\0';
+    node->segment_len = len;
+    if (len && segment[0] == ':') {
+        node->param = copy;
+    } else {
+        node->segment = copy;
+    }
+    return node;
+}
+
+static bool node_has_handler(const route_node_t *node) {
+    for (int i = 0; i < ROUTER_METHODS; i++) {
+        if (node->handlers[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t router_add(uri_router_t *router, httpd_method_t method, const char *pattern, route_handler_t handler) {
+    if (!router || !pattern || !handler || (int)method < 0 || method >= ROUTER_METHODS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!router->root) {
+        router->root = node_new("", 0);
+        if (!router->root) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    route_node_t *node = router->root;
+    const char *p = pattern;
+    while (*p) {
+        if (*p == '/') {
+            p++;
+            continue;
+        }
+        size_t len = strcspn(p, "/");
+        route_node_t *child;
+        if (*p == ':') {
+            child = node->param_child;
+            if (child && (strlen(child->param) != len || strncmp(child->param, p, len))) {
+                return ESP_ERR_INVALID_STATE;   // another parameter name at the same position
+            }
+            if (!child) {
+                child = node_new(p, len);
+                if (!child) {
+                    return ESP_ERR_NO_MEM;
+                }
+                node->param_child = child;
+            }
+        } else {
+            for (child = node->children; child; child = child->next) {
+                if (child->segment_len == len && memcmp(child->segment, p, len) == 0) {
+                    break;
+                }
+            }
+            if (!child) {
+                child = node_new(p, len);
+                if (!child) {
+                    return ESP_ERR_NO_MEM;
+                }
+                child->next = node->children;
+                node->children = child;
+            }
+        }
+        node = child;
+        p += len;
+    }
+
+    if (node->handlers[method]) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    node->handlers[method] = handler;
+    return ESP_OK;
+}
+
+/*
+ * Walks the trie segment by segment, trying the literal child first and the parameter
+ * child if the literal one leads nowhere. Returns the node with handlers for the whole path.
+ */
+static const route_node_t *node_match(const route_node_t *node, const char *path, route_params_t *params) {
+    while (*path == '/') {
+        path++;
+    }
+    if (*path == '\0' || *path == '?' || *path == '#') {
+        return node_has_handler(node) ? node : NULL;
+    }
+
+    size_t len = strcspn(path, "/?#");
+    const route_node_t *found;
+    for (const route_node_t *child = node->children; child; child = child->next) {
+        if (child->segment_len == len && memcmp(child->segment, path, len) == 0) {
+            found = node_match(child, path + len, params);
+            if (found) {
+                return found;
+            }
+            break;
+        }
+    }
+
+    if (node->param_child && len <= ROUTER_PARAM_MAX_LEN && params->count < ROUTER_MAX_PARAMS) {
+        size_t i = params->count++;
+        params->items[i].name = node->param_child->param + 1;
+        params->items[i].len = len;
+        memcpy(params->items[i].value, path, len);
+        params->items[i].value[len] = '\0';
+        found = node_match(node->param_child, path + len, params);
+        if (found) {
+            return found;
+        }
+        params->count--;
+    }
+    return NULL;
+}
+
+esp_err_t router_match(const uri_router_t *router, httpd_method_t method, const char *path,
+                       route_handler_t *handler, route_params_t *params) {
+    params->count = 0;
+    if (!router->root) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const route_node_t *node = node_match(router->root, path, params);
+    if (!node) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if ((int)method < 0 || method >= ROUTER_METHODS || !node->handlers[method]) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    *handler = node->handlers[method];
+    return ESP_OK;
+}
+
+const char *route_param(const route_params_t *params, const char *name, size_t *len) {
+    for (size_t i = 0; i < params->count; i++) {
+        if (strcmp(params->items[i].name, name) == 0) {
+            if (len) {
+                *len = params->items[i].len;
+            }
+            return params->items[i].value;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t router_httpd_handler(httpd_req_t *req) {
+    uri_router_t *router = (uri_router_t *)req->user_ctx;
+    route_handler_t handler;
+    route_params_t params;
+
+    esp_err_t err = router_match(router, (httpd_method_t)req->method, req->uri, &handler, &params);
+    if (err == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not found");
+        return ESP_OK;
+    }
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, "Method not allowed");
+        return ESP_OK;
+    }
+    return handler(req, &params);
+}
+
+esp_err_t router_register(httpd_handle_t server, uri_router_t *router, const httpd_method_t *methods, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        httpd_uri_t uri = {
+            .uri      = "/*",
+            .method   = methods[i],
+            .handler  = router_httpd_handler,
+            .user_ctx = router,
+        };
+        esp_err_t err = httpd_register_uri_handler(server, &uri);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,52 @@
+#ifndef _URI_ROUTER_H_
+#define _URI_ROUTER_H_
+
+#include <stddef.h>
+#include "esp_http_server.h"
+
+#define ROUTER_MAX_PARAMS       4
+#define ROUTER_PARAM_MAX_LEN    31
+
+/* Path parameters captured by ":name" segments of the matched route */
+typedef struct {
+    size_t count;
+    struct {
+        const char *name;
+        size_t len;
+        char value[ROUTER_PARAM_MAX_LEN + 1];
+    } items[ROUTER_MAX_PARAMS];
+} route_params_t;
+
+typedef esp_err_t (*route_handler_t)(httpd_req_t *req, const route_params_t *params);
+
+typedef struct route_node route_node_t;
+
+typedef struct {
+    route_node_t *root;
+} uri_router_t;
+
+/*
+ * Adds a route, e.g. "/sensor/:id/config". Segments starting with ':' match any
+ * single path segment and are passed to the handler by name. Literal segments
+ * take precedence over parameters. Supported methods: DELETE, GET, HEAD, POST, PUT.
+ */
+esp_err_t router_add(uri_router_t *router, httpd_method_t method, const char *pattern, route_handler_t handler);
+
+/*
+ * Finds the handler for the path (query string is ignored) and fills in the params.
+ * Returns ESP_ERR_NOT_FOUND if no route matches the path and ESP_ERR_NOT_SUPPORTED
+ * if the path matches but not for this method.
+ */
+esp_err_t router_match(const uri_router_t *router, httpd_method_t method, const char *path,
+                       route_handler_t *handler, route_params_t *params);
+
+/* Value of the named parameter, NULL if the route has no such parameter */
+const char *route_param(const route_params_t *params, const char *name, size_t *len);
+
+/*
+ * Registers the router as catch-all handler of the given methods, the server must be
+ * started with httpd_uri_match_wildcard as uri_match_fn.
+ */
+esp_err_t router_register(httpd_handle_t server, uri_router_t *router, const httpd_method_t *methods, size_t count);
+
+#endif
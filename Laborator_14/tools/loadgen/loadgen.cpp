@@ -0,0 +1,738 @@
+// Load generator for the Lab 14 sensor REST API.
+//
+// Drives the board (or esp32_sim.py, or the built in simulator with --sim) from
+// a number of connections, each a thread with its own socket, and reports the
+// throughput, latency percentiles and errors per kind of request.
+//
+//   ./loadgen --host 192.168.1.196 --port 80 -c 8 -d 30 --rate 200
+//   ./loadgen --sim -c 16 -d 10 --mix get=60,batch=30,put=10
+//
+// With --rate the requests follow a fixed schedule and latencies are measured
+// from the time a request was due, so a stalled server shows up in the
+// percentiles instead of just slowing the test down.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum Op { OP_GET, OP_BATCH, OP_POST, OP_PUT, OP_COUNT };
+const char *const kOpNames[OP_COUNT] = {"get", "batch", "post", "put"};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8000;
+    int connections = 4;
+    double duration_s = 10;
+    double rate = 0;            // requests per second over all connections, 0 for as fast as possible
+    bool keep_alive = true;
+    bool sim = false;
+    bool cbor = false;          // ask for application/cbor responses
+    int timeout_ms = 5000;
+    std::vector<std::string> ids = {"1", "2"};
+    int weights[OP_COUNT] = {80, 20, 0, 0};
+};
+
+// ---------------------------------------------------------------------------
+// HTTP client
+
+struct Response {
+    int status = 0;
+    bool keep_alive = true;
+    std::string body;
+};
+
+enum class IoError { kNone, kConnect, kTimeout, kClosed, kProtocol };
+
+const char *io_error_name(IoError err) {
+    switch (err) {
+    case IoError::kConnect: return "connect";
+    case IoError::kTimeout: return "timeout";
+    case IoError::kClosed: return "closed";
+    case IoError::kProtocol: return "protocol";
+    default: return "none";
+    }
+}
+
+class Connection {
+public:
+    Connection(const sockaddr_in &addr, int timeout_ms) : addr_(addr), timeout_ms_(timeout_ms) {}
+    ~Connection() { close(); }
+
+    void close() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        buf_.clear();
+    }
+
+    IoError request(const std::string &req, Response *resp) {
+        if (fd_ < 0) {
+            IoError err = connect();
+            if (err != IoError::kNone) {
+                return err;
+            }
+        }
+        IoError err = send_all(req);
+        if (err == IoError::kNone) {
+            err = read_response(resp);
+        }
+        if (err != IoError::kNone || !resp->keep_alive) {
+            close();
+        }
+        return err;
+    }
+
+private:
+    IoError connect() {
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd_ < 0) {
+            return IoError::kConnect;
+        }
+        timeval tv = {timeout_ms_ / 1000, (timeout_ms_ % 1000) * 1000};
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (::connect(fd_, reinterpret_cast<const sockaddr *>(&addr_), sizeof(addr_)) != 0) {
+            IoError err = errno == EINPROGRESS || errno == ETIMEDOUT ? IoError::kTimeout : IoError::kConnect;
+            close();
+            return err;
+        }
+        return IoError::kNone;
+    }
+
+    IoError send_all(const std::string &data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK ? IoError::kTimeout : IoError::kClosed;
+            }
+            sent += n;
+        }
+        return IoError::kNone;
+    }
+
+    IoError fill() {
+        char chunk[4096];
+        ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? IoError::kTimeout : IoError::kClosed;
+        }
+        if (n == 0) {
+            return IoError::kClosed;
+        }
+        buf_.append(chunk, n);
+        return IoError::kNone;
+    }
+
+    // Reads until buf_ holds a CRLF terminated line, returns it without the CRLF
+    IoError read_line(std::string *line) {
+        size_t end;
+        while ((end = buf_.find("\r\n")) == std::string::npos) {
+            IoError err = fill();
+            if (err != IoError::kNone) {
+                return err;
+            }
+        }
+        line->assign(buf_, 0, end);
+        buf_.erase(0, end + 2);
+        return IoError::kNone;
+    }
+
+    IoError read_bytes(size_t len, std::string *out) {
+        while (buf_.size() < len) {
+            IoError err = fill();
+            if (err != IoError::kNone) {
+                return err;
+            }
+        }
+        out->append(buf_, 0, len);
+        buf_.erase(0, len);
+        return IoError::kNone;
+    }
+
+    IoError read_response(Response *resp) {
+        std::string line;
+        IoError err = read_line(&line);
+        if (err != IoError::kNone) {
+            return err;
+        }
+        if (line.compare(0, 5, "HTTP/") != 0 || line.size() < 12) {
+            return IoError::kProtocol;
+        }
+        resp->status = std::atoi(line.c_str() + 9);
+        resp->keep_alive = line.compare(0, 8, "HTTP/1.1") == 0;
+        resp->body.clear();
+
+        long content_length = -1;
+        bool chunked = false;
+        for (;;) {
+            if ((err = read_line(&line)) != IoError::kNone) {
+                return err;
+            }
+            if (line.empty()) {
+                break;
+            }
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                return IoError::kProtocol;
+            }
+            std::string name = line.substr(0, colon);
+            size_t value_start = line.find_first_not_of(' ', colon + 1);
+            std::string value = value_start == std::string::npos ? "" : line.substr(value_start);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+            if (name == "content-length") {
+                content_length = std::atol(value.c_str());
+            } else if (name == "transfer-encoding" && value.find("chunked") != std::string::npos) {
+                chunked = true;
+            } else if (name == "connection") {
+                resp->keep_alive = value.find("close") == std::string::npos;
+            }
+        }
+
+        if (resp->status == 304 || resp->status == 204) {
+            return IoError::kNone;
+        }
+        if (chunked) {
+            for (;;) {
+                if ((err = read_line(&line)) != IoError::kNone) {
+                    return err;
+                }
+                size_t size = std::strtoul(line.c_str(), nullptr, 16);
+                if (size == 0) {
+                    return read_line(&line);    // no trailers are sent by the board
+                }
+                if ((err = read_bytes(size, &resp->body)) != IoError::kNone ||
+                        (err = read_line(&line)) != IoError::kNone) {
+                    return err;
+                }
+            }
+        }
+        if (content_length >= 0) {
+            return read_bytes(content_length, &resp->body);
+        }
+        // no length, the body ends with the connection
+        resp->keep_alive = false;
+        while (fill() == IoError::kNone) {
+        }
+        resp->body.swap(buf_);
+        return IoError::kNone;
+    }
+
+    sockaddr_in addr_;
+    int timeout_ms_;
+    int fd_ = -1;
+    std::string buf_;
+};
+
+// ---------------------------------------------------------------------------
+// Built in simulator, the routes and status codes of the firmware
+
+class Simulator {
+public:
+    bool start(int port) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+                listen(listen_fd_, 128) != 0) {
+            return false;
+        }
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+        std::thread([this] { accept_loop(); }).detach();
+        return true;
+    }
+
+    int port() const { return port_; }
+
+private:
+    void accept_loop() {
+        for (;;) {
+            int fd = accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::thread([this, fd] { serve(fd); }).detach();
+        }
+    }
+
+    void serve(int fd) {
+        std::string buf;
+        char chunk[4096];
+        for (;;) {
+            size_t head_end;
+            while ((head_end = buf.find("\r\n\r\n")) == std::string::npos) {
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n <= 0) {
+                    ::close(fd);
+                    return;
+                }
+                buf.append(chunk, n);
+            }
+            std::string head = buf.substr(0, head_end);
+            std::string lower = head;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            size_t body_len = 0;
+            size_t cl = lower.find("content-length:");
+            if (cl != std::string::npos) {
+                body_len = std::strtoul(head.c_str() + cl + 15, nullptr, 10);
+            }
+            while (buf.size() < head_end + 4 + body_len) {
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n <= 0) {
+                    ::close(fd);
+                    return;
+                }
+                buf.append(chunk, n);
+            }
+            bool keep_alive = lower.find("connection: close") == std::string::npos;
+            std::string method = head.substr(0, head.find(' '));
+            size_t path_start = method.size() + 1;
+            std::string path = head.substr(path_start, head.find(' ', path_start) - path_start);
+            buf.erase(0, head_end + 4 + body_len);
+
+            int status;
+            std::string body = route(method, path, &status);
+            char header[256];
+            snprintf(header, sizeof(header),
+                     "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n%s\r\n",
+                     status, status < 300 ? "OK" : "Error", body.size(), keep_alive ? "" : "Connection: close\r\n");
+            std::string out = header + body;
+            if (send(fd, out.data(), out.size(), MSG_NOSIGNAL) < 0 || !keep_alive) {
+                ::close(fd);
+                return;
+            }
+        }
+    }
+
+    std::string sensor_value(const std::string &id) {
+        static thread_local std::mt19937 rng(std::random_device{}());
+        if (id != "1" && id != "2") {
+            return "{\"sensor_id\":\"" + id + "\",\"error\":\"Sensor not found\"}";
+        }
+        std::uniform_real_distribution<double> dist(id == "1" ? 20 : 50, id == "1" ? 30 : 60);
+        char out[64];
+        snprintf(out, sizeof(out), "{\"sensor_id\":\"%s\",\"value\":%.2f}", id.c_str(), dist(rng));
+        return out;
+    }
+
+    std::string route(const std::string &method, const std::string &path, int *status) {
+        *status = 200;
+        if (method == "GET" && path.compare(0, 8, "/sensors") == 0) {
+            std::string ids = "1,2";
+            size_t q = path.find("ids=");
+            if (q != std::string::npos) {
+                ids = path.substr(q + 4, path.find('&', q) - q - 4);
+            }
+            std::string body = "{\"sensors\":[";
+            size_t start = 0;
+            bool first = true;
+            while (start <= ids.size()) {
+                size_t end = ids.find(',', start);
+                end = end == std::string::npos ? ids.size() : end;
+                if (end > start) {
+                    body += (first ? "" : ",") + sensor_value(ids.substr(start, end - start));
+                    first = false;
+                }
+                start = end + 1;
+            }
+            return body + "]}";
+        }
+        if (path.compare(0, 8, "/sensor/") != 0) {
+            *status = 404;
+            return "{\"error\":\"Not found\"}";
+        }
+        std::string rest = path.substr(8);
+        std::string id = rest.substr(0, rest.find('/'));
+        bool known = id == "1" || id == "2";
+        if (!known) {
+            *status = 404;
+            return "{\"error\":\"Sensor not found\"}";
+        }
+        int index = id == "1" ? 0 : 1;
+        if (method == "GET" && rest == id) {
+            return sensor_value(id);
+        }
+        if (method == "POST" && rest == id) {
+            if (has_config_[index].exchange(true)) {
+                *status = 409;
+                return "{\"error\":\"Config file already exists for this sensor.\"}";
+            }
+            return "Config created";
+        }
+        if (method == "PUT" && rest == id + "/config") {
+            if (!has_config_[index]) {
+                *status = 406;
+                return "{\"error\":\"Config file does not exist; cannot update.\"}";
+            }
+            return "Config updated";
+        }
+        *status = 405;
+        return "{\"error\":\"Method not allowed\"}";
+    }
+
+    int listen_fd_ = -1;
+    int port_ = 0;
+    std::atomic<bool> has_config_[2] = {};
+};
+
+// ---------------------------------------------------------------------------
+// Load
+
+struct Stats {
+    std::vector<uint32_t> latency_us[OP_COUNT];
+    uint64_t ok[OP_COUNT] = {};
+    std::map<std::string, uint64_t> errors[OP_COUNT];     // "409", "timeout"...
+    uint64_t bytes = 0;
+};
+
+std::atomic<bool> g_stop{false};
+
+std::string build_request(const Options &opt, Op op, const std::string &id, std::mt19937 &rng) {
+    std::string path;
+    std::string method = "GET";
+    std::string body;
+    switch (op) {
+    case OP_GET:
+        path = "/sensor/" + id;
+        break;
+    case OP_BATCH: {
+        path = "/sensors?ids=";
+        for (size_t i = 0; i < opt.ids.size(); i++) {
+            path += (i ? "," : "") + opt.ids[i];
+        }
+        break;
+    }
+    case OP_POST:
+    case OP_PUT: {
+        method = op == OP_POST ? "POST" : "PUT";
+        path = op == OP_POST ? "/sensor/" + id : "/sensor/" + id + "/config";
+        body = "{\"scale\":\"metric\",\"seq\":" + std::to_string(rng() % 100000) + "}";
+        break;
+    }
+    default:
+        break;
+    }
+    std::string req = method + " " + path + " HTTP/1.1\r\nHost: " + opt.host + "\r\n";
+    if (!opt.keep_alive) {
+        req += "Connection: close\r\n";
+    }
+    if (opt.cbor) {
+        req += "Accept: application/cbor\r\n";
+    }
+    if (!body.empty()) {
+        req += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    return req + "\r\n" + body;
+}
+
+void worker(const Options &opt, const sockaddr_in &addr, int index, Stats *stats) {
+    std::mt19937 rng(std::random_device{}() + index);
+    int total_weight = 0;
+    for (int w : opt.weights) {
+        total_weight += w;
+    }
+    std::uniform_int_distribution<int> pick_op(0, total_weight - 1);
+    std::uniform_int_distribution<size_t> pick_id(0, opt.ids.size() - 1);
+
+    Connection conn(addr, opt.timeout_ms);
+    auto interval = opt.rate > 0 ? std::chrono::duration_cast<Clock::duration>(
+                                       std::chrono::duration<double>(opt.connections / opt.rate))
+                                 : Clock::duration::zero();
+    // spread the connections over the first interval instead of starting them together
+    auto due = Clock::now() + interval * index / opt.connections;
+    Response resp;
+
+    while (!g_stop.load(std::memory_order_relaxed)) {
+        if (opt.rate > 0) {
+            std::this_thread::sleep_until(due);
+        } else {
+            due = Clock::now();
+        }
+
+        int r = pick_op(rng);
+        Op op = OP_GET;
+        for (int i = 0; i < OP_COUNT; i++) {
+            if (r < opt.weights[i]) {
+                op = static_cast<Op>(i);
+                break;
+            }
+            r -= opt.weights[i];
+        }
+        std::string req = build_request(opt, op, opt.ids[pick_id(rng)], rng);
+
+        IoError err = conn.request(req, &resp);
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due).count();
+        due += interval;
+
+        if (err != IoError::kNone) {
+            stats->errors[op][io_error_name(err)]++;
+            if (err == IoError::kConnect) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));     // do not spin on a refused port
+            }
+            continue;
+        }
+        stats->latency_us[op].push_back(static_cast<uint32_t>(std::min<long long>(latency, UINT32_MAX)));
+        stats->bytes += resp.body.size();
+        if (resp.status >= 200 && resp.status < 400) {
+            stats->ok[op]++;
+        } else {
+            stats->errors[op][std::to_string(resp.status)]++;
+        }
+    }
+}
+
+double percentile(const std::vector<uint32_t> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)] / 1000.0;
+}
+
+void report(const Options &opt, const std::vector<Stats> &all, double elapsed_s) {
+    printf("\n%d connections, %.1f s, keep-alive %s, target rate %s\n", opt.connections, elapsed_s,
+           opt.keep_alive ? "on" : "off", opt.rate > 0 ? std::to_string((int)opt.rate).c_str() : "unlimited");
+    printf("%-6s %9s %9s %8s %8s %8s %8s %8s %8s\n", "op", "requests", "req/s", "p50 ms", "p90 ms", "p99 ms",
+           "p99.9", "max ms", "errors");
+
+    uint64_t total = 0;
+    uint64_t bytes = 0;
+    std::vector<uint32_t> every;
+    for (int op = 0; op < OP_COUNT; op++) {
+        std::vector<uint32_t> lat;
+        uint64_t ok = 0;
+        uint64_t errors = 0;
+        for (const Stats &s : all) {
+            lat.insert(lat.end(), s.latency_us[op].begin(), s.latency_us[op].end());
+            ok += s.ok[op];
+            for (const auto &e : s.errors[op]) {
+                errors += e.second;
+            }
+        }
+        if (ok + errors == 0) {
+            continue;
+        }
+        std::sort(lat.begin(), lat.end());
+        every.insert(every.end(), lat.begin(), lat.end());
+        total += ok + errors;
+        printf("%-6s %9llu %9.1f %8.2f %8.2f %8.2f %8.2f %8.2f %8llu\n", kOpNames[op],
+               (unsigned long long)(ok + errors), (ok + errors) / elapsed_s, percentile(lat, 50),
+               percentile(lat, 90), percentile(lat, 99), percentile(lat, 99.9), percentile(lat, 100),
+               (unsigned long long)errors);
+    }
+    std::sort(every.begin(), every.end());
+    for (const Stats &s : all) {
+        bytes += s.bytes;
+    }
+    printf("%-6s %9llu %9.1f %8.2f %8.2f %8.2f %8.2f %8.2f\n", "all", (unsigned long long)total, total / elapsed_s,
+           percentile(every, 50), percentile(every, 90), percentile(every, 99), percentile(every, 99.9),
+           percentile(every, 100));
+    printf("body bytes received: %llu (%.1f KiB/s)\n", (unsigned long long)bytes, bytes / 1024.0 / elapsed_s);
+
+    std::map<std::string, uint64_t> breakdown;
+    for (int op = 0; op < OP_COUNT; op++) {
+        for (const Stats &s : all) {
+            for (const auto &e : s.errors[op]) {
+                breakdown[std::string(kOpNames[op]) + " " + e.first] += e.second;
+            }
+        }
+    }
+    if (!breakdown.empty()) {
+        printf("errors:\n");
+        for (const auto &e : breakdown) {
+            printf("  %-16s %llu\n", e.first.c_str(), (unsigned long long)e.second);
+        }
+    }
+}
+
+bool parse_mix(const char *arg, int *weights) {
+    std::fill(weights, weights + OP_COUNT, 0);
+    std::string mix = arg;
+    size_t start = 0;
+    while (start < mix.size()) {
+        size_t end = mix.find(',', start);
+        end = end == std::string::npos ? mix.size() : end;
+        std::string item = mix.substr(start, end - start);
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            return false;
+        }
+        std::string name = item.substr(0, eq);
+        int op = std::find(kOpNames, kOpNames + OP_COUNT, name) - kOpNames;
+        if (op == OP_COUNT) {
+            return false;
+        }
+        weights[op] = std::atoi(item.c_str() + eq + 1);
+        start = end + 1;
+    }
+    int total = 0;
+    for (int i = 0; i < OP_COUNT; i++) {
+        total += weights[i];
+    }
+    return total > 0;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --host HOST          device address (default 127.0.0.1)\n"
+            "  --port PORT          device port (default 8000, esp32_sim.py)\n"
+            "  -c, --connections N  concurrent connections (default 4)\n"
+            "  -d, --duration S     test length in seconds (default 10)\n"
+            "  --rate R             total requests per second, 0 = unlimited (default 0)\n"
+            "  --mix LIST           weights, e.g. get=70,batch=20,post=5,put=5 (default get=80,batch=20)\n"
+            "  --ids LIST           sensor ids to use (default 1,2)\n"
+            "  --no-keepalive       new connection per request\n"
+            "  --cbor               ask for CBOR instead of JSON bodies\n"
+            "  --timeout MS         socket timeout (default 5000)\n"
+            "  --sim                run against a built in simulator of the firmware's API\n",
+            prog);
+}
+
+bool parse_args(int argc, char **argv, Options *opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char *v = nullptr;
+        if (arg == "--no-keepalive") {
+            opt->keep_alive = false;
+        } else if (arg == "--cbor") {
+            opt->cbor = true;
+        } else if (arg == "--sim") {
+            opt->sim = true;
+        } else if ((v = value()) == nullptr) {
+            return false;
+        } else if (arg == "--host") {
+            opt->host = v;
+        } else if (arg == "--port") {
+            opt->port = std::atoi(v);
+        } else if (arg == "-c" || arg == "--connections") {
+            opt->connections = std::atoi(v);
+        } else if (arg == "-d" || arg == "--duration") {
+            opt->duration_s = std::atof(v);
+        } else if (arg == "--rate") {
+            opt->rate = std::atof(v);
+        } else if (arg == "--timeout") {
+            opt->timeout_ms = std::atoi(v);
+        } else if (arg == "--mix") {
+            if (!parse_mix(v, opt->weights)) {
+                return false;
+            }
+        } else if (arg == "--ids") {
+            opt->ids.clear();
+            std::string ids = v;
+            size_t start = 0;
+            while (start < ids.size()) {
+                size_t end = ids.find(',', start);
+                end = end == std::string::npos ? ids.size() : end;
+                if (end > start) {
+                    opt->ids.push_back(ids.substr(start, end - start));
+                }
+                start = end + 1;
+            }
+            if (opt->ids.empty()) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return opt->connections > 0 && opt->duration_s > 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_args(argc, argv, &opt)) {
+        usage(argv[0]);
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    Simulator sim;
+    if (opt.sim) {
+        if (!sim.start(0)) {
+            perror("simulator");
+            return 1;
+        }
+        opt.host = "127.0.0.1";
+        opt.port = sim.port();
+        printf("simulator listening on 127.0.0.1:%d\n", opt.port);
+    }
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1) {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        addrinfo *res = nullptr;
+        if (getaddrinfo(opt.host.c_str(), nullptr, &hints, &res) != 0 || !res) {
+            fprintf(stderr, "cannot resolve %s\n", opt.host.c_str());
+            return 1;
+        }
+        addr.sin_addr = reinterpret_cast<sockaddr_in *>(res->ai_addr)->sin_addr;
+        freeaddrinfo(res);
+    }
+
+    // PUT needs a config to exist, create them up front (409 if they already do)
+    if (opt.weights[OP_PUT]) {
+        Connection conn(addr, opt.timeout_ms);
+        Response resp;
+        std::mt19937 rng(1);
+        for (const std::string &id : opt.ids) {
+            conn.request(build_request(opt, OP_POST, id, rng), &resp);
+        }
+    }
+
+    std::vector<Stats> stats(opt.connections);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int i = 0; i < opt.connections; i++) {
+        threads.emplace_back(worker, std::cref(opt), std::cref(addr), i, &stats[i]);
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(opt.duration_s));
+    g_stop = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    report(opt, stats, elapsed);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef _WIFI_FAST_CONNECT_H_
+#define _WIFI_FAST_CONNECT_H_
+
+#include <stdbool.h>
+#include "esp_netif.h"
+#include "esp_wifi.h"
+
+#define WIFI_FAST_NVS_NAMESPACE     "wifi_fast"
+#define WIFI_FAST_STATIC_MAX        16      // connections on the cached address before DHCP is asked again
+#define WIFI_FAST_PROBE_MS          300     // wait for a host claiming the cached address
+
+/*
+ * Station connection which starts from where the previous one ended: the BSSID,
+ * channel and DHCP lease of the last successful connection are kept in NVS, so the
+ * next connection to the same SSID skips the all-channel scan and the DHCP exchange.
+ * If that AP is gone the normal scan and DHCP follow. NVS must be initialized.
+ *
+ * The lease is not reused forever: the record counts the connections made on it and
+ * after WIFI_FAST_STATIC_MAX of them DHCP is asked again. Once connected the address
+ * is probed with ARP, a host answering for it sends the station to DHCP as well.
+ *
+ * Call before esp_wifi_set_config() with the config about to be used: when the SSID
+ * matches the cached one, the config is narrowed to the cached AP and channel and the
+ * cached address is set on sta_netif. Returns true if a fast attempt is armed.
+ */
+bool wifi_fast_connect_prepare(esp_netif_t *sta_netif, wifi_config_t *config);
+
+/*
+ * Call on WIFI_EVENT_STA_DISCONNECTED before counting a retry. Returns true if the
+ * fast attempt failed and the original config and DHCP were restored, the caller
+ * then connects again with the full scan.
+ */
+bool wifi_fast_connect_fallback(void);
+
+/*
+ * Call on IP_EVENT_STA_GOT_IP, saves the AP, lease and use count if they changed, starts
+ * the address probe and logs the boot-to-connected time
+ */
+void wifi_fast_connect_done(void);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _DNS_SERVER_H_
+#define _DNS_SERVER_H_
+
+#include "esp_err.h"
+
+#define DNS_SERVER_PORT     53
+#define DNS_SERVER_TTL_S    60
+
+/*
+ * Captive portal DNS: every A query is answered with the SoftAP's address, so a
+ * phone joining the AP finds its connectivity check redirected to the provisioning
+ * page right away instead of waiting for the lookups to time out. AAAA and other
+ * types get an empty answer, which makes the client fall back to A at once.
+ * The AP must be up, its address is read when the server starts.
+ */
+esp_err_t dns_server_start(void);
+
+/* Stops answering, e.g. once the AP is switched off. Returns without waiting for the task */
+void dns_server_stop(void);
+
+#endif
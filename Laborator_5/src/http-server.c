@@ -1,11 +1,16 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_mac.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_netif.h"
 #include "nvs_flash.h"
 
 #include "lwip/err.h"
@@ -13,10 +18,93 @@
 #include "freertos/event_groups.h"
 
 #include "esp_http_server.h"
+#include "http-server.h"
+
+#define PAGE_CHUNK_SIZE 256
 
 static const char *TAG = "HTTP_SERVER";
 
-char wifi_list_html[2048]; // Adjust size as needed
+/* Last scan result, the page is rendered from it on every GET */
+static wifi_ap_record_t *wifi_list;
+static uint16_t wifi_list_count;
+static SemaphoreHandle_t wifi_list_lock;
+
+static void wifi_list_lock_take(void)
+{
+    // created on first use, a scan can finish before the server starts
+    if (wifi_list_lock == NULL) {
+        wifi_list_lock = xSemaphoreCreateMutex();
+    }
+    xSemaphoreTake(wifi_list_lock, portMAX_DELAY);
+}
+
+/* Collects small writes into one chunk, so an option is not a send() of its own */
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t err;
+    size_t len;
+    char buf[PAGE_CHUNK_SIZE];
+} page_writer_t;
+
+static void page_flush(page_writer_t *page)
+{
+    if (page->len && page->err == ESP_OK) {
+        page->err = httpd_resp_send_chunk(page->req, page->buf, page->len);
+    }
+    page->len = 0;
+}
+
+static void page_write(page_writer_t *page, const char *data, size_t len)
+{
+    while (len && page->err == ESP_OK) {
+        if (page->len == sizeof(page->buf)) {
+            page_flush(page);
+        }
+        size_t n = MIN(len, sizeof(page->buf) - page->len);
+        memcpy(page->buf + page->len, data, n);
+        page->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void page_puts(page_writer_t *page, const char *str)
+{
+    page_write(page, str, strlen(str));
+}
+
+static void page_printf(page_writer_t *page, const char *fmt, ...)
+{
+    char tmp[64];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+    if (len > 0) {
+        page_write(page, tmp, MIN((size_t)len, sizeof(tmp) - 1));
+    }
+}
+
+/* SSIDs are arbitrary bytes chosen by whoever runs the AP, escaped for text and attribute values */
+static void page_write_escaped(page_writer_t *page, const char *str, size_t len)
+{
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        const char *entity;
+        switch (str[i]) {
+        case '&': entity = "&amp;"; break;
+        case '<': entity = "&lt;"; break;
+        case '>': entity = "&gt;"; break;
+        case '"': entity = "&quot;"; break;
+        case '\'': entity = "&#39;"; break;
+        default: continue;
+        }
+        page_write(page, str + start, i - start);
+        page_puts(page, entity);
+        start = i + 1;
+    }
+    page_write(page, str + start, len - start);
+}
 
 // Placeholder for the selected SSID and password
 char selected_ssid[32];
@@ -26,10 +114,36 @@ char password[64];
 esp_err_t get_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "GET /index.html request received");
-    /* Send the HTML content containing the WiFi list */
+    /* Stream the page with the WiFi list, there is no limit on the number of networks */
     httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, wifi_list_html, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    page_writer_t page = { .req = req, .err = ESP_OK, .len = 0 };
+    page_puts(&page, "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>WiFi Scanner</title></head>"
+                     "<body><h1>Available WiFi Networks</h1><form action=\"/results.html\" method=\"post\">"
+                     "<select name=\"ssid\">");
+
+    // held while sending, a new scan result waits for the page being sent
+    wifi_list_lock_take();
+    for (uint16_t i = 0; i < wifi_list_count && page.err == ESP_OK; i++) {
+        const char *ssid = (const char *)wifi_list[i].ssid;
+        size_t ssid_len = strnlen(ssid, sizeof(wifi_list[i].ssid));
+        page_puts(&page, "<option value=\"");
+        page_write_escaped(&page, ssid, ssid_len);
+        page_puts(&page, "\">");
+        page_write_escaped(&page, ssid, ssid_len);
+        page_printf(&page, " (RSSI: %d)</option>", wifi_list[i].rssi);
+    }
+    xSemaphoreGive(wifi_list_lock);
+
+    page_puts(&page, "</select><br><br>"
+                     "Password: <input type=\"password\" name=\"password\"><br><br>"
+                     "<input type=\"submit\" value=\"Connect\">"
+                     "</form></body></html>");
+    page_flush(&page);
+    if (page.err != ESP_OK) {
+        ESP_LOGW(TAG, "Sending the WiFi list failed: %s", esp_err_to_name(page.err));
+        return ESP_FAIL;    // the connection is closed instead of leaving the response half sent
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 /* Our URI handler function to be called during POST /results.html request */
@@ -81,6 +195,28 @@ esp_err_t post_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/*
+ * Anything else, in particular the connectivity probes of the OSes (Android /generate_204,
+ * Apple /hotspot-detect.html, Windows /connecttest.txt, Firefox /success.txt) which the
+ * captive portal DNS sends here. A redirect instead of the expected answer makes the
+ * phone open the provisioning page on its own.
+ */
+static esp_err_t captive_redirect_handler(httpd_req_t *req, httpd_err_code_t error)
+{
+    // absolute, the probe's host name stops resolving to us once the AP is gone
+    char location[40] = "/index.html";
+    esp_netif_ip_info_t ip_info;
+    esp_netif_t *ap = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+    if (ap != NULL && esp_netif_get_ip_info(ap, &ip_info) == ESP_OK) {
+        snprintf(location, sizeof(location), "http://" IPSTR "/index.html", IP2STR(&ip_info.ip));
+    }
+    ESP_LOGD(TAG, "Redirecting %s", req->uri);
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", location);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, NULL, 0);
+}
+
 /* URI handler structure for GET /index.html */
 httpd_uri_t uri_get = {
     .uri       = "/index.html",
@@ -97,21 +233,25 @@ httpd_uri_t uri_post = {
     .user_ctx  = NULL
 };
 
-/* Function to update the WiFi list HTML */
+/* Function to update the WiFi list, keeps a copy of the scan result for the page */
 void update_wifi_list(wifi_ap_record_t *ap_list, uint16_t ap_count)
 {
-    memset(wifi_list_html, 0, sizeof(wifi_list_html));
-    strcat(wifi_list_html, "<!DOCTYPE html><html><head><title>WiFi Scanner</title></head><body><h1>Available WiFi Networks</h1><form action=\"/results.html\" method=\"post\">");
-    strcat(wifi_list_html, "<select name=\"ssid\">");
-    for (int i = 0; i < ap_count; i++) {
-        char option[128];
-        snprintf(option, sizeof(option), "<option value=\"%s\">%s (RSSI: %d)</option>", ap_list[i].ssid, ap_list[i].ssid, ap_list[i].rssi);
-        strcat(wifi_list_html, option);
+    wifi_ap_record_t *copy = NULL;
+    if (ap_count) {
+        copy = malloc(ap_count * sizeof(*copy));
+        if (copy == NULL) {
+            ESP_LOGE(TAG, "No memory for %u scan results", ap_count);
+            return;     // the previous list stays
+        }
+        memcpy(copy, ap_list, ap_count * sizeof(*copy));
     }
-    strcat(wifi_list_html, "</select><br><br>");
-    strcat(wifi_list_html, "Password: <input type=\"password\" name=\"password\"><br><br>");
-    strcat(wifi_list_html, "<input type=\"submit\" value=\"Connect\">");
-    strcat(wifi_list_html, "</form></body></html>");
+
+    wifi_list_lock_take();
+    wifi_ap_record_t *old = wifi_list;
+    wifi_list = copy;
+    wifi_list_count = ap_count;
+    xSemaphoreGive(wifi_list_lock);
+    free(old);
 }
 
 /* Function for starting the webserver */
@@ -119,12 +259,15 @@ httpd_handle_t start_webserver(void)
 {
     ESP_LOGI(TAG, "Starting web server");
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    // a joining phone opens several probe connections at once, the oldest one makes room for the page
+    config.lru_purge_enable = true;
     httpd_handle_t server = NULL;
 
     if (httpd_start(&server, &config) == ESP_OK) {
         ESP_LOGI(TAG, "Registering URI handlers");
         httpd_register_uri_handler(server, &uri_get);
         httpd_register_uri_handler(server, &uri_post);
+        httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, captive_redirect_handler);
     } else {
         ESP_LOGE(TAG, "Error starting web server!");
     }
@@ -1,6 +1,12 @@
 #ifndef _HTTP_S_H_
 #define _HTTP_S_H_
 
+#include "esp_http_server.h"
+#include "esp_wifi_types.h"
+
 httpd_handle_t start_webserver(void);
 
+/* Replaces the networks listed by GET /index.html, the records are copied */
+void update_wifi_list(wifi_ap_record_t *ap_list, uint16_t ap_count);
+
 #endif
\ No newline at end of file
@@ -6,16 +6,19 @@
    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
    CONDITIONS OF ANY KIND, either express or implied.
 */
+#include <inttypes.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/queue.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_http_server.h"
+#include "esp_timer.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
@@ -25,6 +28,8 @@
 
 #include "soft-ap.h"
 #include "http-server.h"
+#include "dns-server.h"
+#include "wifi-fast-connect.h"
 
 #include "..\mdns\include\mdns.h"
 #include "..\mdns\include\mdns_console.h"
@@ -34,14 +39,9 @@
 #define CONFIG_ESP_MAXIMUM_RETRY  5
 #define CONFIG_LOCAL_PORT         10001
 
-/* FreeRTOS event group to signal when we are connected*/
-static EventGroupHandle_t s_wifi_event_group;
-
-/* The event group allows multiple bits for each event, but we only care about two events:
- * - we are connected to the AP with an IP
- * - we failed to connect after the maximum amount of retries */
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
+#define IOT_QUEUE_LEN       8
+#define IOT_TASK_STACK      4096
+#define IOT_TASK_PRIORITY   5
 
 static const char *TAG = "wifi station";
 static const char *TAG_AP = "wifi softAP";
@@ -62,7 +62,45 @@ typedef enum  {
     ERROR =0XFF
 }e_iot_states;
 
+/* What the state machine reacts to, posted by the event handler */
+typedef enum {
+    IOT_EVENT_START = 0,
+    IOT_EVENT_STA_GOT_IP,
+    IOT_EVENT_STA_FAILED,
+    IOT_EVENT_COUNT
+} e_iot_events;
+
+typedef struct {
+    e_iot_events id;
+    int64_t posted_us;
+} iot_event_t;
+
 static e_iot_states iot_mode = 0;
+static QueueHandle_t s_iot_queue;
+static int64_t s_state_entered_us;
+
+static const char *iot_event_names[IOT_EVENT_COUNT] = { "START", "STA_GOT_IP", "STA_FAILED" };
+
+static const char *iot_state_name(e_iot_states state)
+{
+    static const char *names[] = {
+        "INIT", "INIT_NVS", "START_AP", "STOP_AP", "START_HTTP", "WAIT_FOR_DATA",
+        "START_STA", "STOP_STA", "SCAN_SSID", "IDLE"
+    };
+    if (state < sizeof(names) / sizeof(names[0])) {
+        return names[state];
+    }
+    return state == ERROR ? "ERROR" : "?";
+}
+
+/* Queues an event for the state machine task, never blocks the caller */
+static void iot_post(e_iot_events id)
+{
+    iot_event_t event = { .id = id, .posted_us = esp_timer_get_time() };
+    if (xQueueSend(s_iot_queue, &event, 0) != pdTRUE) {
+        ESP_LOGE(TAG, "Event queue full, %s dropped", iot_event_names[id]);
+    }
+}
 
 
 void start_mdns_service()
@@ -161,30 +199,32 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < CONFIG_ESP_MAXIMUM_RETRY) {
+        if (wifi_fast_connect_fallback()) {
+            esp_wifi_connect();     // the cached AP is gone, not counted as a retry
+        } else if (s_retry_num < CONFIG_ESP_MAXIMUM_RETRY) {
             esp_wifi_connect();
             s_retry_num++;
             ESP_LOGI(TAG, "retry to connect to the AP");
         } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+            ESP_LOGI(TAG,"connect to the AP fail");
+            iot_post(IOT_EVENT_STA_FAILED);
         }
-        ESP_LOGI(TAG,"connect to the AP fail");
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        wifi_fast_connect_done();
         s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        iot_post(IOT_EVENT_STA_GOT_IP);
     }
 }
 
-bool wifi_init_sta(void)
+/* Starts the station, IOT_EVENT_STA_GOT_IP or IOT_EVENT_STA_FAILED follows */
+void wifi_init_sta(void)
 {
-    s_wifi_event_group = xEventGroupCreate();
-
     ESP_ERROR_CHECK(esp_netif_init());
 
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -208,105 +248,103 @@ bool wifi_init_sta(void)
             .password = CONFIG_ESP_WIFI_PASS,
         },
     };
+    // the network used last time is joined without the all-channel scan and DHCP
+    wifi_fast_connect_prepare(sta_netif, &wifi_config);
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
     ESP_ERROR_CHECK(esp_wifi_start() );
 
     ESP_LOGI(TAG, "wifi_init_sta finished.");
+}
 
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-            pdFALSE,
-            pdFALSE,
-            portMAX_DELAY);
-
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS);
-        return true;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS);
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-    }
-    return false;
+static void iot_enter(e_iot_states next, const iot_event_t *event)
+{
+    int64_t now_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "%s -> %s on %s, %" PRId64 " ms in %s, %" PRId64 " us after the event, %" PRId64 " ms since boot",
+             iot_state_name(iot_mode), iot_state_name(next), iot_event_names[event->id],
+             (now_us - s_state_entered_us) / 1000, iot_state_name(iot_mode),
+             now_us - event->posted_us, now_us / 1000);
+    iot_mode = next;
+    s_state_entered_us = now_us;
 }
 
-void app_main(void)
+/* The AP and the web server come up whether the station connected or not */
+static void iot_start_ap(const iot_event_t *event)
 {
+    iot_enter(START_AP, event);
+    ESP_LOGI(TAG_AP, "ESP_WIFI_MODE_AP");
+    wifi_init_softap();
+
+    iot_enter(START_HTTP, event);
+    static httpd_handle_t server = NULL;
+    server = start_webserver();
+    if (server == NULL) {
+        iot_enter(ERROR, event);
+        return;
+    }
+    // not fatal, the page is still reachable at the AP's address
+    if (dns_server_start() != ESP_OK) {
+        ESP_LOGW(TAG, "Captive portal DNS not started");
+    }
+    iot_enter(WAIT_FOR_DATA, event);
+}
 
+/* One transition, the blocking calls of a state run here */
+static void iot_handle_event(const iot_event_t *event)
+{
     switch (iot_mode)
     {
     case(INIT):
-        iot_mode =  INIT_NVS;
-        ESP_LOGI(TAG, "iot_mode: %d", iot_mode);
-
-        break;
-
-
-    case(INIT_NVS):
-
-        /*Initialize NVS*/
-        esp_err_t ret = nvs_flash_init();
-        if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-            ESP_ERROR_CHECK(nvs_flash_erase());
-            ret = nvs_flash_init();
+        if (event->id == IOT_EVENT_START) {
+            iot_enter(INIT_NVS, event);
+            /*Initialize NVS*/
+            esp_err_t ret = nvs_flash_init();
+            if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+                ESP_ERROR_CHECK(nvs_flash_erase());
+                ret = nvs_flash_init();
+            }
             ESP_ERROR_CHECK(ret);
+
+            iot_enter(START_STA, event);
+            wifi_init_sta();
         }
-        ESP_LOGI(TAG, "iot_mode: %d", iot_mode);
-        iot_mode =  START_AP;
-        ESP_LOGI(TAG, "iot_mode: %d", iot_mode);
         break;
 
-    case(START_AP):
-        /* Start AP */
-        ESP_LOGI(TAG_AP, "ESP_WIFI_MODE_AP");
-        bool connected = wifi_init_sta();
-        if (connected) {
+    case(START_STA):
+        if (event->id == IOT_EVENT_STA_GOT_IP) {
+            ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
+                    CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS);
             start_mdns_service();
+            iot_start_ap(event);
+        } else if (event->id == IOT_EVENT_STA_FAILED) {
+            ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
+                    CONFIG_ESP_WIFI_SSID, CONFIG_ESP_WIFI_PASS);
+            iot_start_ap(event);
         }
-        wifi_init_softap();
-        ESP_LOGI(TAG, "iot_mode: %d", iot_mode);
-        iot_mode =  START_HTTP;
-        ESP_LOGI(TAG, "iot_mode: %d", iot_mode);
-        break;
-
-    case(START_HTTP):
-        static httpd_handle_t server = NULL;
-        server = start_webserver();
-        ESP_LOGI(TAG, "iot_mode: %d", iot_mode);
-        iot_mode = WAIT_FOR_DATA;
-        ESP_LOGI(TAG, "iot_mode: %d", iot_mode);
-        break;
-
-    case(WAIT_FOR_DATA):
-
-        break;
-
-    case(STOP_STA):
-        ESP_LOGI(TAG_AP, "WIFI_MODE_APSTA");
-        esp_wifi_stop();
-        break;
-
-
-    case(SCAN_SSID):
-        ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
-        break;
-
-    case(IDLE):
-        /*Idle*/
-        break;
-    case(ERROR):
-        /* handling */
         break;
 
     default:
+        /* WAIT_FOR_DATA, IDLE, ERROR: nothing to do until the page posts the credentials */
         break;
     }
+}
+
+/* State machine task, sleeps until an event comes in */
+static void iot_task(void *arg)
+{
+    iot_event_t event;
+    for (;;) {
+        if (xQueueReceive(s_iot_queue, &event, portMAX_DELAY) == pdTRUE) {
+            iot_handle_event(&event);
+        }
+    }
+}
 
+void app_main(void)
+{
+    s_iot_queue = xQueueCreate(IOT_QUEUE_LEN, sizeof(iot_event_t));
+    ESP_ERROR_CHECK(s_iot_queue == NULL ? ESP_ERR_NO_MEM : ESP_OK);
+    s_state_entered_us = esp_timer_get_time();
+    xTaskCreate(iot_task, "iot_sm", IOT_TASK_STACK, NULL, IOT_TASK_PRIORITY, NULL);
+    iot_post(IOT_EVENT_START);
 }
\ No newline at end of file
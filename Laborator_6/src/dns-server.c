@@ -0,0 +1,174 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "lwip/sockets.h"
+
+#include "dns-server.h"
+
+#define DNS_TASK_STACK      3072
+#define DNS_TASK_PRIORITY   5
+#define DNS_MAX_LEN         512     // plain UDP DNS, EDNS is not advertised back
+#define DNS_HEADER_LEN      12
+#define DNS_ANSWER_LEN      16      // name pointer, type, class, TTL, length, IPv4 address
+
+#define DNS_FLAG_QR         0x8000
+#define DNS_OPCODE_MASK     0x7800
+#define DNS_FLAG_AA         0x0400
+#define DNS_FLAG_RD         0x0100
+#define DNS_RCODE_FORMERR   1
+#define DNS_RCODE_NOTIMP    4
+
+#define DNS_TYPE_A          1
+#define DNS_TYPE_ANY        255
+#define DNS_CLASS_IN        1
+#define DNS_CLASS_ANY       255
+
+static const char *TAG = "DNS_SERVER";
+
+static volatile bool s_running;
+static uint32_t s_ap_addr;      // network order, as in esp_netif_ip_info_t
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static void put16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+/* Turns the query in msg into its reply in place, returns the reply length or 0 to drop the packet */
+static size_t dns_reply(uint8_t *msg, size_t len, size_t size)
+{
+    if (len < DNS_HEADER_LEN) {
+        return 0;
+    }
+    uint16_t flags = get16(msg + 2);
+    if (flags & DNS_FLAG_QR) {
+        return 0;   // a response, answering it could start a loop
+    }
+
+    uint16_t rcode = 0;
+    uint16_t qtype = 0;
+    uint16_t qclass = 0;
+    size_t end = DNS_HEADER_LEN;
+    if (flags & DNS_OPCODE_MASK) {
+        rcode = DNS_RCODE_NOTIMP;
+    } else if (get16(msg + 4) != 1) {
+        rcode = DNS_RCODE_FORMERR;  // resolvers send a single question
+    } else {
+        // the name is a list of labels, a query's question has no compression pointers
+        while (end < len && msg[end] != 0 && (msg[end] & 0xC0) == 0) {
+            end += msg[end] + 1;
+        }
+        if (end + 5 > len || msg[end] != 0) {
+            rcode = DNS_RCODE_FORMERR;
+        } else {
+            qtype = get16(msg + end + 1);
+            qclass = get16(msg + end + 3);
+            end += 5;
+        }
+    }
+
+    uint16_t reply_flags = DNS_FLAG_QR | (flags & (DNS_OPCODE_MASK | DNS_FLAG_RD)) | rcode;
+    if (rcode) {
+        put16(msg + 2, reply_flags);
+        memset(msg + 4, 0, DNS_HEADER_LEN - 4);
+        return DNS_HEADER_LEN;
+    }
+
+    bool answer = (qtype == DNS_TYPE_A || qtype == DNS_TYPE_ANY) &&
+                  (qclass == DNS_CLASS_IN || qclass == DNS_CLASS_ANY) &&
+                  end + DNS_ANSWER_LEN <= size;
+    put16(msg + 2, reply_flags | DNS_FLAG_AA);
+    put16(msg + 6, answer ? 1 : 0);
+    put16(msg + 8, 0);
+    put16(msg + 10, 0);     // the query's additional records (EDNS OPT) are not echoed
+    if (!answer) {
+        return end;         // NOERROR without records, AAAA lookups fall back to A at once
+    }
+
+    uint8_t *record = msg + end;
+    put16(record, 0xC000 | DNS_HEADER_LEN);    // the name of the question
+    put16(record + 2, DNS_TYPE_A);
+    put16(record + 4, DNS_CLASS_IN);
+    put16(record + 6, DNS_SERVER_TTL_S >> 16);
+    put16(record + 8, DNS_SERVER_TTL_S & 0xFFFF);
+    put16(record + 10, sizeof(s_ap_addr));
+    memcpy(record + 12, &s_ap_addr, sizeof(s_ap_addr));
+    return end + DNS_ANSWER_LEN;
+}
+
+static void dns_task(void *arg)
+{
+    int sock = (int)(intptr_t)arg;
+    uint8_t msg[DNS_MAX_LEN];
+
+    while (s_running) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, msg, sizeof(msg), 0, (struct sockaddr *)&from, &from_len);
+        if (len <= 0) {
+            continue;   // receive timeout, s_running is checked again
+        }
+        size_t reply_len = dns_reply(msg, len, sizeof(msg));
+        if (reply_len) {
+            sendto(sock, msg, reply_len, 0, (struct sockaddr *)&from, from_len);
+        }
+    }
+    close(sock);
+    ESP_LOGI(TAG, "Stopped");
+    vTaskDelete(NULL);
+}
+
+esp_err_t dns_server_start(void)
+{
+    if (s_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_netif_ip_info_t ip_info;
+    esp_netif_t *ap = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+    if (ap == NULL || esp_netif_get_ip_info(ap, &ip_info) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_ap_addr = ip_info.ip.addr;
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return ESP_FAIL;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    // a timeout lets the task see dns_server_stop() without another task closing its socket
+    struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on port %d: errno %d", DNS_SERVER_PORT, errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+
+    s_running = true;
+    if (xTaskCreate(dns_task, "dns_server", DNS_TASK_STACK, (void *)(intptr_t)sock,
+                    DNS_TASK_PRIORITY, NULL) != pdPASS) {
+        s_running = false;
+        close(sock);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Answering every name with " IPSTR, IP2STR(&ip_info.ip));
+    return ESP_OK;
+}
+
+void dns_server_stop(void)
+{
+    s_running = false;
+}
@@ -1,3 +1,7 @@
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
 #include "freertos/FreeRTOS.h"
@@ -6,83 +10,279 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_netif.h"
 #include "nvs_flash.h"
 #include "lwip/err.h"
 #include "lwip/sys.h"
 #include "freertos/event_groups.h"
 #include "esp_http_server.h"
+#include "esp_timer.h"
+#include "wifi-scan-cache.h"
+#include "http-server.h"
+
+#define PAGE_CHUNK_SIZE 256
+#define FORM_MAX_LEN    320
+
+ESP_EVENT_DEFINE_BASE(PROV_EVENT);
 
 static const char *TAG = "HTTP_SERVER";
 
-void update_wifi_list(wifi_ap_record_t *ap_list, uint16_t ap_count);
+/* Collects small writes into one chunk, so an AP is not a send() of its own */
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t err;
+    size_t len;
+    char buf[PAGE_CHUNK_SIZE];
+} page_writer_t;
+
+static void page_flush(page_writer_t *page)
+{
+    if (page->len && page->err == ESP_OK) {
+        page->err = httpd_resp_send_chunk(page->req, page->buf, page->len);
+    }
+    page->len = 0;
+}
+
+static void page_write(page_writer_t *page, const char *data, size_t len)
+{
+    while (len && page->err == ESP_OK) {
+        if (page->len == sizeof(page->buf)) {
+            page_flush(page);
+        }
+        size_t n = MIN(len, sizeof(page->buf) - page->len);
+        memcpy(page->buf + page->len, data, n);
+        page->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void page_puts(page_writer_t *page, const char *str)
+{
+    page_write(page, str, strlen(str));
+}
 
-char wifi_list_html[2048]; 
-char selected_ssid[32];    
-char password[64];         
+static void page_printf(page_writer_t *page, const char *fmt, ...)
+{
+    char tmp[64];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+    if (len > 0) {
+        page_write(page, tmp, MIN((size_t)len, sizeof(tmp) - 1));
+    }
+}
 
-void scan_wifi_networks(void)
+/* SSIDs are arbitrary bytes chosen by whoever runs the AP, escaped for HTML text and attributes */
+static void page_write_html(page_writer_t *page, const char *str)
 {
-    uint16_t ap_count = 0;
-    wifi_ap_record_t ap_list[20]; 
+    const char *start = str;
+    for (; *str; str++) {
+        const char *entity;
+        switch (*str) {
+        case '&': entity = "&amp;"; break;
+        case '<': entity = "&lt;"; break;
+        case '>': entity = "&gt;"; break;
+        case '"': entity = "&quot;"; break;
+        case '\'': entity = "&#39;"; break;
+        default: continue;
+        }
+        page_write(page, start, str - start);
+        page_puts(page, entity);
+        start = str + 1;
+    }
+    page_puts(page, start);
+}
 
-    ESP_ERROR_CHECK(esp_wifi_scan_start(NULL, true)); 
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&ap_count, ap_list));
+/* ...and for JSON strings */
+static void page_write_json(page_writer_t *page, const char *str)
+{
+    page_puts(page, "\"");
+    const char *start = str;
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        page_write(page, start, str - start);
+        if (c == '"' || c == '\\') {
+            char escaped[2] = { '\\', c };
+            page_write(page, escaped, 2);
+        } else {
+            page_printf(page, "\\u%04x", c);
+        }
+        start = str + 1;
+    }
+    page_puts(page, start);
+    page_puts(page, "\"");
+}
 
-    ESP_LOGI(TAG, "Found %d WiFi networks", ap_count);
-    update_wifi_list(ap_list, ap_count);
+/* An SSID is listed once, with the RSSI of its strongest AP */
+static void write_option(const wifi_scan_entry_t *entry, void *ctx)
+{
+    page_writer_t *page = ctx;
+    if (entry->ssid[0] == '\0' || !entry->strongest) {
+        return;
+    }
+    page_puts(page, "<option value=\"");
+    page_write_html(page, entry->ssid);
+    page_puts(page, "\">");
+    page_write_html(page, entry->ssid);
+    page_printf(page, " (RSSI: %d)</option>", entry->rssi);
 }
 
+static esp_err_t page_finish(page_writer_t *page)
+{
+    page_flush(page);
+    if (page->err != ESP_OK) {
+        ESP_LOGW(TAG, "Sending %s failed: %s", page->req->uri, esp_err_to_name(page->err));
+        return ESP_FAIL;    // the connection is closed instead of leaving the response half sent
+    }
+    return httpd_resp_send_chunk(page->req, NULL, 0);
+}
 
+/* The page comes from the background scanner's cache, a request never waits for a scan */
 esp_err_t get_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "GET /index.html request received");
-    scan_wifi_networks(); 
     httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, wifi_list_html, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    page_writer_t page = { .req = req, .err = ESP_OK, .len = 0 };
+    page_puts(&page, "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>WiFi Scanner</title></head><body>"
+                     "<h1>Select a WiFi Network</h1><form action=\"/results.html\" method=\"post\">"
+                     "<select name=\"ssid\">");
+    wifi_scan_cache_foreach(write_option, &page);
+    page_puts(&page, "</select><br><br>"
+                     "Password: <input type=\"password\" name=\"password\"><br><br>"
+                     "<input type=\"submit\" value=\"Connect\">"
+                     "</form></body></html>");
+    return page_finish(&page);
+}
+
+typedef struct {
+    page_writer_t *page;
+    int64_t now_us;
+    bool first;
+} scan_json_t;
+
+static void write_ap_json(const wifi_scan_entry_t *entry, void *ctx)
+{
+    scan_json_t *json = ctx;
+    page_writer_t *page = json->page;
+    const uint8_t *b = entry->bssid;
+    page_printf(page, "%s{\"bssid\":\"%02x:%02x:%02x:%02x:%02x:%02x\",\"ssid\":",
+                json->first ? "" : ",", b[0], b[1], b[2], b[3], b[4], b[5]);
+    page_write_json(page, entry->ssid);
+    page_printf(page, ",\"rssi\":%d,\"channel\":%u,\"auth\":%d,\"age_s\":%lld}",
+                entry->rssi, entry->channel, (int)entry->authmode,
+                (long long)((json->now_us - entry->last_seen_us) / 1000000));
+    json->first = false;
+}
+
+/* GET /scan, every cached AP as JSON, one entry per BSSID */
+esp_err_t scan_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    page_writer_t page = { .req = req, .err = ESP_OK, .len = 0 };
+    scan_json_t json = { .page = &page, .now_us = esp_timer_get_time(), .first = true };
+    page_printf(&page, "{\"scans\":%lu,\"aps\":[", (unsigned long)wifi_scan_cache_scans());
+    wifi_scan_cache_foreach(write_ap_json, &json);
+    page_puts(&page, "]}");
+    return page_finish(&page);
+}
+
+/* Decodes a form value in place, '+' and %XX */
+static void form_decode(char *value)
+{
+    char *out = value;
+    for (char *in = value; *in; in++) {
+        if (*in == '+') {
+            *out++ = ' ';
+        } else if (*in == '%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2])) {
+            char hex[3] = { in[1], in[2], '\0' };
+            *out++ = (char)strtol(hex, NULL, 16);
+            in += 2;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
 }
 
+/* The credentials go to the provisioning state machine as a PROV_EVENT_CREDENTIALS event */
 esp_err_t post_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "POST /results.html request received");
-    char content[100];
-    size_t recv_size = MIN(req->content_len, sizeof(content) - 1); 
+    char content[FORM_MAX_LEN];
+    if (req->content_len >= sizeof(content)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Form too long");
+        return ESP_FAIL;
+    }
 
-    int ret = httpd_req_recv(req, content, recv_size);
-    if (ret <= 0) {
-        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-            httpd_resp_send_408(req);
+    size_t received = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, content + received, req->content_len - received);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                httpd_resp_send_408(req);
+            }
+            return ESP_FAIL;
         }
+        received += ret;
+    }
+    content[received] = '\0';
+
+    // the form is url encoded like a query string, with room for %XX escapes of every byte
+    prov_credentials_t credentials = { 0 };
+    char value[3 * sizeof(credentials.password)];
+    if (httpd_query_key_value(content, "ssid", value, sizeof(value)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No SSID");
         return ESP_FAIL;
     }
-    content[recv_size] = '\0';
-    ESP_LOGI(TAG, "Received content: %s", content);
-
-    char *ssid_start = strstr(content, "ssid=");
-    if (ssid_start != NULL) {
-        ssid_start += 5;
-        char *ssid_end = strchr(ssid_start, '&');
-        if (ssid_end != NULL) {
-            strncpy(selected_ssid, ssid_start, MIN(sizeof(selected_ssid) - 1, ssid_end - ssid_start));
-            selected_ssid[ssid_end - ssid_start] = '\0';
-        } else {
-            strncpy(selected_ssid, ssid_start, sizeof(selected_ssid) - 1);
-        }
-        ESP_LOGI(TAG, "Selected SSID: %s", selected_ssid);
+    form_decode(value);
+    strlcpy(credentials.ssid, value, sizeof(credentials.ssid));
+    if (httpd_query_key_value(content, "password", value, sizeof(value)) == ESP_OK) {
+        form_decode(value);
+        strlcpy(credentials.password, value, sizeof(credentials.password));
     }
+    ESP_LOGI(TAG, "Selected SSID: %s", credentials.ssid);
 
-    char *password_start = strstr(content, "password=");
-    if (password_start != NULL) {
-        password_start += 9;
-        strncpy(password, password_start, sizeof(password) - 1);
-        ESP_LOGI(TAG, "Password: %s", password);
+    esp_err_t err = esp_event_post(PROV_EVENT, PROV_EVENT_CREDENTIALS, &credentials, sizeof(credentials),
+                                   pdMS_TO_TICKS(100));
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Busy, try again");
+        return ESP_FAIL;
     }
 
-    char resp[256];
-    snprintf(resp, sizeof(resp), "SSID: %s<br>Password: %s", selected_ssid, password);
     httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    page_writer_t page = { .req = req, .err = ESP_OK, .len = 0 };
+    page_puts(&page, "<!DOCTYPE html><html><head><meta charset=\"utf-8\"></head><body>Connecting to ");
+    page_write_html(&page, credentials.ssid);
+    page_puts(&page, "...</body></html>");
+    return page_finish(&page);
+}
+
+/*
+ * Anything else, in particular the connectivity probes of the OSes (Android /generate_204,
+ * Apple /hotspot-detect.html, Windows /connecttest.txt, Firefox /success.txt) which the
+ * captive portal DNS sends here. A redirect instead of the expected answer makes the
+ * phone open the provisioning page on its own.
+ */
+static esp_err_t captive_redirect_handler(httpd_req_t *req, httpd_err_code_t error)
+{
+    // absolute, the probe's host name stops resolving to us once the AP is gone
+    char location[40] = "/index.html";
+    esp_netif_ip_info_t ip_info;
+    esp_netif_t *ap = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+    if (ap != NULL && esp_netif_get_ip_info(ap, &ip_info) == ESP_OK) {
+        snprintf(location, sizeof(location), "http://" IPSTR "/index.html", IP2STR(&ip_info.ip));
+    }
+    ESP_LOGD(TAG, "Redirecting %s", req->uri);
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", location);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, NULL, 0);
 }
 
 httpd_uri_t uri_get = {
@@ -92,6 +292,13 @@ httpd_uri_t uri_get = {
     .user_ctx = NULL
 };
 
+httpd_uri_t uri_scan = {
+    .uri = "/scan",
+    .method = HTTP_GET,
+    .handler = scan_handler,
+    .user_ctx = NULL
+};
+
 httpd_uri_t uri_post = {
     .uri = "/results.html",
     .method = HTTP_POST,
@@ -100,35 +307,20 @@ httpd_uri_t uri_post = {
 };
 
 
-void update_wifi_list(wifi_ap_record_t *ap_list, uint16_t ap_count)
-{
-    memset(wifi_list_html, 0, sizeof(wifi_list_html));
-    strcat(wifi_list_html, "<!DOCTYPE html><html><head><title>WiFi Scanner</title></head><body>");
-    strcat(wifi_list_html, "<h1>Select a WiFi Network</h1><form action=\"/results.html\" method=\"post\">");
-    strcat(wifi_list_html, "<select name=\"ssid\">");
-
-    for (int i = 0; i < ap_count; i++) {
-        char option[128];
-        snprintf(option, sizeof(option), "<option value=\"%s\">%s (RSSI: %d)</option>", ap_list[i].ssid, ap_list[i].ssid, ap_list[i].rssi);
-        strcat(wifi_list_html, option);
-    }
-
-    strcat(wifi_list_html, "</select><br><br>");
-    strcat(wifi_list_html, "Password: <input type=\"password\" name=\"password\"><br><br>");
-    strcat(wifi_list_html, "<input type=\"submit\" value=\"Connect\">");
-    strcat(wifi_list_html, "</form></body></html>");
-}
-
 httpd_handle_t start_webserver(void)
 {
     ESP_LOGI(TAG, "Starting web server");
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    // a joining phone opens several probe connections at once, the oldest one makes room for the page
+    config.lru_purge_enable = true;
     httpd_handle_t server = NULL;
 
     if (httpd_start(&server, &config) == ESP_OK) {
         ESP_LOGI(TAG, "Registering URI handlers");
         httpd_register_uri_handler(server, &uri_get);
+        httpd_register_uri_handler(server, &uri_scan);
         httpd_register_uri_handler(server, &uri_post);
+        httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, captive_redirect_handler);
     } else {
         ESP_LOGE(TAG, "Error starting web server!");
     }
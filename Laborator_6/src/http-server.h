@@ -1,6 +1,21 @@
 #ifndef _HTTP_S_H_
 #define _HTTP_S_H_
 
+#include "esp_event.h"
+#include "esp_http_server.h"
+
+/* Posted on the default event loop when the page's form is submitted */
+ESP_EVENT_DECLARE_BASE(PROV_EVENT);
+
+enum {
+    PROV_EVENT_CREDENTIALS,     // prov_credentials_t
+};
+
+typedef struct {
+    char ssid[33];
+    char password[65];
+} prov_credentials_t;
+
 httpd_handle_t start_webserver(void);
 
 #endif
\ No newline at end of file
@@ -6,10 +6,13 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 
+#include <assert.h>
+#include <inttypes.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/queue.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
@@ -25,6 +28,9 @@
 #include "esp_netif.h"
 #include "esp_timer.h"
 #include "http-server.h"
+#include "dns-server.h"
+#include "wifi-fast-connect.h"
+#include "wifi-scan-cache.h"
 #include "mdns.h"
 #include "mdns_console.h"
 
@@ -39,8 +45,9 @@
 #define DEFAULT_ESP_WIFI_CHANNEL   11
 #define DEFAULT_MAX_STA_CONN       5
 
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
+#define IOT_QUEUE_LEN       8
+#define IOT_TASK_STACK      4096
+#define IOT_TASK_PRIORITY   5
 
 /* ENUMS */
 typedef enum {
@@ -51,25 +58,110 @@ typedef enum {
     START_HTTP,
     WAIT_FOR_DATA,
     START_STA,
+    CONNECT_STA,
     STOP_STA,
     SCAN_SSID,
     IDLE,
     ERROR = 0xFF
 } e_iot_states;
 
+/* What the state machine reacts to, posted by the event handlers */
+typedef enum {
+    IOT_EVENT_START = 0,
+    IOT_EVENT_AP_STARTED,
+    IOT_EVENT_STA_STARTED,
+    IOT_EVENT_CREDENTIALS,
+    IOT_EVENT_STA_GOT_IP,
+    IOT_EVENT_STA_DISCONNECTED,
+    IOT_EVENT_COUNT
+} e_iot_events;
+
+typedef struct {
+    e_iot_events id;
+    int64_t posted_us;
+    prov_credentials_t credentials;     // IOT_EVENT_CREDENTIALS
+} iot_event_t;
+
 /* VARIABLES */
-static EventGroupHandle_t s_wifi_event_group;
 static const char *TAG = "wifi_station";
-static int livetime_counter = 0;
 static int s_retry_num = 0;
-static esp_timer_handle_t periodic_timer;
+static esp_netif_t *s_sta_netif;
 static e_iot_states iot_mode = INIT;
+static QueueHandle_t s_iot_queue;
+static int64_t s_state_entered_us;
+
+static const char *iot_event_names[IOT_EVENT_COUNT] = {
+    "START", "AP_STARTED", "STA_STARTED", "CREDENTIALS", "STA_GOT_IP", "STA_DISCONNECTED"
+};
+
+static const char *iot_state_name(e_iot_states state) {
+    static const char *names[] = {
+        "INIT", "INIT_NVS", "START_AP", "STOP_AP", "START_HTTP", "WAIT_FOR_DATA",
+        "START_STA", "CONNECT_STA", "STOP_STA", "SCAN_SSID", "IDLE"
+    };
+    if (state < sizeof(names) / sizeof(names[0])) {
+        return names[state];
+    }
+    return state == ERROR ? "ERROR" : "?";
+}
 
-/* FUNCTION DECLARATIONS */
+/* Queues an event for the state machine task, never blocks the caller */
+static void iot_post(const iot_event_t *event) {
+    if (xQueueSend(s_iot_queue, event, 0) != pdTRUE) {
+        ESP_LOGE(TAG, "Event queue full, %s dropped", iot_event_names[event->id]);
+    }
+}
+
+static void iot_post_id(e_iot_events id) {
+    iot_event_t event = { .id = id, .posted_us = esp_timer_get_time() };
+    iot_post(&event);
+}
+
+/* WiFi and IP Event Handler, runs on the event loop task and only queues the events */
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
-                               int32_t event_id, void* event_data);
+                               int32_t event_id, void* event_data) {
+    if (event_base == WIFI_EVENT) {
+        switch (event_id) {
+        case WIFI_EVENT_AP_START:
+            iot_post_id(IOT_EVENT_AP_STARTED);
+            break;
+        case WIFI_EVENT_STA_START:
+            iot_post_id(IOT_EVENT_STA_STARTED);
+            break;
+        case WIFI_EVENT_STA_DISCONNECTED:
+            iot_post_id(IOT_EVENT_STA_DISCONNECTED);
+            break;
+        case WIFI_EVENT_AP_STACONNECTED:
+            ESP_LOGI(TAG, "Device connected to AP");
+            break;
+        case WIFI_EVENT_AP_STADISCONNECTED:
+            ESP_LOGI(TAG, "Device disconnected from AP");
+            break;
+        default:
+            break;
+        }
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        iot_post_id(IOT_EVENT_STA_GOT_IP);
+    } else if (event_base == PROV_EVENT && event_id == PROV_EVENT_CREDENTIALS) {
+        iot_event_t event = { .id = IOT_EVENT_CREDENTIALS, .posted_us = esp_timer_get_time() };
+        memcpy(&event.credentials, event_data, sizeof(event.credentials));
+        iot_post(&event);
+    }
+}
+
+/* NVS Initialization */
+static void init_nvs(void) {
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+}
 
-/* WiFi SoftAP Initialization */
+/* WiFi SoftAP Initialization, WIFI_EVENT_AP_START follows */
 void wifi_init_softap(void) {
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -77,10 +169,12 @@ void wifi_init_softap(void) {
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &wifi_event_handler,
-                                                        NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
+                                                        &wifi_event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
+                                                        &wifi_event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(PROV_EVENT, ESP_EVENT_ANY_ID,
+                                                        &wifi_event_handler, NULL, NULL));
     
     wifi_config_t wifi_config = {
         .ap = {
@@ -106,96 +200,145 @@ void wifi_init_softap(void) {
              DEFAULT_ESP_WIFI_SSID, DEFAULT_ESP_WIFI_PASS, DEFAULT_ESP_WIFI_CHANNEL);
 }
 
-/* WiFi Event Handler */
-void wifi_event_handler(void* arg, esp_event_base_t event_base,
-                        int32_t event_id, void* event_data) {
-    if (event_id == WIFI_EVENT_AP_STACONNECTED) {
-        ESP_LOGI(TAG, "Device connected to AP");
-    } else if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
-        ESP_LOGI(TAG, "Device disconnected from AP");
-    }
-}
-
-/* WiFi Scaning Initialization */
+/* WiFi Scaning Initialization, the station interface is added next to the AP and WIFI_EVENT_STA_START follows */
 void wifi_init_sta(void) {
-    //ESP_ERROR_CHECK(esp_netif_init());  this cause an error
-    // ESP_ERROR_CHECK(esp_event_loop_create_default()); this cause an error
-    esp_netif_create_default_wifi_sta();
+    s_sta_netif = esp_netif_create_default_wifi_sta();
 
-   // wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();   this cause an error
-   // ESP_ERROR_CHECK(esp_wifi_init(&cfg)); this cause an error
-    
     wifi_config_t wifi_config = {};
     wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
     wifi_config.sta.threshold.rssi = -127;
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
 
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
+}
 
+/* Connects the station to the network from the form, the scanner waits meanwhile */
+static void wifi_connect_sta(const prov_credentials_t *credentials) {
+    wifi_config_t wifi_config = {};
+    wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    wifi_config.sta.threshold.rssi = -127;
+    wifi_config.sta.threshold.authmode = credentials->password[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+    strlcpy((char *)wifi_config.sta.ssid, credentials->ssid, sizeof(wifi_config.sta.ssid));
+    strlcpy((char *)wifi_config.sta.password, credentials->password, sizeof(wifi_config.sta.password));
+
+    wifi_scan_cache_pause(true);
+    esp_wifi_disconnect();
+    // the network used last time is joined without the all-channel scan and DHCP
+    wifi_fast_connect_prepare(s_sta_netif, &wifi_config);
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    s_retry_num = 0;
+    ESP_ERROR_CHECK(esp_wifi_connect());
 }
 
-/* Timer Callback */
-static void periodic_timer_callback(void *arg) {
-    livetime_counter++;
-    if (livetime_counter % 100 == 0) {
-        ESP_LOGI(TAG, "Uptime: %d seconds", livetime_counter / 100);
-        ESP_LOGI(TAG, "IoT Mode: %d", iot_mode);
-    }
-    
+static void iot_enter(e_iot_states next, const iot_event_t *event) {
+    int64_t now_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "%s -> %s on %s, %" PRId64 " ms in %s, %" PRId64 " us after the event, %" PRId64 " ms since boot",
+             iot_state_name(iot_mode), iot_state_name(next), iot_event_names[event->id],
+             (now_us - s_state_entered_us) / 1000, iot_state_name(iot_mode),
+             now_us - event->posted_us, now_us / 1000);
+    iot_mode = next;
+    s_state_entered_us = now_us;
+}
+
+/* One transition, the blocking calls of a state run here and never on the esp_timer or event loop task */
+static void iot_handle_event(const iot_event_t *event) {
     switch (iot_mode) {
         case INIT:
-            iot_mode = INIT_NVS;
+            if (event->id == IOT_EVENT_START) {
+                iot_enter(INIT_NVS, event);
+                init_nvs();
+                iot_enter(START_AP, event);
+                wifi_init_softap();
+            }
             break;
 
-        case INIT_NVS:
-            if (nvs_flash_init() != ESP_OK) {
-                ESP_ERROR_CHECK(nvs_flash_erase());
-                ESP_ERROR_CHECK(nvs_flash_init());
+        case START_AP:
+            if (event->id == IOT_EVENT_AP_STARTED) {
+                iot_enter(START_HTTP, event);
+                if (start_webserver() == NULL) {
+                    ESP_LOGE(TAG, "Failed to start webserver!");
+                    iot_enter(ERROR, event);
+                    break;
+                }
+                ESP_LOGI(TAG, "Webserver started successfully!");
+                // not fatal, the page is still reachable at the AP's address
+                if (dns_server_start() != ESP_OK) {
+                    ESP_LOGW(TAG, "Captive portal DNS not started");
+                }
+                iot_enter(START_STA, event);
+                wifi_init_sta();
             }
-            iot_mode = START_AP;
             break;
 
-        case START_AP:
-            wifi_init_softap();
-            iot_mode = START_HTTP;
+        case START_STA:
+            if (event->id == IOT_EVENT_STA_STARTED) {
+                // the pages are served from the scan cache, a request never waits for a scan
+                ESP_ERROR_CHECK(wifi_scan_cache_start());
+                iot_enter(WAIT_FOR_DATA, event);
+            }
             break;
 
-        case START_HTTP:
+        case WAIT_FOR_DATA:
+        case CONNECT_STA:
+            if (event->id == IOT_EVENT_CREDENTIALS) {
+                iot_enter(CONNECT_STA, event);
+                wifi_connect_sta(&event->credentials);
+            } else if (iot_mode == CONNECT_STA && event->id == IOT_EVENT_STA_GOT_IP) {
+                // provisioned, the AP and the scanner are no longer needed
+                wifi_fast_connect_done();
+                iot_enter(STOP_AP, event);
+                dns_server_stop();
+                ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+                iot_enter(IDLE, event);
+            } else if (iot_mode == CONNECT_STA && event->id == IOT_EVENT_STA_DISCONNECTED) {
+                if (wifi_fast_connect_fallback()) {
+                    esp_wifi_connect();     // the cached AP is gone, not counted as a retry
+                } else if (s_retry_num < CONFIG_ESP_MAXIMUM_RETRY) {
+                    s_retry_num++;
+                    ESP_LOGI(TAG, "retry to connect to the AP");
+                    esp_wifi_connect();
+                } else {
+                    // wrong password or out of range, the form can be sent again
+                    ESP_LOGI(TAG, "connect to the AP fail");
+                    wifi_scan_cache_pause(false);
+                    iot_enter(WAIT_FOR_DATA, event);
+                }
+            }
+            break;
 
-            httpd_handle_t server = start_webserver();
-            if (server) {
-            ESP_LOGI(TAG, "Webserver started successfully!");
-            iot_mode = START_STA;
-            } else {
-            iot_mode = ERROR;
-            ESP_LOGE(TAG, "Failed to start webserver!");
+        case IDLE:
+            if (event->id == IOT_EVENT_STA_DISCONNECTED) {
+                esp_wifi_connect();
             }
-           
             break;
 
-        case WAIT_FOR_DATA:
+        case INIT_NVS:
         case STOP_AP:
-        case START_STA:
-            wifi_init_sta();
-            iot_mode = WAIT_FOR_DATA;
-            break;
+        case START_HTTP:
         case STOP_STA:
         case SCAN_SSID:
-        case IDLE:
         case ERROR:
             break;
     }
 }
 
+/* State machine task, sleeps until an event comes in */
+static void iot_task(void *arg) {
+    iot_event_t event;
+    for (;;) {
+        if (xQueueReceive(s_iot_queue, &event, portMAX_DELAY) == pdTRUE) {
+            iot_handle_event(&event);
+        }
+    }
+}
+
 /* Main Application Entry */
 void app_main(void) {
-    esp_timer_create_args_t periodic_timer_args = {
-        .callback = periodic_timer_callback,
-        .name = "periodic_100ms"
-    };
-
-    ESP_ERROR_CHECK(esp_timer_create(&periodic_timer_args, &periodic_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(periodic_timer, 10000)); // 10ms
-}
\ No newline at end of file
+    s_iot_queue = xQueueCreate(IOT_QUEUE_LEN, sizeof(iot_event_t));
+    assert(s_iot_queue != NULL);
+    s_state_entered_us = esp_timer_get_time();
+    xTaskCreate(iot_task, "iot_sm", IOT_TASK_STACK, NULL, IOT_TASK_PRIORITY, NULL);
+    iot_post_id(IOT_EVENT_START);
+}
@@ -0,0 +1,220 @@
+#include <inttypes.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_netif_net_stack.h"
+#include "esp_timer.h"
+#include "lwip/etharp.h"
+#include "lwip/tcpip.h"
+#include "nvs.h"
+
+#include "wifi-fast-connect.h"
+
+#define RECORD_KEY          "last"
+#define RECORD_VERSION      2
+
+static const char *TAG = "WIFI_FAST";
+
+/* Where the last successful connection ended up, zero padded so records compare with memcmp */
+typedef struct {
+    uint8_t version;
+    uint8_t static_uses;        // connections on the cached address since DHCP last ran
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info;
+    uint32_t dns;               // network order, 0 if DHCP gave none
+} fast_record_t;
+
+static esp_netif_t *s_netif;
+static wifi_config_t s_config;  // as given by the caller, restored on fallback
+static fast_record_t s_record;
+static bool s_have_record;
+static bool s_fast;             // the cached AP is being tried
+static bool s_static_ip;        // with the cached address instead of DHCP
+static int64_t s_connect_us;
+static esp_timer_handle_t s_probe_timer;
+static uint32_t s_probe_addr;
+
+static bool record_load(fast_record_t *record)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_FAST_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(*record);
+    bool ok = nvs_get_blob(nvs, RECORD_KEY, record, &len) == ESP_OK &&
+              len == sizeof(*record) && record->version == RECORD_VERSION;
+    nvs_close(nvs);
+    return ok;
+}
+
+static void record_save(const fast_record_t *record)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(WIFI_FAST_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, RECORD_KEY, record, sizeof(*record));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Saving the connection failed: %s", esp_err_to_name(err));
+    }
+}
+
+static bool ssid_matches(const char *cached, const wifi_config_t *config)
+{
+    size_t len = strnlen((const char *)config->sta.ssid, sizeof(config->sta.ssid));
+    return len > 0 && strlen(cached) == len && memcmp(cached, config->sta.ssid, len) == 0;
+}
+
+/* The DHCP client stays stopped until a fallback, the address must not change under the connection */
+static bool use_cached_address(void)
+{
+    esp_err_t err = esp_netif_dhcpc_stop(s_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
+        return false;
+    }
+    if (esp_netif_set_ip_info(s_netif, &s_record.ip_info) != ESP_OK) {
+        esp_netif_dhcpc_start(s_netif);
+        return false;
+    }
+    if (s_record.dns != 0) {
+        esp_netif_dns_info_t dns = { .ip.type = ESP_IPADDR_TYPE_V4, .ip.u_addr.ip4.addr = s_record.dns };
+        esp_netif_set_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &dns);
+    }
+    return true;
+}
+
+/* On the lwIP task: an ARP request for the cached address, which a host holding it answers or defends */
+static void probe_send(void *arg)
+{
+    ip4_addr_t addr = { .addr = s_probe_addr };
+    etharp_request(esp_netif_get_netif_impl(s_netif), &addr);
+}
+
+/*
+ * On the lwIP task: our own ARP packets do not come back and an AP answering for its
+ * stations gives our MAC, so an entry for the address with another MAC is a second holder
+ */
+static void probe_check(void *arg)
+{
+    struct netif *netif = esp_netif_get_netif_impl(s_netif);
+    ip4_addr_t addr = { .addr = s_probe_addr };
+    struct eth_addr *mac;
+    const ip4_addr_t *entry;
+    if (!s_static_ip || etharp_find_addr(netif, &addr, &mac, &entry) < 0 ||
+        memcmp(mac->addr, netif->hwaddr, ETH_HWADDR_LEN) == 0) {
+        return;
+    }
+    ESP_LOGW(TAG, IPSTR " is in use by " MACSTR ", asking DHCP", IP2STR(&addr), MAC2STR(mac->addr));
+    s_static_ip = false;
+    esp_netif_dhcpc_start(s_netif);
+}
+
+static void probe_timer_callback(void *arg)
+{
+    tcpip_callback(probe_check, NULL);
+}
+
+static void probe_start(void)
+{
+    if (s_probe_timer == NULL) {
+        const esp_timer_create_args_t args = { .callback = probe_timer_callback, .name = "wifi_fast_probe" };
+        if (esp_timer_create(&args, &s_probe_timer) != ESP_OK) {
+            return;
+        }
+    }
+    s_probe_addr = s_record.ip_info.ip.addr;
+    if (tcpip_callback(probe_send, NULL) == ERR_OK) {
+        esp_timer_stop(s_probe_timer);
+        esp_timer_start_once(s_probe_timer, WIFI_FAST_PROBE_MS * 1000);
+    }
+}
+
+bool wifi_fast_connect_prepare(esp_netif_t *sta_netif, wifi_config_t *config)
+{
+    s_netif = sta_netif;
+    s_config = *config;
+    s_fast = false;
+    s_static_ip = false;
+    s_connect_us = esp_timer_get_time();
+
+    if (!s_have_record) {
+        s_have_record = record_load(&s_record);
+    }
+    if (!s_have_record || !ssid_matches(s_record.ssid, config)) {
+        return false;
+    }
+
+    // a directed probe on one channel instead of the scan of all of them
+    config->sta.bssid_set = true;
+    memcpy(config->sta.bssid, s_record.bssid, sizeof(config->sta.bssid));
+    config->sta.channel = s_record.channel;
+    config->sta.scan_method = WIFI_FAST_SCAN;
+    s_fast = true;
+
+    // after WIFI_FAST_STATIC_MAX connections on the cached address DHCP runs, which renews the lease with the server
+    if (s_record.static_uses < WIFI_FAST_STATIC_MAX && s_record.ip_info.ip.addr != 0) {
+        s_static_ip = use_cached_address();
+    }
+    ESP_LOGI(TAG, "Trying " MACSTR " on channel %u, %s", MAC2STR(s_record.bssid), s_record.channel,
+             s_static_ip ? "cached address" : "DHCP");
+    return true;
+}
+
+bool wifi_fast_connect_fallback(void)
+{
+    if (!s_fast) {
+        return false;
+    }
+    ESP_LOGW(TAG, "Cached AP not reachable, scanning all channels");
+    s_fast = false;
+    if (s_static_ip) {
+        s_static_ip = false;
+        esp_netif_dhcpc_start(s_netif);
+    }
+    esp_wifi_set_config(WIFI_IF_STA, &s_config);
+    return true;
+}
+
+void wifi_fast_connect_done(void)
+{
+    int64_t now_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Connected %" PRId64 " ms after boot, %" PRId64 " ms after the connect started (%s)",
+             now_us / 1000, (now_us - s_connect_us) / 1000,
+             !s_fast ? "full scan, DHCP" : s_static_ip ? "cached AP and address" : "cached AP, DHCP");
+    if (s_fast && s_static_ip) {
+        probe_start();
+    }
+    s_fast = false;
+
+    fast_record_t record;
+    memset(&record, 0, sizeof(record));
+    wifi_ap_record_t ap;
+    if (s_netif == NULL || esp_wifi_sta_get_ap_info(&ap) != ESP_OK ||
+        esp_netif_get_ip_info(s_netif, &record.ip_info) != ESP_OK) {
+        return;
+    }
+    record.version = RECORD_VERSION;
+    // counted in NVS, the limit has to hold over resets and power cycles
+    record.static_uses = s_static_ip ? s_record.static_uses + 1 : 0;
+    memcpy(record.ssid, s_config.sta.ssid, sizeof(s_config.sta.ssid));
+    memcpy(record.bssid, ap.bssid, sizeof(record.bssid));
+    record.channel = ap.primary;
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK && dns.ip.type == ESP_IPADDR_TYPE_V4) {
+        record.dns = dns.ip.u_addr.ip4.addr;
+    }
+
+    // a DHCP connection which found everything where it was does not write the flash
+    if (s_have_record && memcmp(&record, &s_record, sizeof(record)) == 0) {
+        return;
+    }
+    record_save(&record);
+    memcpy(&s_record, &record, sizeof(s_record));
+    s_have_record = true;
+}
@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_wifi.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "wifi-scan-cache.h"
+
+#define SCAN_TASK_STACK     4096
+#define SCAN_TASK_PRIORITY  (tskIDLE_PRIORITY + 2)
+#define SCAN_ACTIVE_MIN_MS  30
+#define SCAN_ACTIVE_MAX_MS  100     // per channel, the AP's clients are not served meanwhile
+
+static const char *TAG = "WIFI_SCAN";
+
+static wifi_scan_entry_t s_cache[WIFI_SCAN_CACHE_SIZE];
+static size_t s_count;
+static uint32_t s_scans;
+static SemaphoreHandle_t s_lock;
+static SemaphoreHandle_t s_scan_lock;   // held for the duration of a scan
+static volatile bool s_paused;
+
+static int compare_rssi(const void *a, const void *b)
+{
+    const wifi_scan_entry_t *x = a;
+    const wifi_scan_entry_t *y = b;
+    return y->rssi_q4 - x->rssi_q4;
+}
+
+/* The entry for bssid, a new one if it is not cached, NULL if the cache is full of stronger APs */
+static wifi_scan_entry_t *cache_slot(const uint8_t *bssid, int8_t rssi)
+{
+    for (size_t i = 0; i < s_count; i++) {
+        if (memcmp(s_cache[i].bssid, bssid, sizeof(s_cache[i].bssid)) == 0) {
+            return &s_cache[i];
+        }
+    }
+    wifi_scan_entry_t *slot;
+    if (s_count < WIFI_SCAN_CACHE_SIZE) {
+        slot = &s_cache[s_count++];
+    } else {
+        // the cache is sorted, the weakest AP is the last one
+        slot = &s_cache[WIFI_SCAN_CACHE_SIZE - 1];
+        if (slot->rssi >= rssi) {
+            return NULL;
+        }
+    }
+    memset(slot, 0, sizeof(*slot));
+    memcpy(slot->bssid, bssid, sizeof(slot->bssid));
+    slot->rssi_q4 = rssi * 16;
+    return slot;
+}
+
+static void cache_merge(const wifi_ap_record_t *records, uint16_t count, int64_t now_us)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint16_t i = 0; i < count; i++) {
+        const wifi_ap_record_t *ap = &records[i];
+        wifi_scan_entry_t *entry = cache_slot(ap->bssid, ap->rssi);
+        if (entry == NULL) {
+            continue;
+        }
+        memcpy(entry->ssid, ap->ssid, sizeof(entry->ssid) - 1);
+        entry->ssid[sizeof(entry->ssid) - 1] = '\0';
+        entry->channel = ap->primary;
+        entry->authmode = ap->authmode;
+        // RSSI of a single scan varies by several dB, averaged over about four scans
+        entry->rssi_q4 += (ap->rssi * 16 - entry->rssi_q4) / 4;
+        entry->rssi = entry->rssi_q4 / 16;
+        entry->last_seen_us = now_us;
+    }
+
+    // drop the APs which were not seen for a while
+    size_t kept = 0;
+    for (size_t i = 0; i < s_count; i++) {
+        if (now_us - s_cache[i].last_seen_us <= (int64_t)WIFI_SCAN_MAX_AGE_MS * 1000) {
+            s_cache[kept++] = s_cache[i];
+        }
+    }
+    s_count = kept;
+    qsort(s_cache, s_count, sizeof(s_cache[0]), compare_rssi);
+    for (size_t i = 0; i < s_count; i++) {
+        s_cache[i].strongest = true;
+        for (size_t j = 0; j < i && s_cache[i].strongest; j++) {
+            s_cache[i].strongest = strcmp(s_cache[j].ssid, s_cache[i].ssid) != 0;
+        }
+    }
+    s_scans++;
+    xSemaphoreGive(s_lock);
+}
+
+/* Scans channel (0 for all of them) and merges what was found */
+static void scan_step(uint8_t channel)
+{
+    xSemaphoreTake(s_scan_lock, portMAX_DELAY);
+    if (s_paused) {
+        xSemaphoreGive(s_scan_lock);
+        return;
+    }
+    wifi_scan_config_t config = {
+        .channel = channel,
+        .show_hidden = false,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active = { .min = SCAN_ACTIVE_MIN_MS, .max = SCAN_ACTIVE_MAX_MS },
+    };
+    esp_err_t err = esp_wifi_scan_start(&config, true);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Scan of channel %u failed: %s", channel, esp_err_to_name(err));
+        xSemaphoreGive(s_scan_lock);
+        return;
+    }
+
+    uint16_t count = 0;
+    esp_wifi_scan_get_ap_num(&count);
+    wifi_ap_record_t *records = count ? malloc(count * sizeof(*records)) : NULL;
+    if (records == NULL) {
+        esp_wifi_clear_ap_list();   // frees the driver's copy, which get_ap_records would have done
+        count = 0;
+    } else if (esp_wifi_scan_get_ap_records(&count, records) != ESP_OK) {
+        count = 0;
+    }
+    xSemaphoreGive(s_scan_lock);
+    cache_merge(records, count, esp_timer_get_time());
+    free(records);
+}
+
+static void scan_task(void *arg)
+{
+    scan_step(0);
+    ESP_LOGI(TAG, "First scan done, %u APs", (unsigned)s_count);
+
+    uint8_t channel = 1;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(WIFI_SCAN_STEP_MS));
+        scan_step(channel);
+        channel = channel % WIFI_SCAN_CHANNELS + 1;
+    }
+}
+
+esp_err_t wifi_scan_cache_start(void)
+{
+    wifi_mode_t mode;
+    esp_err_t err = esp_wifi_get_mode(&mode);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (mode == WIFI_MODE_AP) {
+        // scanning needs the station interface, APSTA keeps the provisioning AP up
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    s_scan_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL || s_scan_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(scan_task, "wifi_scan", SCAN_TASK_STACK, NULL, SCAN_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void wifi_scan_cache_pause(bool paused)
+{
+    s_paused = paused;
+    if (paused && s_scan_lock != NULL) {
+        // waits for the scan in progress
+        xSemaphoreTake(s_scan_lock, portMAX_DELAY);
+        xSemaphoreGive(s_scan_lock);
+    }
+}
+
+size_t wifi_scan_cache_foreach(void (*visit)(const wifi_scan_entry_t *entry, void *ctx), void *ctx)
+{
+    if (s_lock == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t count = s_count;
+    for (size_t i = 0; i < count; i++) {
+        visit(&s_cache[i], ctx);
+    }
+    xSemaphoreGive(s_lock);
+    return count;
+}
+
+uint32_t wifi_scan_cache_scans(void)
+{
+    return s_scans;
+}
@@ -0,0 +1,49 @@
+#ifndef _WIFI_SCAN_CACHE_H_
+#define _WIFI_SCAN_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+
+#define WIFI_SCAN_CACHE_SIZE        64
+#define WIFI_SCAN_CHANNELS          13
+#define WIFI_SCAN_STEP_MS           1500    // one channel per step, a full sweep takes about 20 s
+#define WIFI_SCAN_MAX_AGE_MS        60000   // entries missing from three sweeps are dropped
+
+typedef struct {
+    uint8_t bssid[6];
+    char ssid[33];
+    uint8_t channel;
+    wifi_auth_mode_t authmode;
+    int8_t rssi;            // smoothed
+    int16_t rssi_q4;        // moving average, 1/16 dBm
+    int64_t last_seen_us;   // esp_timer time
+    bool strongest;         // no other AP with this SSID is stronger
+} wifi_scan_entry_t;
+
+/*
+ * Starts the background scanner. It needs the station interface, so the AP keeps
+ * running only in APSTA mode. The first pass scans every channel, after that one
+ * channel is scanned per step, so the AP leaves its own channel for a single short
+ * dwell at a time instead of a multi-second sweep.
+ */
+esp_err_t wifi_scan_cache_start(void);
+
+/*
+ * Stops (or resumes) scanning, e.g. while the station connects. Returns once a scan
+ * in progress is over, the cache keeps what it has.
+ */
+void wifi_scan_cache_pause(bool paused);
+
+/*
+ * Calls visit for each cached AP, strongest first, with the cache locked: visit must
+ * not call back into the cache. Returns the number of entries visited.
+ */
+size_t wifi_scan_cache_foreach(void (*visit)(const wifi_scan_entry_t *entry, void *ctx), void *ctx);
+
+/* Number of completed scan steps, 0 until the first full pass is done */
+uint32_t wifi_scan_cache_scans(void);
+
+#endif